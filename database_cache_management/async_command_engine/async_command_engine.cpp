@@ -0,0 +1,598 @@
+#include "async_command_engine.h"
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<RedisEndpoint> parseEndpoints(const std::vector<std::string>& hosts) {
+    std::vector<RedisEndpoint> endpoints;
+    endpoints.reserve(hosts.size());
+    for (const auto& host : hosts) {
+        endpoints.push_back(RedisEndpoint::parse(host));
+    }
+    return endpoints;
+}
+
+const std::vector<RedisEndpoint>& validatedEndpoints(const std::vector<RedisEndpoint>& endpoints,
+                                                     const AsyncEngineOptions& options) {
+    if (endpoints.empty() || options.event_loop_threads <= 0 || options.connections_per_loop <= 0) {
+        throw std::invalid_argument("Invalid hosts or async engine options");
+    }
+    return endpoints;
+}
+
+std::exception_ptr commandError(const std::string& message) {
+    return std::make_exception_ptr(std::runtime_error(message));
+}
+
+// Each submitting thread rotates through the event loops on its own, so
+// submission does not share a counter between threads.
+size_t nextLoopHint() {
+    static std::atomic<size_t> next_hint{0};
+    thread_local size_t hint = next_hint.fetch_add(1, std::memory_order_relaxed);
+    return hint++;
+}
+
+} // namespace
+
+// One epoll event loop thread and the connections it owns. Everything except
+// submit() and the counters runs on the loop thread.
+class AsyncCommandEngine::EventLoop {
+public:
+    EventLoop(const std::vector<RedisEndpoint>& endpoints, const AsyncEngineOptions& options);
+    ~EventLoop();
+
+    // local_connection is an index into this loop's connections, or
+    // kAnyConnection.
+    void submit(char* formatted, long long length, ReplyCallback callback, size_t local_connection);
+
+    size_t connectionCount() const { return connections_.size(); }
+    size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+    int connected() const { return connected_.load(std::memory_order_relaxed); }
+
+private:
+    enum class State { Disconnected, Connecting, Connected };
+
+    struct Connection {
+        EventLoop* loop = nullptr;
+        size_t host = 0;
+        redisAsyncContext* context = nullptr;
+        State state = State::Disconnected;
+        uint32_t events = 0;         // Registered epoll interest, 0 if not registered
+        size_t in_flight = 0;
+        Clock::time_point deadline;  // Connect timeout, or next reconnect attempt
+        std::chrono::milliseconds backoff{0};
+    };
+
+    // A formatted command waiting for a connection.
+    struct Request {
+        char* command = nullptr;
+        size_t length = 0;
+        ReplyCallback callback;
+        size_t connection = kAnyConnection; // Pinned local connection
+
+        Request(char* formatted, size_t formatted_length, ReplyCallback reply_callback, size_t local_connection)
+            : command(formatted), length(formatted_length), callback(std::move(reply_callback)),
+              connection(local_connection) {}
+        Request(Request&& other) noexcept
+            : command(other.command), length(other.length), callback(std::move(other.callback)),
+              connection(other.connection) {
+            other.command = nullptr;
+        }
+        Request& operator=(Request&& other) noexcept {
+            std::swap(command, other.command);
+            length = other.length;
+            callback = std::move(other.callback);
+            connection = other.connection;
+            return *this;
+        }
+        ~Request() {
+            if (command) redisFreeCommand(command);
+        }
+    };
+
+    // Handed to hiredis as the command's privdata.
+    struct InFlight {
+        Connection* connection;
+        ReplyCallback callback;
+    };
+
+    void run();
+    void connect(Connection& connection, Clock::time_point now);
+    void connectFailed(Connection& connection, Clock::time_point now);
+    void processIncoming();
+    void processTimers(Clock::time_point now);
+    int nextTimeoutMs(Clock::time_point now) const;
+    void dispatch(Request& request);
+    void failBacklogIfUnreachable();
+    void complete(ReplyCallback& callback, const redisReply* reply, std::exception_ptr error);
+    void setEvents(Connection& connection, uint32_t events);
+    void shutdown();
+
+    // hiredis callbacks and event hooks.
+    static void onReply(redisAsyncContext* context, void* reply, void* privdata);
+    static void onConnect(const redisAsyncContext* context, int status);
+    static void onDisconnect(const redisAsyncContext* context, int status);
+    static void addRead(void* data);
+    static void delRead(void* data);
+    static void addWrite(void* data);
+    static void delWrite(void* data);
+    static void cleanup(void* data);
+
+    const std::vector<RedisEndpoint>& endpoints_;
+    const AsyncEngineOptions& options_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    std::deque<Request> backlog_; // Waiting for a connection to come up
+    std::minstd_rand jitter_;
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+
+    std::mutex mutex_;
+    std::vector<Request> incoming_; // Guarded by mutex_
+    std::atomic<bool> stopping_{false};
+    std::atomic<size_t> pending_{0};
+    std::atomic<int> connected_{0};
+    std::thread thread_;
+};
+
+AsyncCommandEngine::EventLoop::EventLoop(const std::vector<RedisEndpoint>& endpoints,
+                                         const AsyncEngineOptions& options)
+    : endpoints_(endpoints), options_(options), jitter_(std::random_device{}()) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+        if (epoll_fd_ >= 0) close(epoll_fd_);
+        if (wakeup_fd_ >= 0) close(wakeup_fd_);
+        throw std::runtime_error("Failed to create async engine event loop");
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; // The wakeup eventfd
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+
+    for (int i = 0; i < options_.connections_per_loop; ++i) {
+        for (size_t host = 0; host < endpoints_.size(); ++host) {
+            auto connection = std::make_unique<Connection>();
+            connection->loop = this;
+            connection->host = host;
+            connections_.push_back(std::move(connection));
+        }
+    }
+    thread_ = std::thread(&EventLoop::run, this);
+}
+
+AsyncCommandEngine::EventLoop::~EventLoop() {
+    stopping_ = true;
+    uint64_t one = 1;
+    (void)write(wakeup_fd_, &one, sizeof(one));
+    thread_.join();
+    close(wakeup_fd_);
+    close(epoll_fd_);
+}
+
+void AsyncCommandEngine::EventLoop::submit(char* formatted, long long length, ReplyCallback callback,
+                                           size_t local_connection) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    Request request(formatted, static_cast<size_t>(length), std::move(callback), local_connection);
+    bool accepted = false;
+    bool wake = false;
+    {
+        // Checked under the lock, which shutdown() takes to fail incoming_.
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopping_) {
+            wake = incoming_.empty();
+            incoming_.push_back(std::move(request));
+            accepted = true;
+        }
+    }
+    if (!accepted) {
+        complete(request.callback, nullptr, commandError("Async engine is shutting down"));
+        return;
+    }
+    // Only the first command of a burst pays for the wakeup.
+    if (wake) {
+        uint64_t one = 1;
+        (void)write(wakeup_fd_, &one, sizeof(one));
+    }
+}
+
+void AsyncCommandEngine::EventLoop::run() {
+    Clock::time_point now = Clock::now();
+    for (auto& connection : connections_) {
+        connect(*connection, now);
+    }
+
+    std::vector<epoll_event> events(64);
+    while (!stopping_) {
+        int ready = epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), nextTimeoutMs(Clock::now()));
+        for (int i = 0; i < ready; ++i) {
+            auto* connection = static_cast<Connection*>(events[i].data.ptr);
+            if (connection == nullptr) {
+                uint64_t count;
+                (void)read(wakeup_fd_, &count, sizeof(count));
+                continue;
+            }
+            // Handling the read can free the context (on error or EOF), which
+            // clears connection->context through the cleanup hook.
+            uint32_t flags = events[i].events;
+            if ((flags & (EPOLLIN | EPOLLERR | EPOLLHUP)) && connection->context) {
+                redisAsyncHandleRead(connection->context);
+            }
+            if ((flags & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && connection->context) {
+                redisAsyncHandleWrite(connection->context);
+            }
+        }
+        processIncoming();
+        processTimers(Clock::now());
+    }
+    shutdown();
+}
+
+void AsyncCommandEngine::EventLoop::connect(Connection& connection, Clock::time_point now) {
+    const RedisEndpoint& endpoint = endpoints_[connection.host];
+    redisAsyncContext* context = endpoint.type == RedisEndpoint::Type::Unix
+        ? redisAsyncConnectUnix(endpoint.path.c_str())
+        : redisAsyncConnect(endpoint.host.c_str(), endpoint.port);
+    if (context == nullptr || context->err) {
+        if (context) {
+            std::cerr << "Redis async connection error (" << endpoint.toString() << "): " << context->errstr << std::endl;
+            redisAsyncFree(context);
+        }
+        connectFailed(connection, now);
+        return;
+    }
+
+    if (endpoint.type == RedisEndpoint::Type::Tcp) {
+        int nodelay = endpoint.tcp_nodelay.value_or(options_.tcp_nodelay) ? 1 : 0;
+        setsockopt(context->c.fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        if (endpoint.tcp_keepalive.value_or(options_.tcp_keepalive)) {
+            redisEnableKeepAlive(&context->c);
+        }
+    }
+
+    connection.context = context;
+    connection.state = State::Connecting;
+    connection.deadline = now + endpoint.connect_timeout.value_or(options_.connect_timeout);
+    context->data = &connection;
+    context->ev.data = &connection;
+    context->ev.addRead = &EventLoop::addRead;
+    context->ev.delRead = &EventLoop::delRead;
+    context->ev.addWrite = &EventLoop::addWrite;
+    context->ev.delWrite = &EventLoop::delWrite;
+    context->ev.cleanup = &EventLoop::cleanup;
+    redisAsyncSetDisconnectCallback(context, &EventLoop::onDisconnect);
+    // Registers write interest: the first writable event completes the connect.
+    redisAsyncSetConnectCallback(context, &EventLoop::onConnect);
+}
+
+void AsyncCommandEngine::EventLoop::connectFailed(Connection& connection, Clock::time_point now) {
+    connection.state = State::Disconnected;
+    connection.backoff = connection.backoff.count() == 0
+        ? options_.reconnect_backoff_initial
+        : std::min(connection.backoff * 2, options_.reconnect_backoff_max);
+    // Equal jitter: wait between half and all of the current delay.
+    std::uniform_int_distribution<long long> distribution(connection.backoff.count() / 2, connection.backoff.count());
+    connection.deadline = now + std::chrono::milliseconds(distribution(jitter_));
+
+    // Commands pinned to this connection cannot go anywhere else.
+    size_t index = static_cast<size_t>(std::find_if(connections_.begin(), connections_.end(),
+        [&](const auto& candidate) { return candidate.get() == &connection; }) - connections_.begin());
+    std::deque<Request> waiting;
+    for (auto& request : backlog_) {
+        if (request.connection == index) {
+            complete(request.callback, nullptr, commandError("Redis connection unavailable"));
+        } else {
+            waiting.push_back(std::move(request));
+        }
+    }
+    backlog_.swap(waiting);
+    failBacklogIfUnreachable();
+}
+
+void AsyncCommandEngine::EventLoop::processIncoming() {
+    std::vector<Request> incoming;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        incoming.swap(incoming_);
+    }
+    for (auto& request : incoming) {
+        dispatch(request);
+    }
+}
+
+void AsyncCommandEngine::EventLoop::processTimers(Clock::time_point now) {
+    for (auto& connection : connections_) {
+        if (now < connection->deadline) continue;
+        if (connection->state == State::Connecting) {
+            std::cerr << "Redis async connection to " << endpoints_[connection->host].toString()
+                      << " timed out" << std::endl;
+            redisAsyncFree(connection->context); // Clears connection->context via cleanup()
+            connectFailed(*connection, now);
+        } else if (connection->state == State::Disconnected) {
+            connect(*connection, now);
+        }
+    }
+}
+
+int AsyncCommandEngine::EventLoop::nextTimeoutMs(Clock::time_point now) const {
+    Clock::time_point next = Clock::time_point::max();
+    for (const auto& connection : connections_) {
+        if (connection->state != State::Connected) {
+            next = std::min(next, connection->deadline);
+        }
+    }
+    if (next == Clock::time_point::max()) {
+        return -1;
+    }
+    // Round up so that we do not wake just before the deadline.
+    auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(next - now) + std::chrono::milliseconds(1);
+    return static_cast<int>(std::max<long long>(wait.count(), 0));
+}
+
+// Sends the request on its pinned connection or else on the connected
+// connection with the fewest commands in flight, or parks it until a
+// connection comes up.
+void AsyncCommandEngine::EventLoop::dispatch(Request& request) {
+    Connection* target = nullptr;
+    bool connecting = false;
+    if (request.connection != kAnyConnection) {
+        Connection& pinned = *connections_[request.connection];
+        if (pinned.state == State::Connected) {
+            target = &pinned;
+        } else if (pinned.state == State::Connecting) {
+            connecting = true;
+        }
+    } else {
+        for (auto& connection : connections_) {
+            if (connection->state == State::Connected) {
+                if (target == nullptr || connection->in_flight < target->in_flight) {
+                    target = connection.get();
+                }
+            } else if (connection->state == State::Connecting) {
+                connecting = true;
+            }
+        }
+    }
+
+    if (target == nullptr) {
+        if (connecting) {
+            backlog_.push_back(std::move(request));
+        } else {
+            complete(request.callback, nullptr, commandError(request.connection != kAnyConnection
+                ? "Redis connection unavailable" : "No Redis connection available"));
+        }
+        return;
+    }
+
+    auto* in_flight = new InFlight{target, std::move(request.callback)};
+    if (redisAsyncFormattedCommand(target->context, &EventLoop::onReply, in_flight,
+                                   request.command, request.length) != REDIS_OK) {
+        std::unique_ptr<InFlight> failed(in_flight);
+        complete(failed->callback, nullptr, commandError("Failed to queue Redis command"));
+        return;
+    }
+    ++target->in_flight;
+}
+
+void AsyncCommandEngine::EventLoop::failBacklogIfUnreachable() {
+    for (const auto& connection : connections_) {
+        if (connection->state != State::Disconnected) return;
+    }
+    std::deque<Request> backlog;
+    backlog.swap(backlog_);
+    for (auto& request : backlog) {
+        complete(request.callback, nullptr, commandError("No Redis connection available"));
+    }
+}
+
+void AsyncCommandEngine::EventLoop::complete(ReplyCallback& callback, const redisReply* reply,
+                                             std::exception_ptr error) {
+    pending_.fetch_sub(1, std::memory_order_relaxed);
+    // A throwing callback must not take the event loop down with it.
+    try {
+        callback(reply, error);
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in async Redis callback: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Exception in async Redis callback" << std::endl;
+    }
+}
+
+void AsyncCommandEngine::EventLoop::setEvents(Connection& connection, uint32_t events) {
+    if (events == connection.events || connection.context == nullptr) return;
+    epoll_event event{};
+    event.events = events;
+    event.data.ptr = &connection;
+    int op = connection.events == 0 ? EPOLL_CTL_ADD : (events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    epoll_ctl(epoll_fd_, op, connection.context->c.fd, &event);
+    connection.events = events;
+}
+
+void AsyncCommandEngine::EventLoop::shutdown() {
+    for (auto& connection : connections_) {
+        if (connection->context) {
+            // Fails the commands in flight through onReply().
+            redisAsyncFree(connection->context);
+        }
+    }
+    std::vector<Request> incoming;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        incoming.swap(incoming_);
+    }
+    for (auto& request : backlog_) {
+        complete(request.callback, nullptr, commandError("Async engine is shutting down"));
+    }
+    backlog_.clear();
+    for (auto& request : incoming) {
+        complete(request.callback, nullptr, commandError("Async engine is shutting down"));
+    }
+}
+
+void AsyncCommandEngine::EventLoop::onReply(redisAsyncContext* context, void* reply, void* privdata) {
+    std::unique_ptr<InFlight> in_flight(static_cast<InFlight*>(privdata));
+    Connection* connection = in_flight->connection;
+    --connection->in_flight;
+
+    auto* redis_reply = static_cast<redisReply*>(reply);
+    if (redis_reply == nullptr) {
+        std::string reason = context->err ? context->errstr : "connection closed";
+        connection->loop->complete(in_flight->callback, nullptr, commandError("Redis command failed: " + reason));
+    } else if (redis_reply->type == REDIS_REPLY_ERROR) {
+        connection->loop->complete(in_flight->callback, nullptr,
+                                   commandError(std::string(redis_reply->str, redis_reply->len)));
+    } else {
+        connection->loop->complete(in_flight->callback, redis_reply, nullptr);
+    }
+}
+
+void AsyncCommandEngine::EventLoop::onConnect(const redisAsyncContext* context, int status) {
+    auto* connection = static_cast<Connection*>(context->data);
+    EventLoop* loop = connection->loop;
+    if (status != REDIS_OK) {
+        // hiredis frees the context after this returns.
+        std::cerr << "Redis async connection error (" << loop->endpoints_[connection->host].toString()
+                  << "): " << context->errstr << std::endl;
+        loop->connectFailed(*connection, Clock::now());
+        return;
+    }
+
+    connection->state = State::Connected;
+    connection->backoff = std::chrono::milliseconds(0);
+    loop->connected_.fetch_add(1, std::memory_order_relaxed);
+    std::deque<Request> backlog;
+    backlog.swap(loop->backlog_);
+    for (auto& request : backlog) {
+        loop->dispatch(request);
+    }
+}
+
+void AsyncCommandEngine::EventLoop::onDisconnect(const redisAsyncContext* context, int status) {
+    auto* connection = static_cast<Connection*>(context->data);
+    EventLoop* loop = connection->loop;
+    loop->connected_.fetch_sub(1, std::memory_order_relaxed);
+    connection->state = State::Disconnected;
+    if (status != REDIS_OK && !loop->stopping_) {
+        std::cerr << "Redis async connection to " << loop->endpoints_[connection->host].toString()
+                  << " lost: " << context->errstr << ". Reconnecting." << std::endl;
+    }
+    // Reconnect right away; backoff only kicks in once connecting fails.
+    connection->deadline = Clock::now();
+    loop->failBacklogIfUnreachable();
+}
+
+void AsyncCommandEngine::EventLoop::addRead(void* data) {
+    auto* connection = static_cast<Connection*>(data);
+    connection->loop->setEvents(*connection, connection->events | EPOLLIN);
+}
+
+void AsyncCommandEngine::EventLoop::delRead(void* data) {
+    auto* connection = static_cast<Connection*>(data);
+    connection->loop->setEvents(*connection, connection->events & ~static_cast<uint32_t>(EPOLLIN));
+}
+
+void AsyncCommandEngine::EventLoop::addWrite(void* data) {
+    auto* connection = static_cast<Connection*>(data);
+    connection->loop->setEvents(*connection, connection->events | EPOLLOUT);
+}
+
+void AsyncCommandEngine::EventLoop::delWrite(void* data) {
+    auto* connection = static_cast<Connection*>(data);
+    connection->loop->setEvents(*connection, connection->events & ~static_cast<uint32_t>(EPOLLOUT));
+}
+
+// Called by hiredis right before it frees the context.
+void AsyncCommandEngine::EventLoop::cleanup(void* data) {
+    auto* connection = static_cast<Connection*>(data);
+    connection->loop->setEvents(*connection, 0);
+    connection->context = nullptr;
+}
+
+AsyncCommandEngine::AsyncCommandEngine(const std::vector<std::string>& hosts, const AsyncEngineOptions& options)
+    : AsyncCommandEngine(parseEndpoints(hosts), options) {
+}
+
+AsyncCommandEngine::AsyncCommandEngine(const std::vector<RedisEndpoint>& endpoints, const AsyncEngineOptions& options)
+    : endpoints_(validatedEndpoints(endpoints, options)), options_(options) {
+    for (int i = 0; i < options_.event_loop_threads; ++i) {
+        loops_.push_back(std::make_unique<EventLoop>(endpoints_, options_));
+    }
+}
+
+AsyncCommandEngine::~AsyncCommandEngine() {
+    loops_.clear();
+}
+
+// Formatting happens on the submitting thread, so the loops only copy bytes.
+template<typename Args>
+void AsyncCommandEngine::submit(const Args& args, ReplyCallback callback, size_t connection) {
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+    char* formatted = nullptr;
+    long long length = redisFormatCommandArgv(&formatted, static_cast<int>(argv.size()), argv.data(), argvlen.data());
+    if (length < 0 || formatted == nullptr) {
+        throw std::runtime_error("Failed to format Redis command");
+    }
+    if (connection == kAnyConnection) {
+        loops_[nextLoopHint() % loops_.size()]->submit(formatted, length, std::move(callback), kAnyConnection);
+    } else {
+        // Connections are numbered round-robin across the loops.
+        loops_[connection % loops_.size()]->submit(formatted, length, std::move(callback), connection / loops_.size());
+    }
+}
+
+void AsyncCommandEngine::command(std::initializer_list<std::string_view> args, ReplyCallback callback) {
+    submit(args, std::move(callback));
+}
+
+void AsyncCommandEngine::command(const std::vector<std::string>& args, ReplyCallback callback) {
+    submit(args, std::move(callback));
+}
+
+void AsyncCommandEngine::commandOn(size_t connection, const std::vector<std::string>& args, ReplyCallback callback) {
+    if (connection >= connectionCount()) {
+        throw std::out_of_range("Async engine connection index out of range");
+    }
+    submit(args, std::move(callback), connection);
+}
+
+size_t AsyncCommandEngine::connectionCount() const {
+    return loops_.size() * loops_.front()->connectionCount();
+}
+
+size_t AsyncCommandEngine::pending() const {
+    size_t total = 0;
+    for (const auto& loop : loops_) {
+        total += loop->pending();
+    }
+    return total;
+}
+
+int AsyncCommandEngine::connected() const {
+    int total = 0;
+    for (const auto& loop : loops_) {
+        total += loop->connected();
+    }
+    return total;
+}
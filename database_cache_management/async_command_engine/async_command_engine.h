@@ -0,0 +1,138 @@
+#ifndef ASYNC_COMMAND_ENGINE_H
+#define ASYNC_COMMAND_ENGINE_H
+
+#include <connection_pool_manager/redis_endpoint.h>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <type_traits>
+
+// Forward declaration for hiredis reply
+struct redisReply;
+
+// Callback of an asynchronous service operation. It receives the result, or
+// a default-constructed result and the error if the operation failed.
+template<typename T>
+struct AsyncCallbackOf {
+    using type = std::function<void(T result, std::exception_ptr error)>;
+};
+
+template<>
+struct AsyncCallbackOf<void> {
+    using type = std::function<void(std::exception_ptr error)>;
+};
+
+template<typename T>
+using AsyncCallback = typename AsyncCallbackOf<T>::type;
+
+// Starts a callback-style operation and returns a future for its result;
+// operation is invoked with the AsyncCallback<T> that fulfils the future.
+template<typename T, typename Operation>
+std::future<T> asyncToFuture(Operation&& operation) {
+    auto promise = std::make_shared<std::promise<T>>();
+    std::future<T> future = promise->get_future();
+    if constexpr (std::is_void_v<T>) {
+        operation(AsyncCallback<void>([promise](std::exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value();
+            }
+        }));
+    } else {
+        operation(AsyncCallback<T>([promise](T result, std::exception_ptr error) {
+            if (error) {
+                promise->set_exception(error);
+            } else {
+                promise->set_value(std::move(result));
+            }
+        }));
+    }
+    return future;
+}
+
+struct AsyncEngineOptions {
+    // Each event loop thread owns its connections and runs their callbacks.
+    int event_loop_threads = 1;
+    // Connections per host and event loop. Commands are pipelined, so a few
+    // connections carry thousands of outstanding commands.
+    int connections_per_loop = 1;
+    // Connection defaults, overridable per endpoint (see RedisEndpoint).
+    std::chrono::milliseconds connect_timeout{1000};
+    bool tcp_nodelay = true;
+    bool tcp_keepalive = true;
+    // Per-connection reconnect backoff, doubled after every failed attempt.
+    std::chrono::milliseconds reconnect_backoff_initial{100};
+    std::chrono::milliseconds reconnect_backoff_max{30000};
+};
+
+// Non-blocking Redis client on the hiredis async API.
+//
+// Commands are queued from any thread and written by epoll-driven event loop
+// threads (no libevent or other event library), which pipeline everything
+// queued since their last wakeup into one write per connection. Replies are
+// delivered to callbacks on the event loop thread, so callbacks must not
+// block: they hold up every connection of their loop.
+//
+// Commands submitted while a loop is still connecting wait for the
+// connection; while none of its connections can be reached they fail
+// immediately, and commands in flight on a connection that drops fail with
+// the connection error. Broken connections are reopened with backoff.
+class AsyncCommandEngine {
+public:
+    // Receives the reply, or nullptr and the error if the command failed
+    // (error reply, lost connection or engine shutdown).
+    using ReplyCallback = std::function<void(const redisReply* reply, std::exception_ptr error)>;
+
+    // Each host is an endpoint URI as accepted by RedisEndpoint::parse().
+    AsyncCommandEngine(const std::vector<std::string>& hosts,
+                       const AsyncEngineOptions& options = AsyncEngineOptions());
+    AsyncCommandEngine(const std::vector<RedisEndpoint>& endpoints,
+                       const AsyncEngineOptions& options = AsyncEngineOptions());
+    // Fails whatever is still queued or in flight.
+    ~AsyncCommandEngine();
+
+    // Deleted copy and move constructors/assignments
+    AsyncCommandEngine(const AsyncCommandEngine&) = delete;
+    AsyncCommandEngine& operator=(const AsyncCommandEngine&) = delete;
+    AsyncCommandEngine(AsyncCommandEngine&&) = delete;
+    AsyncCommandEngine& operator=(AsyncCommandEngine&&) = delete;
+
+    // Queues a command. Arguments are binary safe and copied before this
+    // returns.
+    void command(std::initializer_list<std::string_view> args, ReplyCallback callback);
+    void command(const std::vector<std::string>& args, ReplyCallback callback);
+    // Sends the command on one particular connection, numbered from 0 to
+    // connectionCount() - 1, so that commands sent on the same connection
+    // execute in submission order. Fails if that connection is down.
+    void commandOn(size_t connection, const std::vector<std::string>& args, ReplyCallback callback);
+
+    size_t connectionCount() const;
+
+    // Commands submitted but not completed yet.
+    size_t pending() const;
+    // Live connections across all event loops.
+    int connected() const;
+
+private:
+    class EventLoop;
+
+    static constexpr size_t kAnyConnection = static_cast<size_t>(-1);
+
+    // Formats the command and hands it to a loop (defined in the .cpp).
+    template<typename Args>
+    void submit(const Args& args, ReplyCallback callback, size_t connection = kAnyConnection);
+
+    const std::vector<RedisEndpoint> endpoints_;
+    const AsyncEngineOptions options_;
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+};
+
+#endif // ASYNC_COMMAND_ENGINE_H
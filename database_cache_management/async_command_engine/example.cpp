@@ -0,0 +1,52 @@
+#include "async_command_engine.h"
+#include <hiredis/hiredis.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main() {
+    try {
+        std::vector<std::string> hosts = {"127.0.0.1"};
+        AsyncCommandEngine engine(hosts);
+
+        const std::string counter_key = "async_example:counter";
+        const int commands = 10000;
+
+        // Fire off all increments without waiting; they are pipelined on the
+        // engine's connection.
+        std::atomic<int> remaining{commands};
+        std::promise<void> done;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < commands; ++i) {
+            engine.command({"INCR", counter_key}, [&](const redisReply*, std::exception_ptr error) {
+                if (error) {
+                    std::cerr << "INCR failed" << std::endl;
+                }
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+        done.get_future().wait();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << commands << " INCR commands completed in " << elapsed.count() << " ms" << std::endl;
+
+        std::promise<std::string> value;
+        engine.command({"GET", counter_key}, [&](const redisReply* reply, std::exception_ptr error) {
+            value.set_value(error ? "error" : std::string(reply->str, reply->len));
+        });
+        std::cout << "Counter value: " << value.get_future().get() << std::endl;
+
+        std::promise<void> deleted;
+        engine.command({"DEL", counter_key}, [&](const redisReply*, std::exception_ptr) { deleted.set_value(); });
+        deleted.get_future().wait();
+    } catch (const std::exception& e) {
+        std::cerr << "An exception occurred: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include "async_command_engine.h"
+#include <gtest/gtest.h>
+#include <hiredis/hiredis.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+// We will use a live Redis server for integration testing.
+// Make sure Redis is running on localhost:6379.
+
+namespace {
+
+// Runs one command and waits for its reply, converted to a string.
+std::string roundTrip(AsyncCommandEngine& engine, std::initializer_list<std::string_view> args) {
+    std::promise<std::string> promise;
+    engine.command(args, [&promise](const redisReply* reply, std::exception_ptr error) {
+        if (error) {
+            promise.set_exception(error);
+        } else if (reply->type == REDIS_REPLY_INTEGER) {
+            promise.set_value(std::to_string(reply->integer));
+        } else if (reply->type == REDIS_REPLY_NIL) {
+            promise.set_value("(nil)");
+        } else {
+            promise.set_value(std::string(reply->str, reply->len));
+        }
+    });
+    return promise.get_future().get();
+}
+
+} // namespace
+
+TEST(AsyncCommandEngineTest, BasicCommands) {
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"});
+
+    EXPECT_EQ(roundTrip(engine, {"PING"}), "PONG");
+    EXPECT_EQ(roundTrip(engine, {"SET", "async_key", std::string("a\0b", 3)}), "OK");
+    EXPECT_EQ(roundTrip(engine, {"GET", "async_key"}), std::string("a\0b", 3));
+    EXPECT_EQ(roundTrip(engine, {"DEL", "async_key"}), "1");
+    EXPECT_EQ(roundTrip(engine, {"GET", "async_key"}), "(nil)");
+    EXPECT_EQ(engine.connected(), 1);
+    EXPECT_EQ(engine.pending(), 0u);
+}
+
+TEST(AsyncCommandEngineTest, ThousandsOfCommandsInFlight) {
+    AsyncEngineOptions options;
+    options.event_loop_threads = 2;
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"}, options);
+    roundTrip(engine, {"DEL", "async_counter"});
+
+    const int threads = 4;
+    const int per_thread = 5000;
+    std::atomic<int> completed{0};
+    std::atomic<int> failed{0};
+    std::promise<void> done;
+    std::vector<std::thread> submitters;
+    for (int t = 0; t < threads; ++t) {
+        submitters.emplace_back([&]() {
+            for (int i = 0; i < per_thread; ++i) {
+                engine.command({"INCR", "async_counter"}, [&](const redisReply* reply, std::exception_ptr error) {
+                    if (error || reply->type != REDIS_REPLY_INTEGER) {
+                        failed++;
+                    }
+                    if (++completed == threads * per_thread) {
+                        done.set_value();
+                    }
+                });
+            }
+        });
+    }
+    for (auto& submitter : submitters) {
+        submitter.join();
+    }
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(30)), std::future_status::ready);
+
+    EXPECT_EQ(failed.load(), 0);
+    EXPECT_EQ(roundTrip(engine, {"GET", "async_counter"}), std::to_string(threads * per_thread));
+    roundTrip(engine, {"DEL", "async_counter"});
+}
+
+TEST(AsyncCommandEngineTest, ErrorReplyFailsOnlyThatCommand) {
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"});
+    roundTrip(engine, {"SET", "async_text", "not a number"});
+
+    EXPECT_THROW(roundTrip(engine, {"INCR", "async_text"}), std::runtime_error);
+    EXPECT_EQ(roundTrip(engine, {"GET", "async_text"}), "not a number");
+    roundTrip(engine, {"DEL", "async_text"});
+}
+
+TEST(AsyncCommandEngineTest, PinnedCommandsKeepTheirOrder) {
+    AsyncEngineOptions options;
+    options.event_loop_threads = 2;
+    options.connections_per_loop = 2;
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"}, options);
+    ASSERT_EQ(engine.connectionCount(), 4u);
+    roundTrip(engine, {"DEL", "async_pinned"});
+
+    // Every connection appends its own marker in order.
+    const int per_connection = 200;
+    std::atomic<int> remaining{static_cast<int>(engine.connectionCount()) * per_connection};
+    std::promise<void> done;
+    for (int i = 0; i < per_connection; ++i) {
+        for (size_t c = 0; c < engine.connectionCount(); ++c) {
+            engine.commandOn(c, {"RPUSH", "async_pinned:" + std::to_string(c), std::to_string(i)},
+                             [&](const redisReply*, std::exception_ptr) {
+                if (--remaining == 0) {
+                    done.set_value();
+                }
+            });
+        }
+    }
+    ASSERT_EQ(done.get_future().wait_for(std::chrono::seconds(10)), std::future_status::ready);
+    for (size_t c = 0; c < engine.connectionCount(); ++c) {
+        std::string key = "async_pinned:" + std::to_string(c);
+        EXPECT_EQ(roundTrip(engine, {"LINDEX", key, "0"}), "0");
+        EXPECT_EQ(roundTrip(engine, {"LINDEX", key, "-1"}), std::to_string(per_connection - 1));
+        roundTrip(engine, {"DEL", key});
+    }
+
+    EXPECT_THROW(engine.commandOn(engine.connectionCount(), {"PING"}, [](const redisReply*, std::exception_ptr) {}),
+                 std::out_of_range);
+}
+
+TEST(AsyncCommandEngineTest, UnreachableHostFailsCommands) {
+    AsyncEngineOptions options;
+    options.connect_timeout = std::chrono::milliseconds(200);
+    // Nothing listens on port 1.
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1:1"}, options);
+
+    auto start = std::chrono::steady_clock::now();
+    EXPECT_THROW(roundTrip(engine, {"PING"}), std::runtime_error);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(2));
+    EXPECT_EQ(engine.connected(), 0);
+}
+
+TEST(AsyncCommandEngineTest, ReconnectsAfterConnectionLoss) {
+    AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"});
+    EXPECT_EQ(roundTrip(engine, {"PING"}), "PONG");
+
+    // QUIT makes the server close the connection after replying.
+    EXPECT_EQ(roundTrip(engine, {"QUIT"}), "OK");
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    std::string reply;
+    while (std::chrono::steady_clock::now() < deadline) {
+        try {
+            reply = roundTrip(engine, {"PING"});
+            break;
+        } catch (const std::runtime_error&) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+    EXPECT_EQ(reply, "PONG");
+    EXPECT_EQ(engine.connected(), 1);
+}
+
+TEST(AsyncCommandEngineTest, DestructionFailsPendingCommands) {
+    std::future<void> blocked;
+    std::atomic<int> failed{0};
+    {
+        AsyncCommandEngine engine(std::vector<std::string>{"127.0.0.1"});
+        EXPECT_EQ(roundTrip(engine, {"PING"}), "PONG");
+        // Blocks the connection for a second, so the commands behind it are
+        // still in flight when the engine goes away.
+        engine.command({"BLPOP", "async_never_pushed", "1"}, [&](const redisReply*, std::exception_ptr error) {
+            if (error) failed++;
+        });
+        for (int i = 0; i < 10; ++i) {
+            engine.command({"PING"}, [&](const redisReply*, std::exception_ptr error) {
+                if (error) failed++;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    EXPECT_EQ(failed.load(), 11);
+}
+
+TEST(AsyncCommandEngineTest, AsyncToFutureAdaptsCallbacks) {
+    std::future<int> value = asyncToFuture<int>([](AsyncCallback<int> callback) {
+        callback(42, nullptr);
+    });
+    EXPECT_EQ(value.get(), 42);
+
+    std::future<void> failure = asyncToFuture<void>([](AsyncCallback<void> callback) {
+        callback(std::make_exception_ptr(std::runtime_error("boom")));
+    });
+    EXPECT_THROW(failure.get(), std::runtime_error);
+}
+
+TEST(AsyncCommandEngineTest, InvalidInitialization) {
+    EXPECT_THROW(AsyncCommandEngine(std::vector<std::string>{}), std::invalid_argument);
+    AsyncEngineOptions options;
+    options.event_loop_threads = 0;
+    EXPECT_THROW(AsyncCommandEngine(std::vector<std::string>{"127.0.0.1"}, options), std::invalid_argument);
+}
@@ -0,0 +1,226 @@
+#include "batch_executor.h"
+#include <hiredis/hiredis.h>
+#include <stdexcept>
+#include <algorithm>
+
+namespace {
+
+const std::string kNoError;
+
+std::string replyTypeError(const char* expected) {
+    return std::string("Unexpected reply type in batch, expected ") + expected;
+}
+
+} // namespace
+
+BatchExecutor::BatchExecutor(ConnectionPoolManager* pool_manager, size_t max_in_flight)
+    : guard_(pool_manager), max_in_flight_(std::max<size_t>(max_in_flight, 1)) {
+}
+
+BatchExecutor::BatchExecutor(ConnectionPoolManager* pool_manager, std::chrono::milliseconds timeout,
+                             size_t max_in_flight)
+    : guard_(pool_manager, timeout), max_in_flight_(std::max<size_t>(max_in_flight, 1)) {
+}
+
+BatchExecutor::~BatchExecutor() {
+    // Unread replies would be picked up by the connection's next user, so
+    // clear() reads them before the guard returns the connection.
+    clear();
+}
+
+size_t BatchExecutor::add(std::initializer_list<std::string_view> args) {
+    argv_.clear();
+    argvlen_.clear();
+    for (std::string_view arg : args) {
+        argv_.push_back(arg.data());
+        argvlen_.push_back(arg.size());
+    }
+    return append(argv_.size(), argv_.data(), argvlen_.data());
+}
+
+size_t BatchExecutor::add(const std::vector<std::string>& args) {
+    argv_.clear();
+    argvlen_.clear();
+    for (const auto& arg : args) {
+        argv_.push_back(arg.data());
+        argvlen_.push_back(arg.size());
+    }
+    return append(argv_.size(), argv_.data(), argvlen_.data());
+}
+
+size_t BatchExecutor::add(const std::vector<std::string_view>& args) {
+    argv_.clear();
+    argvlen_.clear();
+    for (std::string_view arg : args) {
+        argv_.push_back(arg.data());
+        argvlen_.push_back(arg.size());
+    }
+    return append(argv_.size(), argv_.data(), argvlen_.data());
+}
+
+size_t BatchExecutor::append(size_t argc, const char** argv, const size_t* argvlen) {
+    if (argc == 0) {
+        throw std::invalid_argument("Empty command in batch");
+    }
+    if (pending() >= max_in_flight_) {
+        drain(max_in_flight_ / 2);
+    }
+
+    // A command that fails here gets its error now and no reply; drain()
+    // steps over it when it comes up, after the replies queued before it.
+    redisContext* context = guard_.getContext();
+    size_t index = results_.size();
+    results_.emplace_back();
+    if (context->err) {
+        // The connection broke earlier in this batch; fail fast.
+        results_.back().error = context->errstr;
+    } else if (redisAppendCommandArgv(context, static_cast<int>(argc), argv, argvlen) != REDIS_OK) {
+        results_.back().error = context->errstr[0] ? context->errstr : "Failed to queue command";
+    }
+    return index;
+}
+
+void BatchExecutor::execute() {
+    drain(0);
+}
+
+// Reads replies until at most keep_in_flight remain outstanding. The first
+// read flushes the whole output buffer, so the commands go out in one write.
+void BatchExecutor::drain(size_t keep_in_flight) {
+    redisContext* context = guard_.getContext();
+    while (pending() > keep_in_flight) {
+        Result& result = results_[received_];
+        ++received_;
+        if (!result.error.empty()) {
+            continue; // Failed while queueing, no reply to read
+        }
+
+        void* raw = nullptr;
+        if (redisGetReply(context, &raw) != REDIS_OK || raw == nullptr) {
+            // The stream is out of sync now; fail everything still in flight.
+            std::string error = context->errstr[0] ? context->errstr : "Failed to read reply";
+            result.error = error;
+            for (; received_ < results_.size(); ++received_) {
+                if (results_[received_].error.empty()) {
+                    results_[received_].error = error;
+                }
+            }
+            return;
+        }
+
+        redisReply* reply = static_cast<redisReply*>(raw);
+        if (reply->type == REDIS_REPLY_ERROR) {
+            result.error = reply->len > 0 ? std::string(reply->str, reply->len) : "Redis error reply";
+            freeReplyObject(reply);
+        } else {
+            result.reply = reply;
+        }
+    }
+}
+
+void BatchExecutor::clear() {
+    if (pending() > 0) {
+        drain(0);
+    }
+    for (auto& result : results_) {
+        if (result.reply) {
+            freeReplyObject(result.reply);
+        }
+    }
+    results_.clear();
+    received_ = 0;
+}
+
+size_t BatchExecutor::failures() const {
+    // Executed commands without a reply, plus those that failed while queueing.
+    size_t failed = 0;
+    for (size_t i = 0; i < results_.size(); ++i) {
+        if (i < received_ ? results_[i].reply == nullptr : !results_[i].error.empty()) ++failed;
+    }
+    return failed;
+}
+
+const BatchExecutor::Result& BatchExecutor::executed(size_t index) const {
+    if (index >= results_.size()) {
+        throw std::out_of_range("Batch command index out of range");
+    }
+    if (index >= received_) {
+        throw std::logic_error("Batch command has not been executed yet");
+    }
+    return results_[index];
+}
+
+const redisReply* BatchExecutor::checked(size_t index) const {
+    const Result& result = executed(index);
+    if (result.reply == nullptr) {
+        throw std::runtime_error("Batch command failed: " + result.error);
+    }
+    return result.reply;
+}
+
+bool BatchExecutor::ok(size_t index) const {
+    return executed(index).reply != nullptr;
+}
+
+const std::string& BatchExecutor::error(size_t index) const {
+    const Result& result = executed(index);
+    return result.reply ? kNoError : result.error;
+}
+
+bool BatchExecutor::isNil(size_t index) const {
+    const redisReply* reply = executed(index).reply;
+    return reply != nullptr && reply->type == REDIS_REPLY_NIL;
+}
+
+long long BatchExecutor::integer(size_t index) const {
+    const redisReply* reply = checked(index);
+    if (reply->type != REDIS_REPLY_INTEGER) {
+        throw std::runtime_error(replyTypeError("integer"));
+    }
+    return reply->integer;
+}
+
+std::optional<std::string> BatchExecutor::string(size_t index) const {
+    const redisReply* reply = checked(index);
+    if (reply->type == REDIS_REPLY_NIL) {
+        return std::nullopt;
+    }
+    return std::string(view(index));
+}
+
+std::string_view BatchExecutor::view(size_t index) const {
+    const redisReply* reply = checked(index);
+    if (reply->type == REDIS_REPLY_NIL) {
+        return std::string_view();
+    }
+    if (reply->type != REDIS_REPLY_STRING && reply->type != REDIS_REPLY_STATUS) {
+        throw std::runtime_error(replyTypeError("string"));
+    }
+    return std::string_view(reply->str, reply->len);
+}
+
+std::vector<std::optional<std::string>> BatchExecutor::array(size_t index) const {
+    const redisReply* reply = checked(index);
+    if (reply->type != REDIS_REPLY_ARRAY) {
+        throw std::runtime_error(replyTypeError("array"));
+    }
+    std::vector<std::optional<std::string>> elements;
+    elements.reserve(reply->elements);
+    for (size_t i = 0; i < reply->elements; ++i) {
+        const redisReply* element = reply->element[i];
+        if (element->type == REDIS_REPLY_NIL) {
+            elements.emplace_back();
+        } else if (element->type == REDIS_REPLY_STRING || element->type == REDIS_REPLY_STATUS) {
+            elements.emplace_back(std::string(element->str, element->len));
+        } else if (element->type == REDIS_REPLY_INTEGER) {
+            elements.emplace_back(std::to_string(element->integer));
+        } else {
+            throw std::runtime_error(replyTypeError("array of strings"));
+        }
+    }
+    return elements;
+}
+
+const redisReply* BatchExecutor::reply(size_t index) const {
+    return executed(index).reply;
+}
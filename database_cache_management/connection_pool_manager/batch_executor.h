@@ -0,0 +1,106 @@
+#ifndef BATCH_EXECUTOR_H
+#define BATCH_EXECUTOR_H
+
+#include "connection_pool_manager.h"
+#include "redis_connection_guard.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+#include <initializer_list>
+#include <chrono>
+#include <cstddef>
+
+// Forward declaration for hiredis reply
+struct redisReply;
+
+// Pipelines commands on one pooled connection.
+//
+// add() appends a command to the connection's output buffer
+// (redisAppendCommandArgv, so arguments are binary safe); execute() sends
+// everything queued in one write and then reads the replies, so a batch of N
+// commands costs one round-trip instead of N.
+//
+//   BatchExecutor batch(pool.get());
+//   size_t a = batch.add({"INCRBY", "hits", "5"});
+//   size_t b = batch.add({"GET", "config"});
+//   batch.execute();
+//   long long hits = batch.integer(a);
+//   std::optional<std::string> config = batch.string(b);
+//
+// Errors are isolated per command: an error reply only fails its own entry,
+// and the typed accessors throw for that entry alone. If the connection
+// breaks mid-batch, the commands whose replies were not read fail with the
+// connection error, and the connection is quarantined when the batch returns
+// it to the pool.
+class BatchExecutor {
+public:
+    // Commands queued beyond this many unread replies make add() drain the
+    // replies received so far, which bounds the buffers on both ends.
+    static constexpr size_t kDefaultMaxInFlight = 1024;
+
+    explicit BatchExecutor(ConnectionPoolManager* pool_manager, size_t max_in_flight = kDefaultMaxInFlight);
+    // Throws ConnectionPoolTimeout if no connection frees up within timeout.
+    BatchExecutor(ConnectionPoolManager* pool_manager, std::chrono::milliseconds timeout,
+                  size_t max_in_flight = kDefaultMaxInFlight);
+    ~BatchExecutor();
+
+    // Deleted copy and move constructors/assignments
+    BatchExecutor(const BatchExecutor&) = delete;
+    BatchExecutor& operator=(const BatchExecutor&) = delete;
+    BatchExecutor(BatchExecutor&&) = delete;
+    BatchExecutor& operator=(BatchExecutor&&) = delete;
+
+    // Queues a command and returns its index for the result accessors.
+    size_t add(std::initializer_list<std::string_view> args);
+    size_t add(const std::vector<std::string>& args);
+    size_t add(const std::vector<std::string_view>& args);
+
+    // Sends the queued commands and reads all outstanding replies. Does not
+    // throw for failed commands; check them with ok() or the accessors.
+    void execute();
+
+    // Frees the results and starts a new batch on the same connection.
+    void clear();
+
+    size_t size() const { return results_.size(); }
+    size_t pending() const { return results_.size() - received_; }
+    // Number of commands that failed, including any that could not even be
+    // queued.
+    size_t failures() const;
+
+    // Per-command results, valid once execute() has read the reply.
+    bool ok(size_t index) const;
+    // Error message of a failed command, empty if it succeeded.
+    const std::string& error(size_t index) const;
+    bool isNil(size_t index) const;
+    // The accessors below throw std::runtime_error if the command failed
+    // or its reply has a different type.
+    long long integer(size_t index) const;
+    std::optional<std::string> string(size_t index) const; // nullopt for nil
+    std::string_view view(size_t index) const;             // Valid until clear(); empty for nil
+    std::vector<std::optional<std::string>> array(size_t index) const;
+    // Raw reply for other types, nullptr if the command failed.
+    const redisReply* reply(size_t index) const;
+
+private:
+    struct Result {
+        redisReply* reply = nullptr;
+        std::string error;
+    };
+
+    size_t append(size_t argc, const char** argv, const size_t* argvlen);
+    void drain(size_t keep_in_flight);
+    const Result& executed(size_t index) const;
+    const redisReply* checked(size_t index) const;
+
+    RedisConnectionGuard guard_;
+    const size_t max_in_flight_;
+    std::vector<Result> results_;
+    size_t received_ = 0;
+    // Argument scratch space reused across add() calls.
+    std::vector<const char*> argv_;
+    std::vector<size_t> argvlen_;
+};
+
+#endif // BATCH_EXECUTOR_H
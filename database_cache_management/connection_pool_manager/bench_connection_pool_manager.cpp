@@ -0,0 +1,65 @@
+#include "connection_pool_manager.h"
+#include <hiredis/hiredis.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Contention benchmark for ConnectionPoolManager checkout/return.
+// Make sure Redis is running on localhost:6379.
+//
+// Usage: connection_pool_manager_bench [pool_size] [duration_ms] [ping] [endpoint]
+// With "ping" every checkout also does a PING round-trip, which makes it easy to
+// compare e.g. 127.0.0.1 against unix:///var/run/redis/redis.sock.
+
+int main(int argc, char** argv) {
+    const int pool_size = argc > 1 ? std::stoi(argv[1]) : 32;
+    const auto duration = std::chrono::milliseconds(argc > 2 ? std::stoi(argv[2]) : 1000);
+    const bool ping = argc > 3 && std::string(argv[3]) == "ping";
+    const std::string endpoint = argc > 4 ? argv[4] : "127.0.0.1";
+
+    try {
+        ConnectionPoolManager pool(std::vector<std::string>{endpoint}, pool_size);
+
+        std::cout << endpoint << " pool_size=" << pool_size << (ping ? " (checkout + PING)" : " (checkout only)") << std::endl;
+        std::cout << "threads\tops/sec" << std::endl;
+
+        for (int num_threads : {1, 2, 4, 8, 16, 32, 64}) {
+            std::atomic<bool> stop{false};
+            std::atomic<long long> total_ops{0};
+
+            std::vector<std::thread> threads;
+            for (int t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&]() {
+                    long long ops = 0;
+                    while (!stop.load(std::memory_order_relaxed)) {
+                        redisContext* conn = pool.getConnection();
+                        if (ping) {
+                            redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+                            if (reply) freeReplyObject(reply);
+                        }
+                        pool.returnConnection(conn);
+                        ++ops;
+                    }
+                    total_ops += ops;
+                });
+            }
+
+            std::this_thread::sleep_for(duration);
+            stop = true;
+            for (auto& t : threads) {
+                t.join();
+            }
+
+            double seconds = std::chrono::duration<double>(duration).count();
+            std::cout << num_threads << "\t" << static_cast<long long>(total_ops / seconds) << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "An exception occurred: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,20 +3,113 @@
 #include <hiredis/hiredis.h>
 #include <iostream>
 #include <stdexcept>
+#include <algorithm>
 #include <chrono>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
 
-ConnectionPoolManager::ConnectionPoolManager(const std::vector<std::string>& hosts, int pool_size)
-    : redis_hosts_(hosts), pool_size_(pool_size), in_use_(pool_size, false) {
-    if (redis_hosts_.empty() || pool_size_ <= 0) {
+namespace {
+
+// Returns the number of slots to allocate: the maximum pool size.
+int validatedPoolSize(const std::vector<RedisEndpoint>& endpoints, int pool_size,
+                      const ConnectionPoolOptions& options) {
+    if (endpoints.empty() || pool_size <= 0) {
         throw std::invalid_argument("Invalid hosts or pool size");
     }
+    if (options.min_pool_size > pool_size || (options.max_pool_size >= 0 && options.max_pool_size < pool_size)) {
+        throw std::invalid_argument("Pool size must lie between min_pool_size and max_pool_size");
+    }
+    if (options.resize_interval.count() <= 0) {
+        throw std::invalid_argument("Invalid resize interval");
+    }
+    return std::max(pool_size, options.max_pool_size);
+}
+
+std::vector<RedisEndpoint> parseEndpoints(const std::vector<std::string>& hosts) {
+    std::vector<RedisEndpoint> endpoints;
+    endpoints.reserve(hosts.size());
+    for (const auto& host : hosts) {
+        endpoints.push_back(RedisEndpoint::parse(host));
+    }
+    return endpoints;
+}
+
+// Each thread starts its idle-slot search at its own stripe, so threads tend to
+// check out and return connections on different cache lines.
+size_t threadStripeHint() {
+    static std::atomic<size_t> next_hint{0};
+    thread_local size_t hint = next_hint.fetch_add(1, std::memory_order_relaxed);
+    return hint;
+}
+
+constexpr size_t kCheckoutShards = 16;
+
+// Upper bounds of the checkout wait-time histogram buckets.
+const std::vector<std::chrono::microseconds> kWaitBucketBounds = {
+    std::chrono::microseconds(0),
+    std::chrono::microseconds(100),
+    std::chrono::microseconds(250),
+    std::chrono::microseconds(500),
+    std::chrono::milliseconds(1),
+    std::chrono::milliseconds(5),
+    std::chrono::milliseconds(10),
+    std::chrono::milliseconds(50),
+    std::chrono::milliseconds(100),
+    std::chrono::milliseconds(500),
+    std::chrono::seconds(1),
+    std::chrono::microseconds::max(),
+};
 
-    pool_.resize(pool_size, nullptr);
+// Weight of a new latency sample in the per-host EWMA.
+constexpr double kLatencyEwmaWeight = 0.2;
+
+timeval toTimeval(std::chrono::milliseconds timeout) {
+    timeval tv;
+    tv.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+    return tv;
+}
+
+} // namespace
+
+ConnectionPoolManager::ConnectionPoolManager(const std::vector<std::string>& hosts, int pool_size,
+                                             const ConnectionPoolOptions& options)
+    : ConnectionPoolManager(parseEndpoints(hosts), pool_size, options) {
+}
+
+ConnectionPoolManager::ConnectionPoolManager(const std::vector<RedisEndpoint>& endpoints, int pool_size,
+                                             const ConnectionPoolOptions& options)
+    : endpoints_(endpoints), pool_size_(validatedPoolSize(endpoints, pool_size, options)),
+      min_size_(options.min_pool_size < 0 ? pool_size : options.min_pool_size), options_(options),
+      pool_(pool_size_, nullptr), routes_(new HostRoute[endpoints.size()]),
+      slot_states_(new std::atomic<SlotState>[pool_size_]), idle_since_(pool_size_),
+      context_slots_(pool_size_), checkout_shards_(new CheckoutShard[kCheckoutShards]),
+      wait_histogram_(new std::atomic<uint64_t>[kWaitBucketBounds.size()]()),
+      host_backoff_(endpoints.size()), jitter_(std::random_device{}()) {
+    for (size_t host = 0; host < endpoints_.size(); ++host) {
+        size_t host_slots = (pool_size_ + endpoints_.size() - 1 - host) / endpoints_.size();
+        routes_[host].idle_slots.reset(new IdleSlotSet(host_slots));
+    }
+
+    // The health engine opens the initial connections in parallel on its
+    // first pass; consecutive slots map to different hosts, so a lazy pool's
+    // initial connections are spread across hosts.
+    int initial = options_.lazy_connect ? std::min(std::max(options_.min_ready, 0), pool_size) : pool_size;
     for (int i = 0; i < pool_size_; ++i) {
-        pool_[i] = connectToRedis(redis_hosts_[i % redis_hosts_.size()]);
+        slot_states_[i].store(i < initial ? SlotState::Disconnected : SlotState::Unopened);
     }
+    unopened_ = pool_size_ - initial;
 
     health_check_thread_ = std::thread(&ConnectionPoolManager::healthCheck, this);
+
+    int min_ready = options_.min_ready < 0 ? initial : std::min(options_.min_ready, initial);
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiters_.fetch_add(1); // Wakes us from releaseSlot() as connections come up
+    condition_.wait(lock, [&] {
+        return warmup_done_ || connected_.load() >= min_ready;
+    });
+    waiters_.fetch_sub(1);
 }
 
 ConnectionPoolManager::~ConnectionPoolManager() {
@@ -25,6 +118,7 @@ ConnectionPoolManager::~ConnectionPoolManager() {
         shutting_down_ = true;
     }
     condition_.notify_all();
+    health_condition_.notify_all();
     health_check_thread_.join();
 
     for (auto conn : pool_) {
@@ -34,87 +128,542 @@ ConnectionPoolManager::~ConnectionPoolManager() {
     }
 }
 
-redisContext* ConnectionPoolManager::connectToRedis(const std::string& host) {
-    redisContext* context = redisConnect(host.c_str(), 6379);
+redisContext* ConnectionPoolManager::connectToRedis(const RedisEndpoint& endpoint) {
+    timeval connect_timeout = toTimeval(endpoint.connect_timeout.value_or(options_.connect_timeout));
+    redisContext* context = endpoint.type == RedisEndpoint::Type::Unix
+        ? redisConnectUnixWithTimeout(endpoint.path.c_str(), connect_timeout)
+        : redisConnectWithTimeout(endpoint.host.c_str(), endpoint.port, connect_timeout);
     if (context == nullptr || context->err) {
         if (context) {
-            std::cerr << "Redis connection error: " << context->errstr << std::endl;
+            std::cerr << "Redis connection error (" << endpoint.toString() << "): " << context->errstr << std::endl;
             redisFree(context);
         } else {
             std::cerr << "Can't allocate redis context" << std::endl;
         }
         return nullptr;
     }
+
+    bool configured = applyCommandTimeout(context, endpoint);
+    if (configured && endpoint.type == RedisEndpoint::Type::Tcp) {
+        int nodelay = endpoint.tcp_nodelay.value_or(options_.tcp_nodelay) ? 1 : 0;
+        configured = setsockopt(context->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == 0;
+        if (configured && endpoint.tcp_keepalive.value_or(options_.tcp_keepalive)) {
+            configured = redisEnableKeepAlive(context) == REDIS_OK;
+        }
+    }
+    if (!configured) {
+        std::cerr << "Failed to configure Redis connection (" << endpoint.toString() << ")" << std::endl;
+        redisFree(context);
+        return nullptr;
+    }
     return context;
 }
 
+// Sets the endpoint's command timeout. This also undoes the connect timeout,
+// which older hiredis versions apply to commands as well, and the probe timeout.
+bool ConnectionPoolManager::applyCommandTimeout(redisContext* context, const RedisEndpoint& endpoint) {
+    return redisSetTimeout(context, toTimeval(endpoint.command_timeout.value_or(options_.command_timeout))) == REDIS_OK;
+}
+
+redisContext* ConnectionPoolManager::openDedicatedConnection(size_t host_index) {
+    return connectToRedis(endpoints_[host_index % endpoints_.size()]);
+}
+
 redisContext* ConnectionPoolManager::getConnection() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    condition_.wait(lock, [this] {
-        if (shutting_down_) return true;
-        for (int i = 0; i < pool_size_; ++i) {
-            if (!in_use_[i] && pool_[i] != nullptr) {
+    return waitForConnection(nullptr);
+}
+
+redisContext* ConnectionPoolManager::tryGetConnection(std::chrono::steady_clock::time_point deadline) {
+    return waitForConnection(&deadline);
+}
+
+redisContext* ConnectionPoolManager::tryGetConnection(std::chrono::milliseconds timeout) {
+    return tryGetConnection(Clock::now() + timeout);
+}
+
+redisContext* ConnectionPoolManager::waitForConnection(const Clock::time_point* deadline) {
+    size_t slot;
+    if (tryAcquireSlot(slot)) {
+        checkout_shards_[threadStripeHint() % kCheckoutShards].immediate.fetch_add(1, std::memory_order_relaxed);
+        return pool_[slot];
+    }
+
+    // Slow path: the pool is exhausted. Grow a lazy pool, otherwise wait for
+    // a connection to come back (or for elastic sizing to add one).
+    exhausted_.fetch_add(1, std::memory_order_relaxed);
+    Clock::time_point start = Clock::now();
+    if (options_.lazy_connect && unopened_.load(std::memory_order_relaxed) > 0) {
+        openLazySlot();
+    }
+    bool acquired = false;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        waiters_.fetch_add(1);
+        auto ready = [&] {
+            return shutting_down_ || (acquired = tryAcquireSlot(slot));
+        };
+        if (deadline) {
+            condition_.wait_until(lock, *deadline, ready);
+        } else {
+            condition_.wait(lock, ready);
+        }
+        waiters_.fetch_sub(1);
+        if (!acquired) {
+            if (!shutting_down_) {
+                timeouts_.fetch_add(1, std::memory_order_relaxed);
+            }
+            return nullptr;
+        }
+    }
+
+    auto waited = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start);
+    size_t bucket = 1;
+    while (bucket + 1 < kWaitBucketBounds.size() && waited > kWaitBucketBounds[bucket]) {
+        ++bucket;
+    }
+    wait_histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+    return pool_[slot];
+}
+
+void ConnectionPoolManager::returnConnection(redisContext* context) {
+    if (context == nullptr) return;
+
+    size_t slot;
+    if (!context_slots_.find(context, slot)) return;
+
+    size_t host = hostIndex(slot);
+    if (options_.routing_policy != RoutingPolicy::RoundRobin) {
+        routes_[host].outstanding.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    if (context->err) {
+        // Quarantine: keep the slot out of circulation until it is replaced.
+        quarantined_.fetch_add(1, std::memory_order_relaxed);
+        setEjected(host, true);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            broken_slots_.push_back(slot);
+        }
+        health_condition_.notify_one();
+        return;
+    }
+    idle_since_[slot] = resize_period_.load(std::memory_order_relaxed);
+    releaseSlot(slot);
+}
+
+ConnectionPoolStats ConnectionPoolManager::getStats() const {
+    ConnectionPoolStats stats;
+    stats.wait_bucket_bounds = kWaitBucketBounds;
+    stats.wait_histogram.resize(kWaitBucketBounds.size());
+    for (size_t i = 0; i < kWaitBucketBounds.size(); ++i) {
+        stats.wait_histogram[i] = wait_histogram_[i].load(std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < kCheckoutShards; ++i) {
+        stats.wait_histogram[0] += checkout_shards_[i].immediate.load(std::memory_order_relaxed);
+    }
+    for (uint64_t count : stats.wait_histogram) {
+        stats.checkouts += count;
+    }
+
+    stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.reconnects = reconnects_.load(std::memory_order_relaxed);
+    stats.reconnect_failures = reconnect_failures_.load(std::memory_order_relaxed);
+    stats.quarantined = quarantined_.load(std::memory_order_relaxed);
+    stats.grown = grown_.load(std::memory_order_relaxed);
+    stats.shrunk = shrunk_.load(std::memory_order_relaxed);
+
+    stats.pool_size = pool_size_;
+    stats.connected = connected_.load(std::memory_order_relaxed);
+    for (size_t host = 0; host < endpoints_.size(); ++host) {
+        stats.idle += static_cast<int>(routes_[host].idle_slots->count());
+    }
+    stats.in_use = std::max(stats.connected - stats.idle, 0);
+    return stats;
+}
+
+// Tries the host chosen by the routing policy first, then every other healthy
+// host, and only falls back to ejected hosts when nothing else is available.
+bool ConnectionPoolManager::tryAcquireSlot(size_t& slot) {
+    const size_t num_hosts = endpoints_.size();
+    const size_t first = num_hosts == 1 ? 0 : pickHost();
+    const size_t hint = threadStripeHint();
+
+    for (int pass = 0; pass < 2; ++pass) {
+        const bool want_ejected = pass == 1;
+        for (size_t i = 0; i < num_hosts; ++i) {
+            size_t host = (first + i) % num_hosts;
+            HostRoute& route = routes_[host];
+            if (route.ejected.load(std::memory_order_relaxed) != want_ejected) continue;
+
+            size_t local;
+            if (route.idle_slots->tryAcquire(hint, local)) {
+                slot = local * num_hosts + host;
+                // Round-robin does not need the count, so it skips the shared write.
+                if (options_.routing_policy != RoutingPolicy::RoundRobin) {
+                    route.outstanding.fetch_add(1, std::memory_order_relaxed);
+                }
                 return true;
             }
         }
-        return false;
-    });
+    }
+    return false;
+}
 
-    if (shutting_down_) {
-        return nullptr;
+size_t ConnectionPoolManager::pickHost() {
+    const size_t num_hosts = endpoints_.size();
+    // A per-thread rotation keeps round-robin free of shared writes and makes
+    // the scans below start at different hosts on different threads.
+    thread_local size_t rotation = threadStripeHint();
+    const size_t start = rotation++ % num_hosts;
+
+    if (options_.routing_policy == RoutingPolicy::RoundRobin) {
+        return start;
     }
 
-    for (int i = 0; i < pool_size_; ++i) {
-        if (!in_use_[i] && pool_[i] != nullptr) {
-            in_use_[i] = true;
-            return pool_[i];
+    size_t best = start;
+    double best_cost = 0;
+    bool found = false;
+    for (size_t i = 0; i < num_hosts; ++i) {
+        size_t host = (start + i) % num_hosts;
+        const HostRoute& route = routes_[host];
+        if (route.ejected.load(std::memory_order_relaxed)) continue;
+
+        double outstanding = route.outstanding.load(std::memory_order_relaxed);
+        double cost = outstanding;
+        if (options_.routing_policy == RoutingPolicy::EwmaLatency) {
+            // Unmeasured hosts count as 1us so they get tried early.
+            double latency = std::max<long long>(route.latency_ewma_us.load(std::memory_order_relaxed), 1);
+            cost = latency * (outstanding + 1);
+        }
+        if (!found || cost < best_cost) {
+            best = host;
+            best_cost = cost;
+            found = true;
         }
     }
+    return best;
+}
 
-    return nullptr; // Should not be reached if wait condition is correct
+// Racing updates may drop a sample, which is fine for a smoothed estimate.
+void ConnectionPoolManager::recordLatency(size_t host_index, std::chrono::microseconds latency) {
+    std::atomic<long long>& ewma = routes_[host_index].latency_ewma_us;
+    long long previous = ewma.load(std::memory_order_relaxed);
+    long long sample = latency.count();
+    long long updated = previous == 0
+        ? sample
+        : static_cast<long long>(previous + kLatencyEwmaWeight * (sample - previous));
+    ewma.store(std::max<long long>(updated, 1), std::memory_order_relaxed);
 }
 
-void ConnectionPoolManager::returnConnection(redisContext* context) {
-    if (context == nullptr) return;
+// Opens one Unopened slot on behalf of a checkout that found nothing idle.
+// The new connection is released into the idle set like any other.
+bool ConnectionPoolManager::openLazySlot() {
+    const size_t start = threadStripeHint();
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int n = 0; n < pool_size_; ++n) {
+            size_t slot = (start + n) % pool_size_;
+            // Prefer healthy hosts on the first pass.
+            if (pass == 0 && routes_[hostIndex(slot)].ejected.load(std::memory_order_relaxed)) continue;
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    for (int i = 0; i < pool_size_; ++i) {
-        if (pool_[i] == context) {
-            in_use_[i] = false;
-            break;
+            SlotState expected = SlotState::Unopened;
+            if (!slot_states_[slot].compare_exchange_strong(expected, SlotState::Connecting)) continue;
+            unopened_.fetch_sub(1);
+
+            redisContext* context = connectToRedis(endpoints_[hostIndex(slot)]);
+            replaceConnection(slot, context);
+            if (context == nullptr) {
+                // The slot is now Disconnected, so the health engine reopens
+                // it; the engine also puts the host into backoff.
+                setEjected(hostIndex(slot), true);
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    failed_lazy_hosts_.push_back(hostIndex(slot));
+                }
+                health_condition_.notify_one();
+            }
+            return context != nullptr;
         }
     }
-    condition_.notify_one();
+    return false;
+}
+
+void ConnectionPoolManager::setEjected(size_t host_index, bool ejected) {
+    if (routes_[host_index].ejected.exchange(ejected) != ejected) {
+        std::cerr << "Redis host " << endpoints_[host_index].toString()
+                  << (ejected ? " ejected from routing" : " restored to routing") << std::endl;
+    }
+}
+
+void ConnectionPoolManager::releaseSlot(size_t slot) {
+    idleSlotsOf(slot).release(localIndex(slot));
+    // Pairs with the waiters_ increment in getConnection(): either the waiter
+    // sees the released slot or we see the waiter and wake it.
+    if (waiters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        condition_.notify_one();
+    }
+}
+
+// Must be called by the slot's current owner (checked out or disconnected).
+void ConnectionPoolManager::replaceConnection(size_t slot, redisContext* context) {
+    redisContext* old_context = pool_[slot];
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (old_context) {
+            context_slots_.erase(old_context);
+        }
+        pool_[slot] = context;
+        if (context) {
+            context_slots_.insert(context, slot);
+        }
+    }
+    connected_.fetch_add((context ? 1 : 0) - (old_context ? 1 : 0), std::memory_order_relaxed);
+    slot_states_[slot].store(context ? SlotState::Connected : SlotState::Disconnected);
+    if (old_context) {
+        redisFree(old_context);
+    }
+    if (context) {
+        idle_since_[slot] = resize_period_.load(std::memory_order_relaxed);
+        releaseSlot(slot);
+    }
 }
 
 void ConnectionPoolManager::healthCheck() {
+    Clock::time_point next_probe = Clock::now() + options_.health_check_interval;
+    Clock::time_point next_reconnect = Clock::now();
+    // Without a range to resize in, the resize deadline never comes up.
+    const bool elastic = min_size_ < pool_size_;
+    Clock::time_point next_resize = elastic ? Clock::now() + options_.resize_interval : Clock::time_point::max();
+    std::vector<size_t> broken;
+    std::vector<size_t> failed_hosts;
+
     while (true) {
-        std::this_thread::sleep_for(std::chrono::seconds(5));
         {
             std::unique_lock<std::mutex> lock(mutex_);
+            health_condition_.wait_until(lock, std::min({next_probe, next_reconnect, next_resize}), [this] {
+                return shutting_down_ || !broken_slots_.empty() || !failed_lazy_hosts_.empty();
+            });
             if (shutting_down_) {
                 return;
             }
+            broken.swap(broken_slots_);
+            failed_hosts.swap(failed_lazy_hosts_);
+        }
 
-            for (int i = 0; i < pool_size_; ++i) {
-                if (in_use_[i]) continue;
-
-                if (pool_[i] == nullptr) {
-                    pool_[i] = connectToRedis(redis_hosts_[i % redis_hosts_.size()]);
-                    if(pool_[i] != nullptr) condition_.notify_one();
-                } else {
-                    redisReply* reply = (redisReply*)redisCommand(pool_[i], "PING");
-                    if (reply == nullptr || pool_[i]->err) {
-                        std::cerr << "Health check failed for connection " << i << ". Reconnecting." << std::endl;
-                        redisFree(pool_[i]);
-                        pool_[i] = connectToRedis(redis_hosts_[i % redis_hosts_.size()]);
-                        if(pool_[i] != nullptr) condition_.notify_one();
-                    }
-                    if (reply) {
-                        freeReplyObject(reply);
-                    }
-                }
+        for (size_t slot : broken) {
+            replaceConnection(slot, nullptr);
+        }
+        broken.clear();
+
+        // One backoff step per host, however many lazy opens failed on it.
+        std::sort(failed_hosts.begin(), failed_hosts.end());
+        failed_hosts.erase(std::unique(failed_hosts.begin(), failed_hosts.end()), failed_hosts.end());
+        for (size_t host : failed_hosts) {
+            recordConnectResult(host, false, Clock::now());
+        }
+        failed_hosts.clear();
+
+        if (Clock::now() >= next_probe) {
+            probeIdleSlots();
+            next_probe = Clock::now() + options_.health_check_interval;
+        }
+        if (Clock::now() >= next_resize) {
+            resizePool();
+            next_resize = Clock::now() + options_.resize_interval;
+        }
+        next_reconnect = reconnectSlots(Clock::now());
+
+        if (!warmup_done_) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                warmup_done_ = true;
+            }
+            condition_.notify_all();
+        }
+    }
+}
+
+void ConnectionPoolManager::probeIdleSlots() {
+    for (int i = 0; i < pool_size_ && !shutting_down_; ++i) {
+        // Claiming an idle slot quarantines it: checkout skips it while the
+        // PING is in flight, and no pool lock is held during the round-trip.
+        if (slot_states_[i].load() != SlotState::Connected || !idleSlotsOf(i).tryClaim(localIndex(i))) continue;
+
+        redisContext* context = pool_[i];
+        redisSetTimeout(context, toTimeval(options_.probe_timeout));
+        Clock::time_point start = Clock::now();
+        redisReply* reply = (redisReply*)redisCommand(context, "PING");
+        bool healthy = reply != nullptr && !context->err &&
+                       applyCommandTimeout(context, endpoints_[hostIndex(i)]);
+        if (reply) {
+            freeReplyObject(reply);
+        }
+
+        setEjected(hostIndex(i), !healthy);
+        if (healthy) {
+            recordLatency(hostIndex(i), std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start));
+            releaseSlot(i);
+        } else {
+            std::cerr << "Health check failed for connection " << i << ". Reconnecting." << std::endl;
+            replaceConnection(i, nullptr);
+        }
+    }
+}
+
+// One elastic sizing step. Growth is driven by checkouts that had to wait,
+// shrinking by how long individual connections sat unused; the pool does not
+// shrink in a period in which checkouts waited.
+void ConnectionPoolManager::resizePool() {
+    uint64_t exhausted = exhausted_.load(std::memory_order_relaxed);
+    bool pressure = exhausted != last_exhausted_;
+    last_exhausted_ = exhausted;
+    pressure_periods_ = pressure ? pressure_periods_ + 1 : 0;
+    uint64_t period = resize_period_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    int open = pool_size_ - unopened_.load();
+    if (pressure) {
+        // Lazy pools already grow on demand in the checkout path.
+        if (!options_.lazy_connect && pressure_periods_ >= std::max(options_.grow_after_periods, 1) && open < pool_size_) {
+            int grown = growPool(std::max(open / 4, 1));
+            grown_.fetch_add(grown, std::memory_order_relaxed);
+            pressure_periods_ = 0;
+        }
+        return;
+    }
+
+    uint64_t idle_periods = std::max<uint64_t>(
+        (options_.idle_timeout.count() + options_.resize_interval.count() - 1) / options_.resize_interval.count(), 1);
+    if (open > min_size_ && period >= idle_periods) {
+        shrinkPool(period - idle_periods);
+    }
+}
+
+// Hands up to count Unopened slots to the reconnect pass that follows, lowest
+// first so that the open slots stay spread evenly across hosts.
+int ConnectionPoolManager::growPool(int count) {
+    int grown = 0;
+    for (int i = 0; i < pool_size_ && grown < count; ++i) {
+        SlotState expected = SlotState::Unopened;
+        if (slot_states_[i].compare_exchange_strong(expected, SlotState::Disconnected)) {
+            unopened_.fetch_sub(1);
+            ++grown;
+        }
+    }
+    return grown;
+}
+
+// Closes idle connections last returned no later than period cutoff, highest
+// slot first, while more than min_pool_size slots are open.
+void ConnectionPoolManager::shrinkPool(uint64_t cutoff) {
+    for (int i = pool_size_ - 1; i >= 0 && pool_size_ - unopened_.load() > min_size_; --i) {
+        // Claiming the slot takes it out of checkout, as for a health probe.
+        if (slot_states_[i].load() != SlotState::Connected || !idleSlotsOf(i).tryClaim(localIndex(i))) continue;
+
+        if (idle_since_[i] > cutoff) {
+            releaseSlot(i);
+            continue;
+        }
+        replaceConnection(i, nullptr);
+        slot_states_[i].store(SlotState::Unopened);
+        unopened_.fetch_add(1);
+        shrunk_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+// Reconnects disconnected slots whose host is out of backoff and returns when
+// the next reconnect attempt is due. While a host is failing only one of its
+// slots is tried per pass.
+ConnectionPoolManager::Clock::time_point ConnectionPoolManager::reconnectSlots(Clock::time_point now) {
+    Clock::time_point next_due = now + options_.health_check_interval;
+    std::vector<size_t> due;
+    std::vector<char> host_queued(endpoints_.size(), 0);
+    for (int i = 0; i < pool_size_; ++i) {
+        if (slot_states_[i].load() != SlotState::Disconnected) continue;
+
+        size_t host = hostIndex(i);
+        const HostBackoff& backoff = host_backoff_[host];
+        if (now < backoff.next_attempt) {
+            next_due = std::min(next_due, backoff.next_attempt);
+            continue;
+        }
+        if (backoff.delay.count() > 0 && host_queued[host]) continue;
+        host_queued[host] = 1;
+        due.push_back(i);
+    }
+    if (due.empty()) {
+        return next_due;
+    }
+
+    std::vector<int> results = connectSlots(due);
+
+    // One backoff step per host and pass, however many of its slots failed.
+    std::vector<int> host_result(endpoints_.size(), -1);
+    for (size_t k = 0; k < due.size(); ++k) {
+        size_t host = hostIndex(due[k]);
+        host_result[host] = std::max(host_result[host], results[k]);
+        if (warmup_done_ && results[k] >= 0) {
+            (results[k] == 1 ? reconnects_ : reconnect_failures_).fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    for (size_t host = 0; host < endpoints_.size(); ++host) {
+        if (host_result[host] < 0) continue;
+        recordConnectResult(host, host_result[host] == 1, Clock::now());
+        if (host_result[host] == 0) {
+            next_due = std::min(next_due, host_backoff_[host].next_attempt);
+        } else {
+            // The host is back; retry its other slots right away.
+            next_due = now;
+        }
+    }
+    return next_due;
+}
+
+// Connects the given slots using up to connect_parallelism threads. Reports
+// per slot 1 (connected), 0 (failed) or -1 (skipped because another slot of
+// the same host already failed in this pass).
+std::vector<int> ConnectionPoolManager::connectSlots(const std::vector<size_t>& slots) {
+    std::vector<int> results(slots.size(), -1);
+    std::unique_ptr<std::atomic<bool>[]> host_failed(new std::atomic<bool>[endpoints_.size()]());
+    std::atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t k = next++; k < slots.size() && !shutting_down_; k = next++) {
+            size_t host = hostIndex(slots[k]);
+            if (host_failed[host].load()) continue;
+
+            redisContext* context = connectToRedis(endpoints_[host]);
+            results[k] = context != nullptr ? 1 : 0;
+            if (context == nullptr) {
+                host_failed[host] = true;
             }
+            replaceConnection(slots[k], context);
         }
+    };
+
+    size_t num_threads = std::min<size_t>(slots.size(), std::max(options_.connect_parallelism, 1));
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < num_threads; ++t) {
+        helpers.emplace_back(worker);
     }
+    worker();
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+    return results;
+}
+
+void ConnectionPoolManager::recordConnectResult(size_t host_index, bool connected, Clock::time_point now) {
+    HostBackoff& backoff = host_backoff_[host_index];
+    setEjected(host_index, !connected);
+    if (connected) {
+        backoff = HostBackoff();
+        return;
+    }
+
+    backoff.delay = backoff.delay.count() == 0
+        ? options_.reconnect_backoff_initial
+        : std::min(backoff.delay * 2, options_.reconnect_backoff_max);
+    // Equal jitter: wait between half and all of the current delay.
+    std::uniform_int_distribution<long long> distribution(backoff.delay.count() / 2, backoff.delay.count());
+    backoff.next_attempt = now + std::chrono::milliseconds(distribution(jitter_));
 }
@@ -7,14 +7,98 @@
 #include <mutex>
 #include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include "idle_slot_set.h"
+#include "context_slot_map.h"
+#include "redis_endpoint.h"
 
 // Forward declaration for hiredis context
 struct redisContext;
 class RedisConnectionGuard;
 
+// How getConnection() picks the host to take a connection from.
+enum class RoutingPolicy {
+    RoundRobin,       // Rotate through hosts (per calling thread)
+    LeastOutstanding, // Host with the fewest connections currently checked out
+    EwmaLatency,      // Lowest EWMA of health PING round-trips, weighted by outstanding connections
+};
+
+struct ConnectionPoolOptions {
+    RoutingPolicy routing_policy = RoutingPolicy::RoundRobin;
+
+    // How often idle connections are PINGed by the health engine.
+    std::chrono::milliseconds health_check_interval{5000};
+    // Upper bound for a health PING; a slower reply counts as a failure.
+    std::chrono::milliseconds probe_timeout{500};
+    // Connection defaults, overridable per endpoint (see RedisEndpoint).
+    std::chrono::milliseconds connect_timeout{1000};
+    std::chrono::milliseconds command_timeout{0}; // 0 = block until the reply arrives
+    bool tcp_nodelay = true;
+    bool tcp_keepalive = true;
+    // Startup. Connections are opened in parallel by up to this many threads
+    // (reconnects after an outage use the same parallelism).
+    int connect_parallelism = 8;
+    // Lazy pools open only min_ready connections up front and open the rest,
+    // up to the maximum pool size, when a checkout finds no idle connection.
+    bool lazy_connect = false;
+    // The constructor returns as soon as this many connections are live, or
+    // once every initial connection attempt has finished. -1 waits for all
+    // initial attempts (eager) or opens nothing up front (lazy).
+    int min_ready = -1;
+    // Per-host reconnect backoff, doubled after every failed attempt and
+    // jittered so that many pools do not retry a recovering host in lockstep.
+    std::chrono::milliseconds reconnect_backoff_initial{100};
+    std::chrono::milliseconds reconnect_backoff_max{30000};
+    // Elastic sizing. The pool starts with pool_size connections and may grow
+    // up to max_pool_size when checkouts had to wait in grow_after_periods
+    // consecutive resize periods, by a quarter of its size at a time.
+    // Connections left idle for idle_timeout are closed again, but never
+    // below min_pool_size. -1 pins the bound to pool_size, so by default the
+    // pool does not resize.
+    int min_pool_size = -1;
+    int max_pool_size = -1;
+    std::chrono::milliseconds resize_interval{1000};
+    int grow_after_periods = 2;
+    std::chrono::milliseconds idle_timeout{60000};
+};
+
+// Point-in-time view of pool health and checkout behaviour.
+struct ConnectionPoolStats {
+    // Checkout wait-time histogram: wait_histogram[i] counts checkouts that
+    // waited at most wait_bucket_bounds[i] (and more than the previous bound).
+    // Checkouts served without waiting land in bucket 0, the last bound is
+    // unbounded.
+    std::vector<std::chrono::microseconds> wait_bucket_bounds;
+    std::vector<uint64_t> wait_histogram;
+
+    uint64_t checkouts = 0;          // Successful getConnection()/tryGetConnection() calls
+    uint64_t exhausted = 0;          // Checkouts that found no idle connection and had to wait
+    uint64_t timeouts = 0;           // tryGetConnection() calls that hit their deadline
+    uint64_t reconnects = 0;         // Connections re-established by the health engine
+    uint64_t reconnect_failures = 0; // Failed reconnect attempts
+    uint64_t quarantined = 0;        // Connections returned in an error state
+    uint64_t grown = 0;              // Connections added by elastic sizing
+    uint64_t shrunk = 0;             // Idle connections closed by elastic sizing
+
+    int pool_size = 0;    // Maximum number of connections
+    int connected = 0;    // Slots with a live connection
+    int idle = 0;         // Connected and available for checkout
+    int in_use = 0;       // Connected and checked out (or being probed)
+
+    // Fraction of live connections that are checked out.
+    double utilization() const { return connected > 0 ? static_cast<double>(in_use) / connected : 0.0; }
+};
+
 class ConnectionPoolManager {
 public:
-    ConnectionPoolManager(const std::vector<std::string>& hosts, int pool_size);
+    // Each host is an endpoint URI as accepted by RedisEndpoint::parse().
+    ConnectionPoolManager(const std::vector<std::string>& hosts, int pool_size,
+                          const ConnectionPoolOptions& options = ConnectionPoolOptions());
+    ConnectionPoolManager(const std::vector<RedisEndpoint>& endpoints, int pool_size,
+                          const ConnectionPoolOptions& options = ConnectionPoolOptions());
     ~ConnectionPoolManager();
 
     // Deleted copy and move constructors/assignments
@@ -23,22 +107,136 @@ public:
     ConnectionPoolManager(ConnectionPoolManager&&) = delete;
     ConnectionPoolManager& operator=(ConnectionPoolManager&&) = delete;
 
+    // Blocks until a connection is available; returns nullptr on shutdown.
     redisContext* getConnection();
+    // Like getConnection(), but gives up and returns nullptr at the deadline.
+    redisContext* tryGetConnection(std::chrono::steady_clock::time_point deadline);
+    redisContext* tryGetConnection(std::chrono::milliseconds timeout);
+    // Returning a connection whose context reports an error quarantines it;
+    // the health engine replaces it in the background.
     void returnConnection(redisContext* context);
 
+    ConnectionPoolStats getStats() const;
+
+    // Opens a connection outside the pool, configured like pooled ones, for
+    // callers that need one for themselves (e.g. pub/sub subscribers). The
+    // host index is taken modulo hostCount(). Returns nullptr if the
+    // connection fails; the caller owns the context and frees it with
+    // redisFree().
+    redisContext* openDedicatedConnection(size_t host_index);
+    size_t hostCount() const { return endpoints_.size(); }
+
 private:
-    redisContext* connectToRedis(const std::string& host);
+    using Clock = std::chrono::steady_clock;
+
+    // Lifecycle of a pool slot. Only Unopened slots are claimed concurrently
+    // (by lazy openers, via CAS); Disconnected slots belong to the health
+    // engine, Connected slots to whoever holds them through the idle sets.
+    enum class SlotState : uint8_t {
+        Unopened,     // Lazy or elastic slot without a connection
+        Connecting,   // Claimed by a lazy opener
+        Disconnected, // Waiting for the health engine to (re)connect it
+        Connected,    // Has a live context
+    };
+
+    // Reconnect state for one host, only touched by the health engine
+    // (and the constructor before the engine starts).
+    struct HostBackoff {
+        Clock::time_point next_attempt{};
+        std::chrono::milliseconds delay{0};
+    };
+
+    redisContext* connectToRedis(const RedisEndpoint& endpoint);
+    bool applyCommandTimeout(redisContext* context, const RedisEndpoint& endpoint);
     void healthCheck();
+    void probeIdleSlots();
+    Clock::time_point reconnectSlots(Clock::time_point now);
+    void resizePool();
+    int growPool(int count);
+    void shrinkPool(uint64_t cutoff);
+    std::vector<int> connectSlots(const std::vector<size_t>& slots);
+    bool openLazySlot();
+    void recordConnectResult(size_t host_index, bool connected, Clock::time_point now);
+    size_t hostIndex(size_t slot) const { return slot % endpoints_.size(); }
+    IdleSlotSet& idleSlotsOf(size_t slot) { return *routes_[hostIndex(slot)].idle_slots; }
+    size_t localIndex(size_t slot) const { return slot / endpoints_.size(); }
+    size_t pickHost();
+    void recordLatency(size_t host_index, std::chrono::microseconds latency);
+    void setEjected(size_t host_index, bool ejected);
+    redisContext* waitForConnection(const Clock::time_point* deadline);
+    bool tryAcquireSlot(size_t& slot);
+    void releaseSlot(size_t slot);
+    void replaceConnection(size_t slot, redisContext* context);
 
-    const std::vector<std::string> redis_hosts_;
-    const int pool_size_;
+    const std::vector<RedisEndpoint> endpoints_;
+    const int pool_size_; // Number of slots, i.e. the maximum pool size
+    const int min_size_;
+    const ConnectionPoolOptions options_;
 
-    std::vector<redisContext*> pool_; // All connections, some can be nullptr
-    std::vector<bool> in_use_;      // Flag for each connection
+    // Routing state for one host. Slot s belongs to host s % endpoints_.size()
+    // and is tracked in that host's idle set under index s / endpoints_.size().
+    // A host is ejected after a failed connect, probe or returned connection
+    // and only serves checkouts again once it looks healthy, unless every
+    // host is ejected.
+    struct alignas(64) HostRoute {
+        std::unique_ptr<IdleSlotSet> idle_slots; // Lock-free checkout fast path
+        std::atomic<int> outstanding{0};
+        std::atomic<long long> latency_ewma_us{0};
+        std::atomic<bool> ejected{false};
+    };
 
+    // All connections, some can be nullptr. A slot's context is only written
+    // while the writer owns the slot (checked out or disconnected), so readers
+    // that acquired the slot through its idle set see a stable pointer.
+    std::vector<redisContext*> pool_;
+    std::unique_ptr<HostRoute[]> routes_;
+    std::unique_ptr<std::atomic<SlotState>[]> slot_states_;
+    // Per slot resize period of the last return. Written by the slot's owner
+    // on return; the health engine reads it only after tryClaim().
+    std::vector<uint64_t> idle_since_;
+    ContextSlotMap context_slots_;  // returnConnection() lookup, written under mutex_
+    std::atomic<int> connected_{0};
+    std::atomic<int> unopened_{0};
+
+    // Statistics. Checkouts that do not wait are counted in per-thread shards
+    // so the fast path does not share a counter cache line.
+    struct alignas(64) CheckoutShard {
+        std::atomic<uint64_t> immediate{0};
+    };
+    std::unique_ptr<CheckoutShard[]> checkout_shards_;
+    std::unique_ptr<std::atomic<uint64_t>[]> wait_histogram_;
+    std::atomic<uint64_t> exhausted_{0};
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> reconnects_{0};
+    std::atomic<uint64_t> reconnect_failures_{0};
+    std::atomic<uint64_t> quarantined_{0};
+    std::atomic<uint64_t> grown_{0};
+    std::atomic<uint64_t> shrunk_{0};
+
+    // Slow path only: blocking waits, reconnects and shutdown.
     std::mutex mutex_;
     std::condition_variable condition_;
-    bool shutting_down_ = false;
+    std::atomic<int> waiters_{0};
+    std::atomic<bool> shutting_down_{false};
+
+    // Health engine. Slots in broken_slots_ (guarded by mutex_) were returned
+    // with an error; they stay out of circulation until the engine replaces
+    // them. failed_lazy_hosts_ (guarded by mutex_) lists hosts a lazy open
+    // failed on, for the engine to back off. warmup_done_ (guarded by mutex_)
+    // is set once the engine has made its first pass over the initial slots.
+    std::condition_variable health_condition_;
+    std::vector<size_t> broken_slots_;
+    std::vector<size_t> failed_lazy_hosts_;
+    bool warmup_done_ = false;
+    std::vector<HostBackoff> host_backoff_;
+    std::minstd_rand jitter_;
+
+    // Elastic sizing, driven by the health engine once per resize_interval.
+    // resize_period_ counts the periods and stamps idle_since_ on return;
+    // the rest is only touched by the engine.
+    std::atomic<uint64_t> resize_period_{0};
+    uint64_t last_exhausted_ = 0;
+    int pressure_periods_ = 0;
     std::thread health_check_thread_;
 };
 
@@ -0,0 +1,85 @@
+#ifndef CONTEXT_SLOT_MAP_H
+#define CONTEXT_SLOT_MAP_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Forward declaration for hiredis context
+struct redisContext;
+
+// Open-addressed map from a live redisContext to the pool slot that owns it.
+//
+// Lookups are lock-free so returnConnection() can find its slot in O(1).
+// insert() and erase() only run when a connection is (re)established or torn
+// down and must be serialized by the caller.
+class ContextSlotMap {
+public:
+    explicit ContextSlotMap(size_t max_entries) {
+        size_t capacity = 16;
+        while (capacity < max_entries * 4) capacity <<= 1;
+        mask_ = capacity - 1;
+        keys_.reset(new std::atomic<redisContext*>[capacity]);
+        slots_.reset(new std::atomic<size_t>[capacity]);
+        for (size_t i = 0; i < capacity; ++i) {
+            keys_[i].store(nullptr, std::memory_order_relaxed);
+            slots_[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    // Deleted copy and move constructors/assignments
+    ContextSlotMap(const ContextSlotMap&) = delete;
+    ContextSlotMap& operator=(const ContextSlotMap&) = delete;
+    ContextSlotMap(ContextSlotMap&&) = delete;
+    ContextSlotMap& operator=(ContextSlotMap&&) = delete;
+
+    void insert(redisContext* context, size_t slot) {
+        for (size_t i = hash(context), n = 0; n <= mask_; i = (i + 1) & mask_, ++n) {
+            redisContext* key = keys_[i].load(std::memory_order_relaxed);
+            if (key == nullptr || key == tombstone()) {
+                slots_[i].store(slot, std::memory_order_relaxed);
+                keys_[i].store(context, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
+    void erase(redisContext* context) {
+        for (size_t i = hash(context), n = 0; n <= mask_; i = (i + 1) & mask_, ++n) {
+            redisContext* key = keys_[i].load(std::memory_order_relaxed);
+            if (key == context) {
+                keys_[i].store(tombstone(), std::memory_order_release);
+                return;
+            }
+            if (key == nullptr) return;
+        }
+    }
+
+    // Returns false if the context does not belong to the pool.
+    bool find(redisContext* context, size_t& slot) const {
+        for (size_t i = hash(context), n = 0; n <= mask_; i = (i + 1) & mask_, ++n) {
+            redisContext* key = keys_[i].load(std::memory_order_acquire);
+            if (key == context) {
+                slot = slots_[i].load(std::memory_order_relaxed);
+                return true;
+            }
+            if (key == nullptr) return false;
+        }
+        return false;
+    }
+
+private:
+    static redisContext* tombstone() { return reinterpret_cast<redisContext*>(uintptr_t(1)); }
+
+    size_t hash(redisContext* context) const {
+        uint64_t h = (reinterpret_cast<uintptr_t>(context) >> 4) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & mask_;
+    }
+
+    size_t mask_;
+    std::unique_ptr<std::atomic<redisContext*>[]> keys_;
+    std::unique_ptr<std::atomic<size_t>[]> slots_;
+};
+
+#endif // CONTEXT_SLOT_MAP_H
@@ -0,0 +1,83 @@
+#ifndef IDLE_SLOT_SET_H
+#define IDLE_SLOT_SET_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+
+// Lock-free set of idle pool slot indices.
+//
+// Slots are striped across cache-line sized bitmap words (slot s lives in word
+// s % stripes) so that threads starting their search at different words do not
+// contend on the same cache line. Acquire and release are a single CAS /
+// fetch_or in the common case.
+class IdleSlotSet {
+public:
+    explicit IdleSlotSet(size_t capacity)
+        : capacity_(capacity),
+          stripes_(std::max<size_t>(std::min<size_t>(capacity, kMaxStripes), (capacity + 63) / 64)),
+          words_(new Word[stripes_]) {
+    }
+
+    // Deleted copy and move constructors/assignments
+    IdleSlotSet(const IdleSlotSet&) = delete;
+    IdleSlotSet& operator=(const IdleSlotSet&) = delete;
+    IdleSlotSet(IdleSlotSet&&) = delete;
+    IdleSlotSet& operator=(IdleSlotSet&&) = delete;
+
+    // Claims any idle slot, starting the search at the stripe picked by hint.
+    bool tryAcquire(size_t hint, size_t& slot) {
+        for (size_t i = 0; i < stripes_; ++i) {
+            size_t stripe = (hint + i) % stripes_;
+            std::atomic<uint64_t>& bits = words_[stripe].bits;
+            uint64_t current = bits.load();
+            while (current != 0) {
+                unsigned bit = static_cast<unsigned>(__builtin_ctzll(current));
+                if (bits.compare_exchange_weak(current, current & ~(uint64_t(1) << bit))) {
+                    slot = bit * stripes_ + stripe;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Claims a specific slot if it is currently idle.
+    bool tryClaim(size_t slot) {
+        uint64_t mask = maskOf(slot);
+        return (words_[slot % stripes_].bits.fetch_and(~mask) & mask) != 0;
+    }
+
+    void release(size_t slot) {
+        words_[slot % stripes_].bits.fetch_or(maskOf(slot));
+    }
+
+    // Number of idle slots; only a snapshot while other threads are active.
+    size_t count() const {
+        size_t idle = 0;
+        for (size_t i = 0; i < stripes_; ++i) {
+            idle += static_cast<size_t>(__builtin_popcountll(words_[i].bits.load(std::memory_order_relaxed)));
+        }
+        return idle;
+    }
+
+    size_t capacity() const { return capacity_; }
+    size_t stripes() const { return stripes_; }
+
+private:
+    static constexpr size_t kMaxStripes = 8;
+
+    struct alignas(64) Word {
+        std::atomic<uint64_t> bits{0};
+    };
+
+    uint64_t maskOf(size_t slot) const { return uint64_t(1) << (slot / stripes_); }
+
+    const size_t capacity_;
+    const size_t stripes_;
+    std::unique_ptr<Word[]> words_;
+};
+
+#endif // IDLE_SLOT_SET_H
@@ -2,11 +2,18 @@
 #define REDIS_CONNECTION_GUARD_H
 
 #include <stdexcept>
+#include <chrono>
 
 // Forward declaration for hiredis context
 struct redisContext;
 class ConnectionPoolManager;
 
+// Thrown when a deadline-aware guard could not check out a connection in time.
+class ConnectionPoolTimeout : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
 class RedisConnectionGuard {
 public:
     RedisConnectionGuard(ConnectionPoolManager* pool_manager)
@@ -16,6 +23,13 @@ public:
         }
     }
 
+    RedisConnectionGuard(ConnectionPoolManager* pool_manager, std::chrono::milliseconds timeout)
+        : pool_manager_(pool_manager), context_(pool_manager->tryGetConnection(timeout)) {
+        if (!context_) {
+            throw ConnectionPoolTimeout("Timed out waiting for Redis connection from pool");
+        }
+    }
+
     ~RedisConnectionGuard() {
         if (context_) {
             pool_manager_->returnConnection(context_);
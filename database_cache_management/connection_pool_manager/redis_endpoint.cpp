@@ -0,0 +1,134 @@
+#include "redis_endpoint.h"
+#include <stdexcept>
+
+namespace {
+
+const std::string kUnixScheme = "unix://";
+const std::string kTcpScheme = "tcp://";
+
+long long parseNumber(const std::string& value, const std::string& uri) {
+    size_t consumed = 0;
+    long long number = -1;
+    try {
+        number = std::stoll(value, &consumed);
+    } catch (const std::exception&) {
+    }
+    if (value.empty() || consumed != value.size() || number < 0) {
+        throw std::invalid_argument("Invalid number '" + value + "' in Redis endpoint: " + uri);
+    }
+    return number;
+}
+
+bool parseFlag(const std::string& value, const std::string& uri) {
+    if (value == "1" || value == "true" || value == "yes") return true;
+    if (value == "0" || value == "false" || value == "no") return false;
+    throw std::invalid_argument("Invalid flag '" + value + "' in Redis endpoint: " + uri);
+}
+
+void parseSetting(RedisEndpoint& endpoint, const std::string& setting, const std::string& uri) {
+    size_t eq = setting.find('=');
+    if (eq == std::string::npos) {
+        throw std::invalid_argument("Expected key=value setting in Redis endpoint: " + uri);
+    }
+    std::string key = setting.substr(0, eq);
+    std::string value = setting.substr(eq + 1);
+
+    if (key == "connect_timeout_ms") {
+        endpoint.connect_timeout = std::chrono::milliseconds(parseNumber(value, uri));
+    } else if (key == "command_timeout_ms") {
+        endpoint.command_timeout = std::chrono::milliseconds(parseNumber(value, uri));
+    } else if (key == "nodelay") {
+        endpoint.tcp_nodelay = parseFlag(value, uri);
+    } else if (key == "keepalive") {
+        endpoint.tcp_keepalive = parseFlag(value, uri);
+    } else {
+        throw std::invalid_argument("Unknown setting '" + key + "' in Redis endpoint: " + uri);
+    }
+}
+
+void parseAuthority(RedisEndpoint& endpoint, const std::string& authority, const std::string& uri) {
+    std::string port;
+    if (!authority.empty() && authority[0] == '[') {
+        // [IPv6]:port
+        size_t close = authority.find(']');
+        if (close == std::string::npos) {
+            throw std::invalid_argument("Unterminated IPv6 address in Redis endpoint: " + uri);
+        }
+        endpoint.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size()) {
+            if (authority[close + 1] != ':') {
+                throw std::invalid_argument("Unexpected characters after IPv6 address in Redis endpoint: " + uri);
+            }
+            port = authority.substr(close + 2);
+        }
+    } else if (authority.find(':') != authority.rfind(':')) {
+        // Bare IPv6 address without a port.
+        endpoint.host = authority;
+    } else {
+        size_t colon = authority.find(':');
+        endpoint.host = authority.substr(0, colon);
+        if (colon != std::string::npos) {
+            port = authority.substr(colon + 1);
+        }
+    }
+
+    if (endpoint.host.empty()) {
+        throw std::invalid_argument("Missing host in Redis endpoint: " + uri);
+    }
+    if (!port.empty() || authority.back() == ':') {
+        long long number = parseNumber(port, uri);
+        if (number < 1 || number > 65535) {
+            throw std::invalid_argument("Port out of range in Redis endpoint: " + uri);
+        }
+        endpoint.port = static_cast<int>(number);
+    }
+}
+
+} // namespace
+
+RedisEndpoint RedisEndpoint::parse(const std::string& uri) {
+    RedisEndpoint endpoint;
+
+    size_t query = uri.find('?');
+    std::string address = uri.substr(0, query);
+
+    if (address.compare(0, kUnixScheme.size(), kUnixScheme) == 0) {
+        endpoint.type = Type::Unix;
+        endpoint.path = address.substr(kUnixScheme.size());
+        if (endpoint.path.empty()) {
+            throw std::invalid_argument("Missing socket path in Redis endpoint: " + uri);
+        }
+    } else {
+        if (address.compare(0, kTcpScheme.size(), kTcpScheme) == 0) {
+            address = address.substr(kTcpScheme.size());
+        }
+        if (address.empty()) {
+            throw std::invalid_argument("Missing host in Redis endpoint: " + uri);
+        }
+        parseAuthority(endpoint, address, uri);
+    }
+
+    if (query != std::string::npos) {
+        size_t start = query + 1;
+        while (start <= uri.size()) {
+            size_t end = uri.find('&', start);
+            if (end == std::string::npos) end = uri.size();
+            if (end > start) {
+                parseSetting(endpoint, uri.substr(start, end - start), uri);
+            }
+            start = end + 1;
+        }
+    }
+
+    return endpoint;
+}
+
+std::string RedisEndpoint::toString() const {
+    if (type == Type::Unix) {
+        return kUnixScheme + path;
+    }
+    if (host.find(':') != std::string::npos) {
+        return kTcpScheme + "[" + host + "]:" + std::to_string(port);
+    }
+    return kTcpScheme + host + ":" + std::to_string(port);
+}
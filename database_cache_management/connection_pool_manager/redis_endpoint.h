@@ -0,0 +1,37 @@
+#ifndef REDIS_ENDPOINT_H
+#define REDIS_ENDPOINT_H
+
+#include <string>
+#include <chrono>
+#include <optional>
+
+// A Redis server address plus per-endpoint connection settings.
+//
+// Accepted forms:
+//   unix:///var/run/redis/redis.sock
+//   tcp://host:port, tcp://[::1]:port
+//   host:port, host (port 6379)
+//
+// Settings may be appended as a query string, e.g.
+//   tcp://10.0.0.5:6380?connect_timeout_ms=200&command_timeout_ms=50&keepalive=1&nodelay=1
+// Settings that are not given fall back to the pool-wide ConnectionPoolOptions.
+struct RedisEndpoint {
+    enum class Type { Tcp, Unix };
+
+    Type type = Type::Tcp;
+    std::string host;  // Tcp only
+    int port = 6379;   // Tcp only
+    std::string path;  // Unix only
+
+    std::optional<std::chrono::milliseconds> connect_timeout;
+    std::optional<std::chrono::milliseconds> command_timeout; // 0 disables the timeout
+    std::optional<bool> tcp_nodelay;
+    std::optional<bool> tcp_keepalive;
+
+    // Throws std::invalid_argument on a malformed URI or unknown setting.
+    static RedisEndpoint parse(const std::string& uri);
+
+    std::string toString() const;
+};
+
+#endif // REDIS_ENDPOINT_H
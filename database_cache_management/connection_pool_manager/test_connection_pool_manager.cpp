@@ -1,13 +1,114 @@
 #include "connection_pool_manager.h"
+#include "redis_connection_guard.h"
+#include "batch_executor.h"
 #include <gtest/gtest.h>
 #include <vector>
 #include <string>
 #include <thread>
+#include <set>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
 #include <hiredis/hiredis.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 // We will use a live Redis server for integration testing.
 // Make sure Redis is running on localhost:6379.
 
+namespace {
+
+// Forwards connections on an ephemeral local port to the Redis server on
+// 127.0.0.1:6379, holding every request back for delay. Lets a test treat
+// one "host" as slow.
+class DelayingProxy {
+public:
+    explicit DelayingProxy(std::chrono::milliseconds delay) : delay_(delay) {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (bind(listen_fd_, (sockaddr*)&address, length) != 0 || listen(listen_fd_, 16) != 0 ||
+            getsockname(listen_fd_, (sockaddr*)&address, &length) != 0) {
+            throw std::runtime_error("DelayingProxy cannot listen");
+        }
+        port_ = ntohs(address.sin_port);
+        acceptor_ = std::thread([this] { acceptLoop(); });
+    }
+
+    ~DelayingProxy() {
+        stop_ = true;
+        shutdown(listen_fd_, SHUT_RDWR);
+        acceptor_.join();
+        close(listen_fd_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& thread : connections_) {
+            thread.join();
+        }
+    }
+
+    std::string address() const { return "127.0.0.1:" + std::to_string(port_); }
+
+private:
+    void acceptLoop() {
+        while (!stop_) {
+            int client = accept(listen_fd_, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            int server = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in redis{};
+            redis.sin_family = AF_INET;
+            redis.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            redis.sin_port = htons(6379);
+            if (connect(server, (sockaddr*)&redis, sizeof(redis)) != 0) {
+                close(client);
+                close(server);
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            connections_.emplace_back([this, client, server] { relay(client, server); });
+        }
+    }
+
+    void relay(int client, int server) {
+        pollfd fds[2] = {{client, POLLIN, 0}, {server, POLLIN, 0}};
+        char buffer[16384];
+        while (!stop_) {
+            if (poll(fds, 2, 50) <= 0) {
+                continue;
+            }
+            if (fds[0].revents) {
+                ssize_t n = read(client, buffer, sizeof(buffer));
+                if (n <= 0) break;
+                std::this_thread::sleep_for(delay_);
+                if (write(server, buffer, n) != n) break;
+            }
+            if (fds[1].revents) {
+                ssize_t n = read(server, buffer, sizeof(buffer));
+                if (n <= 0 || write(client, buffer, n) != n) break;
+            }
+        }
+        close(client);
+        close(server);
+    }
+
+    const std::chrono::milliseconds delay_;
+    int listen_fd_ = -1;
+    int port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread acceptor_;
+    std::mutex mutex_;
+    std::vector<std::thread> connections_;
+};
+
+} // namespace
+
 TEST(ConnectionPoolManagerTest, BasicConnection) {
     std::vector<std::string> hosts = {"127.0.0.1"};
     ConnectionPoolManager pool(hosts, 1);
@@ -83,3 +184,583 @@ TEST(ConnectionPoolManagerTest, Shutdown) {
 
     t.join();
 }
+
+// Every slot should be handed out exactly once until it is returned.
+TEST(ConnectionPoolManagerTest, DistinctConnectionsWhenFullyCheckedOut) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    const int pool_size = 20;
+    ConnectionPoolManager pool(hosts, pool_size);
+
+    std::set<redisContext*> checked_out;
+    for (int i = 0; i < pool_size; ++i) {
+        redisContext* conn = pool.getConnection();
+        ASSERT_NE(conn, nullptr);
+        ASSERT_TRUE(checked_out.insert(conn).second);
+    }
+
+    for (auto conn : checked_out) {
+        pool.returnConnection(conn);
+    }
+
+    // All connections are available again.
+    std::set<redisContext*> second_round;
+    for (int i = 0; i < pool_size; ++i) {
+        second_round.insert(pool.getConnection());
+    }
+    ASSERT_EQ(second_round, checked_out);
+    for (auto conn : second_round) {
+        pool.returnConnection(conn);
+    }
+}
+
+// Hammer checkout/return from more threads than connections and make sure no
+// connection is ever held by two threads at once.
+TEST(ConnectionPoolManagerTest, ConcurrentCheckoutIsExclusive) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 4);
+
+    std::mutex held_mutex;
+    std::set<redisContext*> held;
+    std::atomic<int> violations{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 16; ++t) {
+        threads.emplace_back([&]() {
+            for (int i = 0; i < 2000; ++i) {
+                redisContext* conn = pool.getConnection();
+                {
+                    std::lock_guard<std::mutex> lock(held_mutex);
+                    if (!held.insert(conn).second) violations++;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(held_mutex);
+                    held.erase(conn);
+                }
+                pool.returnConnection(conn);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    ASSERT_EQ(violations.load(), 0);
+}
+
+// A host that cannot be reached must not stall checkout from healthy hosts.
+TEST(ConnectionPoolManagerTest, UnreachableHostDoesNotBlockCheckout) {
+    std::vector<std::string> hosts = {"127.0.0.1", "unreachable.invalid"};
+    ConnectionPoolOptions options;
+    options.connect_timeout = std::chrono::milliseconds(200);
+    ConnectionPoolManager pool(hosts, 4, options);
+
+    for (int i = 0; i < 2; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        redisContext* conn = pool.getConnection();
+        ASSERT_NE(conn, nullptr);
+        ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(100));
+
+        redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+        ASSERT_NE(reply, nullptr);
+        ASSERT_STREQ(reply->str, "PONG");
+        freeReplyObject(reply);
+        pool.returnConnection(conn);
+    }
+}
+
+// A connection returned in an error state is quarantined and replaced.
+TEST(ConnectionPoolManagerTest, BrokenConnectionIsReplaced) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.health_check_interval = std::chrono::milliseconds(100);
+    ConnectionPoolManager pool(hosts, 1, options);
+
+    redisContext* conn = pool.getConnection();
+    ASSERT_NE(conn, nullptr);
+    // The server closes the connection after QUIT, so the next command fails.
+    redisReply* reply = (redisReply*)redisCommand(conn, "QUIT");
+    if (reply) freeReplyObject(reply);
+    reply = (redisReply*)redisCommand(conn, "PING");
+    ASSERT_EQ(reply, nullptr);
+    ASSERT_NE(conn->err, 0);
+    pool.returnConnection(conn);
+
+    // Blocks until the health engine has reconnected the slot.
+    redisContext* replacement = pool.getConnection();
+    ASSERT_NE(replacement, nullptr);
+    reply = (redisReply*)redisCommand(replacement, "PING");
+    ASSERT_NE(reply, nullptr);
+    ASSERT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+    pool.returnConnection(replacement);
+}
+
+TEST(ConnectionPoolManagerTest, ParseEndpointUris) {
+    RedisEndpoint plain = RedisEndpoint::parse("127.0.0.1");
+    EXPECT_EQ(plain.type, RedisEndpoint::Type::Tcp);
+    EXPECT_EQ(plain.host, "127.0.0.1");
+    EXPECT_EQ(plain.port, 6379);
+
+    RedisEndpoint host_port = RedisEndpoint::parse("redis-1:6380");
+    EXPECT_EQ(host_port.host, "redis-1");
+    EXPECT_EQ(host_port.port, 6380);
+
+    RedisEndpoint tcp = RedisEndpoint::parse("tcp://[::1]:7000?connect_timeout_ms=200&command_timeout_ms=50&keepalive=0&nodelay=1");
+    EXPECT_EQ(tcp.host, "::1");
+    EXPECT_EQ(tcp.port, 7000);
+    EXPECT_EQ(tcp.connect_timeout, std::chrono::milliseconds(200));
+    EXPECT_EQ(tcp.command_timeout, std::chrono::milliseconds(50));
+    EXPECT_EQ(tcp.tcp_keepalive, false);
+    EXPECT_EQ(tcp.tcp_nodelay, true);
+    EXPECT_EQ(tcp.toString(), "tcp://[::1]:7000");
+
+    RedisEndpoint unix_socket = RedisEndpoint::parse("unix:///var/run/redis/redis.sock");
+    EXPECT_EQ(unix_socket.type, RedisEndpoint::Type::Unix);
+    EXPECT_EQ(unix_socket.path, "/var/run/redis/redis.sock");
+    EXPECT_FALSE(unix_socket.command_timeout.has_value());
+
+    EXPECT_THROW(RedisEndpoint::parse(""), std::invalid_argument);
+    EXPECT_THROW(RedisEndpoint::parse("unix://"), std::invalid_argument);
+    EXPECT_THROW(RedisEndpoint::parse("host:0"), std::invalid_argument);
+    EXPECT_THROW(RedisEndpoint::parse("host:abc"), std::invalid_argument);
+    EXPECT_THROW(RedisEndpoint::parse("host:6379?bogus=1"), std::invalid_argument);
+    EXPECT_THROW(ConnectionPoolManager(std::vector<std::string>{"host:99999"}, 1), std::invalid_argument);
+}
+
+TEST(ConnectionPoolManagerTest, HostPortEndpoint) {
+    std::vector<std::string> hosts = {"tcp://127.0.0.1:6379?keepalive=1&command_timeout_ms=1000"};
+    ConnectionPoolManager pool(hosts, 2);
+
+    redisContext* conn = pool.getConnection();
+    ASSERT_NE(conn, nullptr);
+    redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+    ASSERT_NE(reply, nullptr);
+    ASSERT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+    pool.returnConnection(conn);
+}
+
+// Set REDIS_UNIX_SOCKET to the server's unixsocket path to run this test.
+TEST(ConnectionPoolManagerTest, UnixSocketEndpoint) {
+    const char* socket_path = std::getenv("REDIS_UNIX_SOCKET");
+    if (socket_path == nullptr) {
+        GTEST_SKIP() << "REDIS_UNIX_SOCKET not set";
+    }
+
+    std::vector<std::string> hosts = {std::string("unix://") + socket_path};
+    ConnectionPoolManager pool(hosts, 2);
+
+    redisContext* conn = pool.getConnection();
+    ASSERT_NE(conn, nullptr);
+    redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+    ASSERT_NE(reply, nullptr);
+    ASSERT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+    pool.returnConnection(conn);
+}
+
+namespace {
+
+// Both hosts point at the same server; the host name tells them apart.
+std::map<std::string, int> checkoutHosts(ConnectionPoolManager& pool, int count) {
+    std::vector<redisContext*> held;
+    std::map<std::string, int> per_host;
+    for (int i = 0; i < count; ++i) {
+        redisContext* conn = pool.getConnection();
+        held.push_back(conn);
+        per_host[conn->tcp.host]++;
+    }
+    for (auto conn : held) {
+        pool.returnConnection(conn);
+    }
+    return per_host;
+}
+
+} // namespace
+
+TEST(ConnectionPoolManagerTest, RoundRobinSpreadsAcrossHosts) {
+    std::vector<std::string> hosts = {"127.0.0.1", "localhost"};
+    ConnectionPoolOptions options;
+    options.routing_policy = RoutingPolicy::RoundRobin;
+    ConnectionPoolManager pool(hosts, 8, options);
+
+    auto per_host = checkoutHosts(pool, 4);
+    EXPECT_EQ(per_host["127.0.0.1"], 2);
+    EXPECT_EQ(per_host["localhost"], 2);
+}
+
+TEST(ConnectionPoolManagerTest, LeastOutstandingBalancesHeldConnections) {
+    std::vector<std::string> hosts = {"127.0.0.1", "localhost"};
+    ConnectionPoolOptions options;
+    options.routing_policy = RoutingPolicy::LeastOutstanding;
+    ConnectionPoolManager pool(hosts, 8, options);
+
+    auto per_host = checkoutHosts(pool, 6);
+    EXPECT_EQ(per_host["127.0.0.1"], 3);
+    EXPECT_EQ(per_host["localhost"], 3);
+}
+
+TEST(ConnectionPoolManagerTest, EwmaLatencyAvoidsSlowHost) {
+    DelayingProxy slow_host(std::chrono::milliseconds(20));
+    std::vector<std::string> hosts = {"127.0.0.1", slow_host.address()};
+    ConnectionPoolOptions options;
+    options.routing_policy = RoutingPolicy::EwmaLatency;
+    options.health_check_interval = std::chrono::milliseconds(20);
+    ConnectionPoolManager pool(hosts, 4, options);
+
+    // Let the health PINGs measure both hosts.
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    // Time spent holding a connection is the caller's, not the host's: the
+    // fast host stays preferred however long its connections are held.
+    int fast = 0;
+    for (int i = 0; i < 20; ++i) {
+        redisContext* conn = pool.getConnection();
+        if (conn->tcp.port == 6379) {
+            fast++;
+            std::this_thread::sleep_for(std::chrono::milliseconds(40));
+        }
+        pool.returnConnection(conn);
+    }
+    EXPECT_GE(fast, 18);
+}
+
+TEST(ConnectionPoolManagerTest, TryGetConnectionTimesOut) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 1);
+
+    redisContext* conn = pool.getConnection();
+    ASSERT_NE(conn, nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(pool.tryGetConnection(std::chrono::milliseconds(50)), nullptr);
+    auto waited = std::chrono::steady_clock::now() - start;
+    EXPECT_GE(waited, std::chrono::milliseconds(50));
+    EXPECT_LT(waited, std::chrono::milliseconds(1000));
+
+    ASSERT_THROW(RedisConnectionGuard(&pool, std::chrono::milliseconds(10)), ConnectionPoolTimeout);
+
+    pool.returnConnection(conn);
+    {
+        RedisConnectionGuard guard(&pool, std::chrono::milliseconds(10));
+        ASSERT_EQ(guard.getContext(), conn);
+    }
+
+    ConnectionPoolStats stats = pool.getStats();
+    EXPECT_EQ(stats.timeouts, 2u);
+    EXPECT_EQ(stats.exhausted, 2u);
+    EXPECT_EQ(stats.checkouts, 2u);
+}
+
+TEST(ConnectionPoolManagerTest, StatsReportUtilizationAndWaits) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 4);
+
+    redisContext* held[3];
+    for (auto& conn : held) {
+        conn = pool.getConnection();
+    }
+
+    ConnectionPoolStats stats = pool.getStats();
+    EXPECT_EQ(stats.pool_size, 4);
+    EXPECT_EQ(stats.connected, 4);
+    EXPECT_EQ(stats.idle, 1);
+    EXPECT_EQ(stats.in_use, 3);
+    EXPECT_DOUBLE_EQ(stats.utilization(), 0.75);
+    EXPECT_EQ(stats.wait_histogram[0], 3u);
+
+    // Exhaust the pool and make a checkout wait ~20ms.
+    redisContext* last = pool.getConnection();
+    std::thread returner([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pool.returnConnection(last);
+    });
+    redisContext* waited = pool.getConnection();
+    returner.join();
+
+    stats = pool.getStats();
+    EXPECT_EQ(stats.exhausted, 1u);
+    EXPECT_EQ(stats.checkouts, 5u);
+    ASSERT_EQ(stats.wait_histogram.size(), stats.wait_bucket_bounds.size());
+    uint64_t slow_waits = 0;
+    for (size_t i = 0; i < stats.wait_histogram.size(); ++i) {
+        if (stats.wait_bucket_bounds[i] >= std::chrono::milliseconds(10)) {
+            slow_waits += stats.wait_histogram[i];
+        }
+    }
+    EXPECT_EQ(slow_waits, 1u);
+
+    pool.returnConnection(waited);
+    for (auto conn : held) {
+        pool.returnConnection(conn);
+    }
+}
+
+TEST(ConnectionPoolManagerTest, MinReadyReturnsEarlyAndFinishesWarmup) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.min_ready = 2;
+    ConnectionPoolManager pool(hosts, 16, options);
+
+    EXPECT_GE(pool.getStats().connected, 2);
+
+    // The rest of the pool keeps connecting in the background.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.getStats().connected < 16 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(pool.getStats().connected, 16);
+    EXPECT_EQ(pool.getStats().reconnects, 0u);
+}
+
+TEST(ConnectionPoolManagerTest, LazyPoolOpensConnectionsOnDemand) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.lazy_connect = true;
+    ConnectionPoolManager pool(hosts, 3, options);
+
+    EXPECT_EQ(pool.getStats().connected, 0);
+
+    redisContext* first = pool.getConnection();
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(pool.getStats().connected, 1);
+
+    // Reusing an idle connection does not open another one.
+    pool.returnConnection(first);
+    first = pool.getConnection();
+    EXPECT_EQ(pool.getStats().connected, 1);
+
+    std::vector<redisContext*> held = {first, pool.getConnection(), pool.getConnection()};
+    EXPECT_EQ(pool.getStats().connected, 3);
+
+    // Never more than pool_size connections.
+    EXPECT_EQ(pool.tryGetConnection(std::chrono::milliseconds(20)), nullptr);
+    EXPECT_EQ(pool.getStats().connected, 3);
+
+    for (auto conn : held) {
+        pool.returnConnection(conn);
+    }
+}
+
+// A failed lazy open leaves its slot to the health engine, which backs off
+// the host instead of retrying it right away.
+TEST(ConnectionPoolManagerTest, LazyPoolSkipsUnreachableHost) {
+    std::vector<std::string> hosts = {"127.0.0.1", "127.0.0.1:1"};
+    ConnectionPoolOptions options;
+    options.lazy_connect = true;
+    options.health_check_interval = std::chrono::milliseconds(20);
+    options.reconnect_backoff_initial = std::chrono::milliseconds(10000);
+    ConnectionPoolManager pool(hosts, 4, options);
+
+    // Two slots per host; only the reachable host's slots open.
+    std::vector<redisContext*> held;
+    for (int i = 0; i < 4; ++i) {
+        redisContext* conn = pool.tryGetConnection(std::chrono::milliseconds(100));
+        if (conn == nullptr) continue;
+        redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+        ASSERT_NE(reply, nullptr);
+        EXPECT_STREQ(reply->str, "PONG");
+        freeReplyObject(reply);
+        held.push_back(conn);
+    }
+    EXPECT_EQ(held.size(), 2u);
+    EXPECT_EQ(pool.getStats().connected, 2);
+
+    // The host is in backoff, so the engine has not tried it again.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(pool.getStats().reconnect_failures, 0u);
+
+    for (auto conn : held) {
+        pool.returnConnection(conn);
+    }
+    for (int i = 0; i < 20; ++i) {
+        redisContext* conn = pool.getConnection();
+        redisReply* reply = (redisReply*)redisCommand(conn, "PING");
+        ASSERT_NE(reply, nullptr);
+        EXPECT_STREQ(reply->str, "PONG");
+        freeReplyObject(reply);
+        pool.returnConnection(conn);
+    }
+}
+
+TEST(ConnectionPoolManagerTest, ElasticPoolGrowsUnderWaitPressure) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.max_pool_size = 4;
+    options.resize_interval = std::chrono::milliseconds(20);
+    options.grow_after_periods = 2;
+    ConnectionPoolManager pool(hosts, 2, options);
+
+    EXPECT_EQ(pool.getStats().connected, 2);
+    EXPECT_EQ(pool.getStats().pool_size, 4);
+    std::vector<redisContext*> held = {pool.getConnection(), pool.getConnection()};
+
+    // Keep checkouts waiting until the pool has grown enough to serve them.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (held.size() < 4 && std::chrono::steady_clock::now() < deadline) {
+        redisContext* conn = pool.tryGetConnection(std::chrono::milliseconds(10));
+        if (conn) {
+            held.push_back(conn);
+        }
+    }
+    ASSERT_EQ(held.size(), 4u);
+    EXPECT_EQ(pool.getStats().connected, 4);
+    EXPECT_EQ(pool.getStats().grown, 2u);
+
+    // Never beyond max_pool_size.
+    EXPECT_EQ(pool.tryGetConnection(std::chrono::milliseconds(100)), nullptr);
+    EXPECT_EQ(pool.getStats().connected, 4);
+
+    for (auto conn : held) {
+        pool.returnConnection(conn);
+    }
+}
+
+TEST(ConnectionPoolManagerTest, ElasticPoolShrinksIdleConnections) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.min_pool_size = 1;
+    options.resize_interval = std::chrono::milliseconds(20);
+    options.idle_timeout = std::chrono::milliseconds(100);
+    ConnectionPoolManager pool(hosts, 4, options);
+
+    // A connection in steady use survives, the idle rest is closed.
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pool.getStats().connected > 1 && std::chrono::steady_clock::now() < deadline) {
+        redisContext* conn = pool.getConnection();
+        ASSERT_NE(conn, nullptr);
+        pool.returnConnection(conn);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    ConnectionPoolStats stats = pool.getStats();
+    EXPECT_EQ(stats.connected, 1);
+    EXPECT_EQ(stats.shrunk, 3u);
+
+    // The remaining connection still works, and the pool never drops below min.
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    EXPECT_EQ(pool.getStats().connected, 1);
+    RedisConnectionGuard guard(&pool);
+    redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "PING");
+    ASSERT_NE(reply, nullptr);
+    EXPECT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+}
+
+TEST(ConnectionPoolManagerTest, ElasticBoundsAreValidated) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolOptions options;
+    options.max_pool_size = 2;
+    EXPECT_THROW(ConnectionPoolManager(hosts, 4, options), std::invalid_argument);
+    options = ConnectionPoolOptions();
+    options.min_pool_size = 5;
+    EXPECT_THROW(ConnectionPoolManager(hosts, 4, options), std::invalid_argument);
+}
+
+TEST(ConnectionPoolManagerTest, DedicatedConnectionsStayOutOfThePool) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 1);
+    EXPECT_EQ(pool.hostCount(), 1u);
+
+    redisContext* dedicated = pool.openDedicatedConnection(3);
+    ASSERT_NE(dedicated, nullptr);
+    redisReply* reply = (redisReply*)redisCommand(dedicated, "PING");
+    ASSERT_NE(reply, nullptr);
+    EXPECT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+
+    // The pool's only connection is still available.
+    ConnectionPoolStats stats = pool.getStats();
+    EXPECT_EQ(stats.idle, 1);
+    EXPECT_EQ(stats.in_use, 0);
+    redisFree(dedicated);
+}
+
+TEST(ConnectionPoolManagerTest, BatchExecutorPipelinesCommands) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 1);
+
+    // More commands than max_in_flight, so add() drains part of the way.
+    BatchExecutor batch(&pool, 64);
+    batch.add({"DEL", "batch_counter", "batch_value"});
+    std::vector<size_t> increments;
+    for (int i = 1; i <= 1000; ++i) {
+        increments.push_back(batch.add({"INCRBY", "batch_counter", std::to_string(i)}));
+    }
+    std::string binary("a\0b", 3);
+    size_t set = batch.add(std::vector<std::string>{"SET", "batch_value", binary});
+    size_t get = batch.add({"GET", "batch_value"});
+    size_t missing = batch.add({"GET", "batch_missing"});
+    size_t mget = batch.add({"MGET", "batch_counter", "batch_missing"});
+    batch.execute();
+
+    EXPECT_EQ(batch.size(), 1005u);
+    EXPECT_EQ(batch.pending(), 0u);
+    EXPECT_EQ(batch.failures(), 0u);
+    long long expected = 0;
+    for (int i = 1; i <= 1000; ++i) {
+        expected += i;
+        ASSERT_EQ(batch.integer(increments[i - 1]), expected);
+    }
+    EXPECT_EQ(batch.view(set), "OK");
+    EXPECT_EQ(batch.string(get), binary);
+    EXPECT_TRUE(batch.isNil(missing));
+    EXPECT_EQ(batch.string(missing), std::nullopt);
+    auto values = batch.array(mget);
+    ASSERT_EQ(values.size(), 2u);
+    EXPECT_EQ(values[0], std::to_string(expected));
+    EXPECT_EQ(values[1], std::nullopt);
+
+    // The batch can be reused on the same connection.
+    batch.clear();
+    size_t del = batch.add({"DEL", "batch_counter", "batch_value"});
+    batch.execute();
+    EXPECT_EQ(batch.integer(del), 2);
+}
+
+TEST(ConnectionPoolManagerTest, BatchExecutorIsolatesCommandErrors) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 1);
+    {
+        BatchExecutor batch(&pool);
+        batch.add({"SET", "batch_text", "not a number"});
+        size_t before = batch.add({"INCR", "batch_number"});
+        size_t failed = batch.add({"INCR", "batch_text"});
+        size_t after = batch.add({"INCR", "batch_number"});
+        size_t wrong_type = batch.add({"GET", "batch_number"});
+
+        EXPECT_THROW(batch.integer(before), std::logic_error);
+        batch.execute();
+
+        EXPECT_EQ(batch.failures(), 1u);
+        EXPECT_TRUE(batch.ok(before));
+        EXPECT_FALSE(batch.ok(failed));
+        EXPECT_NE(batch.error(failed).find("not an integer"), std::string::npos);
+        EXPECT_TRUE(batch.error(after).empty());
+        EXPECT_THROW(batch.integer(failed), std::runtime_error);
+        EXPECT_EQ(batch.reply(failed), nullptr);
+        EXPECT_EQ(batch.integer(after), batch.integer(before) + 1);
+        EXPECT_THROW(batch.integer(wrong_type), std::runtime_error);
+        EXPECT_THROW(batch.ok(99), std::out_of_range);
+
+        batch.clear();
+        batch.add({"DEL", "batch_text", "batch_number"});
+        batch.execute();
+    }
+    // Error replies do not poison the connection.
+    EXPECT_EQ(pool.getStats().quarantined, 0u);
+}
+
+TEST(ConnectionPoolManagerTest, BatchExecutorReadsUnexecutedRepliesBeforeReturning) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    ConnectionPoolManager pool(hosts, 1);
+    {
+        BatchExecutor batch(&pool);
+        batch.add({"ECHO", "left over"});
+    }
+
+    RedisConnectionGuard guard(&pool);
+    redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "PING");
+    ASSERT_NE(reply, nullptr);
+    EXPECT_STREQ(reply->str, "PONG");
+    freeReplyObject(reply);
+}
@@ -1,20 +1,127 @@
 #include "counter_service.h"
 #include <connection_pool_manager/redis_connection_guard.h>
+#include <connection_pool_manager/batch_executor.h>
 #include <hiredis/hiredis.h>
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <random>
+#include <string_view>
+#include <iostream>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
-CounterService::CounterService(std::shared_ptr<ConnectionPoolManager> pool_manager)
-    : pool_manager_(pool_manager) {
+namespace {
+
+// One buffered counter, on its own cache line so that threads bumping
+// different counters do not contend.
+struct alignas(64) BufferedCounter {
+    std::atomic<long long> delta{0};
+    // Value Redis returned when the counter was last flushed.
+    std::atomic<long long> flushed_value{0};
+    // Nothing to flush last time; dropped if that happens twice in a row.
+    // Only touched by the flush under its shard's exclusive lock.
+    bool idle = false;
+};
+
+// Parses a counter straight from the reply buffer.
+long long parseCounterValue(const redisReply* reply) {
+    if (reply->type == REDIS_REPLY_NIL) {
+        return 0; // Default to 0 if key doesn't exist
+    }
+    if (reply->type != REDIS_REPLY_STRING) {
+        throw std::runtime_error("Unexpected reply type when getting counter value");
+    }
+    long long value = 0;
+    const char* end = reply->str + reply->len;
+    auto [parsed_end, error] = std::from_chars(reply->str, end, value);
+    if (error != std::errc() || parsed_end != end) {
+        throw std::runtime_error("Counter value is not an integer");
+    }
+    return value;
+}
+
+std::string stripeKey(const std::string& counter_key, size_t stripe) {
+    return stripe == 0 ? counter_key : counter_key + ":stripe:" + std::to_string(stripe);
+}
+
+// Each thread sticks to one stripe, picked at random so that threads of
+// different processes do not pile onto the same one.
+size_t threadStripeSeed() {
+    thread_local const size_t seed = std::random_device{}();
+    return seed;
+}
+
+// Elements per PFADD when flushing or adding many at once.
+constexpr size_t kPfaddChunkSize = 1000;
+
+} // namespace
+
+// Local deltas of a buffered service. Updates take their shard's lock shared
+// and add atomically, so only the first update of a counter (which inserts
+// it) and the flusher's scan lock a shard exclusively.
+struct CounterService::WriteBuffer {
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, std::unique_ptr<BufferedCounter>> counters;
+        // HyperLogLog elements added since the last flush, per key.
+        std::unordered_map<std::string, std::unordered_set<std::string>> distinct;
+    };
+
+    explicit WriteBuffer(size_t shard_count) : shards(shard_count) {}
+
+    Shard& shardFor(const std::string& key) {
+        return shards[std::hash<std::string>{}(key) % shards.size()];
+    }
+
+    std::vector<Shard> shards;
+    std::atomic<size_t> updates{0}; // Since the last flush
+};
+
+CounterService::CounterService(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                               std::shared_ptr<AsyncCommandEngine> async_engine,
+                               const CounterServiceOptions& options)
+    : pool_manager_(pool_manager), async_engine_(async_engine), options_(options) {
+    if (options_.buffered) {
+        if (options_.flush_interval.count() <= 0) {
+            throw std::invalid_argument("flush_interval must be positive");
+        }
+        if (options_.buffer_shards == 0) {
+            throw std::invalid_argument("buffer_shards must be positive");
+        }
+        buffer_ = std::make_unique<WriteBuffer>(options_.buffer_shards);
+        flusher_thread_ = std::thread(&CounterService::flusherLoop, this);
+    }
 }
 
 CounterService::~CounterService() {
+    if (!buffer_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(flusher_mutex_);
+        stop_flusher_ = true;
+    }
+    flusher_cv_.notify_one();
+    flusher_thread_.join();
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to flush buffered counters: " << e.what() << std::endl;
+    }
 }
 
 long long CounterService::increment(const std::string& counter_key, long long amount) {
+    const std::string key = updateKey(counter_key);
+    if (buffer_) {
+        return bufferedAdd(key, amount);
+    }
     RedisConnectionGuard conn(pool_manager_.get());
 
-    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "INCRBY %s %lld", counter_key.c_str(), amount);
+    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "INCRBY %s %lld", key.c_str(), amount);
     if (!reply || reply->type != REDIS_REPLY_INTEGER) {
         if (reply) freeReplyObject(reply);
         throw std::runtime_error("Failed to increment counter in Redis");
@@ -26,9 +133,13 @@ long long CounterService::increment(const std::string& counter_key, long long am
 }
 
 long long CounterService::decrement(const std::string& counter_key, long long amount) {
+    const std::string key = updateKey(counter_key);
+    if (buffer_) {
+        return bufferedAdd(key, -amount);
+    }
     RedisConnectionGuard conn(pool_manager_.get());
 
-    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "DECRBY %s %lld", counter_key.c_str(), amount);
+    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "DECRBY %s %lld", key.c_str(), amount);
     if (!reply || reply->type != REDIS_REPLY_INTEGER) {
         if (reply) freeReplyObject(reply);
         throw std::runtime_error("Failed to decrement counter in Redis");
@@ -40,6 +151,14 @@ long long CounterService::decrement(const std::string& counter_key, long long am
 }
 
 long long CounterService::getValue(const std::string& counter_key) {
+    if (stripes(counter_key) > 1) {
+        return getValues({counter_key}).front();
+    }
+    // Keeps a flush from moving the delta between the GET and the buffer.
+    std::shared_lock<std::shared_mutex> flush_lock(flush_mutex_, std::defer_lock);
+    if (buffer_ && options_.read_your_writes) {
+        flush_lock.lock();
+    }
     RedisConnectionGuard conn(pool_manager_.get());
 
     redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "GET %s", counter_key.c_str());
@@ -47,23 +166,564 @@ long long CounterService::getValue(const std::string& counter_key) {
         throw std::runtime_error("Failed to get counter value from Redis");
     }
 
-    long long result = 0; // Default to 0 if key doesn't exist
-    if (reply->type == REDIS_REPLY_STRING) {
-        result = std::stoll(reply->str);
-    } else if (reply->type != REDIS_REPLY_NIL) {
+    long long result;
+    try {
+        result = parseCounterValue(reply);
+    } catch (...) {
         freeReplyObject(reply);
-        throw std::runtime_error("Unexpected reply type when getting counter value");
+        throw;
     }
 
     freeReplyObject(reply);
+    if (flush_lock.owns_lock()) {
+        result += bufferedDelta(counter_key);
+    }
     return result;
 }
 
 void CounterService::deleteCounter(const std::string& counter_key) {
+    std::vector<std::string> keys = storedKeys(counter_key);
+    std::unique_lock<std::shared_mutex> flush_lock(flush_mutex_, std::defer_lock);
+    if (buffer_) {
+        flush_lock.lock();
+        for (const auto& key : keys) {
+            auto& shard = buffer_->shardFor(key);
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            shard.counters.erase(key);
+            shard.distinct.erase(key);
+        }
+    }
     RedisConnectionGuard conn(pool_manager_.get());
 
-    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "DEL %s", counter_key.c_str());
+    keys.insert(keys.begin(), "DEL");
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    for (const auto& key : keys) {
+        argv.push_back(key.data());
+        argvlen.push_back(key.size());
+    }
+    redisReply* reply = (redisReply*)redisCommandArgv(conn.getContext(), static_cast<int>(argv.size()),
+                                                      argv.data(), argvlen.data());
     if (reply) {
         freeReplyObject(reply);
     }
 }
+
+std::vector<long long> CounterService::getValues(const std::vector<std::string>& counter_keys) {
+    // Striped counters expand into their stripes, which are summed below.
+    std::vector<size_t> counts(counter_keys.size(), 1);
+    size_t extra_stripes = 0;
+    {
+        std::shared_lock<std::shared_mutex> lock(stripes_mutex_);
+        if (!stripes_.empty()) {
+            for (size_t i = 0; i < counter_keys.size(); ++i) {
+                auto it = stripes_.find(counter_keys[i]);
+                if (it != stripes_.end()) {
+                    counts[i] = it->second;
+                    extra_stripes += it->second - 1;
+                }
+            }
+        }
+    }
+    std::vector<std::string> stripe_keys;
+    stripe_keys.reserve(extra_stripes); // Never reallocates, so views stay valid
+    std::vector<std::string_view> keys;
+    std::vector<size_t> owners; // Index into counter_keys of each key
+    keys.reserve(counter_keys.size() + extra_stripes);
+    owners.reserve(counter_keys.size() + extra_stripes);
+    for (size_t i = 0; i < counter_keys.size(); ++i) {
+        keys.push_back(counter_keys[i]);
+        owners.push_back(i);
+        for (size_t stripe = 1; stripe < counts[i]; ++stripe) {
+            stripe_keys.push_back(stripeKey(counter_keys[i], stripe));
+            keys.push_back(stripe_keys.back());
+            owners.push_back(i);
+        }
+    }
+
+    std::shared_lock<std::shared_mutex> flush_lock(flush_mutex_, std::defer_lock);
+    if (buffer_ && options_.read_your_writes) {
+        flush_lock.lock();
+    }
+    std::vector<long long> values(counter_keys.size(), 0);
+    if (keys.empty()) {
+        return values;
+    }
+
+    const size_t chunk_size = std::max<size_t>(options_.mget_chunk_size, 1);
+    BatchExecutor batch(pool_manager_.get());
+    std::vector<std::string_view> args;
+    args.reserve(std::min(chunk_size, keys.size()) + 1);
+    for (size_t first = 0; first < keys.size(); first += chunk_size) {
+        size_t last = std::min(first + chunk_size, keys.size());
+        args.assign(1, "MGET");
+        args.insert(args.end(), keys.begin() + first, keys.begin() + last);
+        batch.add(args);
+    }
+    batch.execute();
+
+    for (size_t chunk = 0; chunk < batch.size(); ++chunk) {
+        const redisReply* reply = batch.reply(chunk);
+        if (reply == nullptr) {
+            throw std::runtime_error("Failed to get counter values from Redis: " + batch.error(chunk));
+        }
+        size_t first = chunk * chunk_size;
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements != std::min(chunk_size, keys.size() - first)) {
+            throw std::runtime_error("Unexpected reply type when getting counter values");
+        }
+        for (size_t i = 0; i < reply->elements; ++i) {
+            values[owners[first + i]] += parseCounterValue(reply->element[i]);
+        }
+    }
+
+    if (flush_lock.owns_lock()) {
+        for (size_t k = 0; k < keys.size(); ++k) {
+            values[owners[k]] += bufferedDelta(std::string(keys[k]));
+        }
+    }
+    return values;
+}
+
+std::vector<long long> CounterService::incrementMany(const std::vector<CounterIncrement>& increments) {
+    std::vector<long long> values;
+    values.reserve(increments.size());
+    if (buffer_) {
+        for (const auto& increment : increments) {
+            values.push_back(bufferedAdd(updateKey(increment.key), increment.amount));
+        }
+        return values;
+    }
+    if (increments.empty()) {
+        return values;
+    }
+
+    BatchExecutor batch(pool_manager_.get());
+    char amount[24];
+    for (const auto& increment : increments) {
+        auto result = std::to_chars(amount, amount + sizeof(amount), increment.amount);
+        if (stripes(increment.key) > 1) {
+            batch.add({"INCRBY", updateKey(increment.key), std::string_view(amount, result.ptr - amount)});
+        } else {
+            batch.add({"INCRBY", increment.key, std::string_view(amount, result.ptr - amount)});
+        }
+    }
+    batch.execute();
+
+    size_t failed = 0;
+    std::string first_error;
+    for (size_t i = 0; i < increments.size(); ++i) {
+        const redisReply* reply = batch.reply(i);
+        if (reply != nullptr && reply->type == REDIS_REPLY_INTEGER) {
+            values.push_back(reply->integer);
+            continue;
+        }
+        values.push_back(0);
+        if (failed++ == 0) {
+            first_error = reply ? "unexpected reply type" : batch.error(i);
+        }
+    }
+    if (failed > 0) {
+        throw std::runtime_error("Failed to increment " + std::to_string(failed) + " of " +
+                                 std::to_string(increments.size()) + " counters in Redis: " + first_error);
+    }
+    return values;
+}
+
+void CounterService::setStripes(const std::string& counter_key, size_t stripes) {
+    if (stripes == 0) {
+        throw std::invalid_argument("Stripe count must be positive");
+    }
+    std::unique_lock<std::shared_mutex> lock(stripes_mutex_);
+    auto it = stripes_.find(counter_key);
+    size_t current = it == stripes_.end() ? 1 : it->second;
+    if (stripes < current) {
+        throw std::invalid_argument("Stripe count of a counter can only be raised");
+    }
+    if (stripes > 1) {
+        stripes_[counter_key] = stripes;
+    }
+}
+
+size_t CounterService::stripes(const std::string& counter_key) const {
+    std::shared_lock<std::shared_mutex> lock(stripes_mutex_);
+    auto it = stripes_.find(counter_key);
+    return it == stripes_.end() ? 1 : it->second;
+}
+
+std::string CounterService::updateKey(const std::string& counter_key) const {
+    size_t count = stripes(counter_key);
+    return count > 1 ? stripeKey(counter_key, threadStripeSeed() % count) : counter_key;
+}
+
+std::vector<std::string> CounterService::storedKeys(const std::string& counter_key) const {
+    size_t count = stripes(counter_key);
+    std::vector<std::string> keys;
+    keys.reserve(count);
+    for (size_t stripe = 0; stripe < count; ++stripe) {
+        keys.push_back(stripeKey(counter_key, stripe));
+    }
+    return keys;
+}
+
+void CounterService::addDistinct(const std::string& hll_key, const std::string& element) {
+    if (buffer_) {
+        bufferDistinct(hll_key, &element, 1);
+        return;
+    }
+    RedisConnectionGuard conn(pool_manager_.get());
+
+    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "PFADD %b %b", hll_key.data(), hll_key.size(),
+                                                  element.data(), element.size());
+    if (!reply || reply->type != REDIS_REPLY_INTEGER) {
+        if (reply) freeReplyObject(reply);
+        throw std::runtime_error("Failed to add element to HyperLogLog in Redis");
+    }
+    freeReplyObject(reply);
+}
+
+void CounterService::addDistinct(const std::string& hll_key, const std::vector<std::string>& elements) {
+    if (elements.empty()) {
+        return;
+    }
+    if (buffer_) {
+        bufferDistinct(hll_key, elements.data(), elements.size());
+        return;
+    }
+    BatchExecutor batch(pool_manager_.get());
+    std::vector<std::string_view> args;
+    for (size_t first = 0; first < elements.size(); first += kPfaddChunkSize) {
+        size_t last = std::min(first + kPfaddChunkSize, elements.size());
+        args.assign({"PFADD", hll_key});
+        args.insert(args.end(), elements.begin() + first, elements.begin() + last);
+        batch.add(args);
+    }
+    batch.execute();
+    if (batch.failures() > 0) {
+        throw std::runtime_error("Failed to add elements to HyperLogLog in Redis");
+    }
+}
+
+long long CounterService::countDistinct(const std::string& hll_key) {
+    return countDistinct(std::vector<std::string>{hll_key});
+}
+
+long long CounterService::countDistinct(const std::vector<std::string>& hll_keys) {
+    if (hll_keys.empty()) {
+        return 0;
+    }
+    BatchExecutor batch(pool_manager_.get());
+    std::vector<std::string_view> args{"PFCOUNT"};
+    args.insert(args.end(), hll_keys.begin(), hll_keys.end());
+    batch.add(args);
+    batch.execute();
+    if (!batch.ok(0)) {
+        throw std::runtime_error("Failed to count HyperLogLog in Redis: " + batch.error(0));
+    }
+    return batch.integer(0);
+}
+
+void CounterService::mergeDistinct(const std::string& destination, const std::vector<std::string>& sources) {
+    BatchExecutor batch(pool_manager_.get());
+    std::vector<std::string_view> args{"PFMERGE", destination};
+    args.insert(args.end(), sources.begin(), sources.end());
+    batch.add(args);
+    batch.execute();
+    if (!batch.ok(0)) {
+        throw std::runtime_error("Failed to merge HyperLogLogs in Redis: " + batch.error(0));
+    }
+}
+
+void CounterService::bufferDistinct(const std::string& hll_key, const std::string* elements, size_t count) {
+    auto& shard = buffer_->shardFor(hll_key);
+    size_t added = 0;
+    {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto& window = shard.distinct[hll_key];
+        for (size_t i = 0; i < count; ++i) {
+            added += window.insert(elements[i]).second ? 1 : 0;
+        }
+    }
+    size_t before = buffer_->updates.fetch_add(added, std::memory_order_relaxed);
+    if (options_.flush_threshold > 0 && before < options_.flush_threshold && before + added >= options_.flush_threshold) {
+        {
+            std::lock_guard<std::mutex> lock(flusher_mutex_);
+            flush_requested_ = true;
+        }
+        flusher_cv_.notify_one();
+    }
+}
+
+void CounterService::flush() {
+    if (!buffer_) {
+        return;
+    }
+    std::unique_lock<std::shared_mutex> flush_lock(flush_mutex_);
+    flushBuffer();
+}
+
+size_t CounterService::bufferedUpdates() const {
+    return buffer_ ? buffer_->updates.load(std::memory_order_relaxed) : 0;
+}
+
+long long CounterService::bufferedAdd(const std::string& counter_key, long long amount) {
+    auto& shard = buffer_->shardFor(counter_key);
+    long long estimate = 0;
+    auto add = [&](BufferedCounter& counter) {
+        estimate = counter.flushed_value.load(std::memory_order_relaxed) +
+                   counter.delta.fetch_add(amount, std::memory_order_relaxed) + amount;
+    };
+    bool added = false;
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.counters.find(counter_key);
+        if (it != shard.counters.end()) {
+            add(*it->second);
+            added = true;
+        }
+    }
+    if (!added) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto& counter = shard.counters[counter_key];
+        if (!counter) {
+            counter = std::make_unique<BufferedCounter>();
+        }
+        add(*counter);
+    }
+
+    if (buffer_->updates.fetch_add(1, std::memory_order_relaxed) + 1 == options_.flush_threshold) {
+        {
+            std::lock_guard<std::mutex> lock(flusher_mutex_);
+            flush_requested_ = true;
+        }
+        flusher_cv_.notify_one();
+    }
+    return estimate;
+}
+
+long long CounterService::bufferedDelta(const std::string& counter_key) const {
+    auto& shard = buffer_->shardFor(counter_key);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.counters.find(counter_key);
+    return it == shard.counters.end() ? 0 : it->second->delta.load(std::memory_order_relaxed);
+}
+
+// Moves every non-zero delta into one pipelined batch of INCRBY commands.
+// The caller holds flush_mutex_ exclusively, which is also what keeps the
+// collected counters from being erased until the batch is done.
+void CounterService::flushBuffer() {
+    struct Pending {
+        const std::string* key;
+        BufferedCounter* counter;
+        long long delta;
+    };
+    std::vector<Pending> pending;
+    std::vector<std::pair<std::string, std::vector<std::string>>> distinct;
+    for (auto& shard : buffer_->shards) {
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        for (auto& [key, window] : shard.distinct) {
+            std::vector<std::string> elements;
+            elements.reserve(window.size());
+            while (!window.empty()) {
+                elements.push_back(std::move(window.extract(window.begin()).value()));
+            }
+            distinct.emplace_back(key, std::move(elements));
+        }
+        shard.distinct.clear();
+        for (auto it = shard.counters.begin(); it != shard.counters.end();) {
+            BufferedCounter& counter = *it->second;
+            long long delta = counter.delta.exchange(0, std::memory_order_relaxed);
+            if (delta != 0) {
+                counter.idle = false;
+                pending.push_back({&it->first, &counter, delta});
+            } else if (counter.idle) {
+                it = shard.counters.erase(it);
+                continue;
+            } else {
+                counter.idle = true;
+            }
+            ++it;
+        }
+    }
+    buffer_->updates.store(0, std::memory_order_relaxed);
+    if (pending.empty() && distinct.empty()) {
+        return;
+    }
+
+    // Failed deltas and elements go back into the buffer for the next flush.
+    auto restore = [this](const Pending& entry) {
+        entry.counter->delta.fetch_add(entry.delta, std::memory_order_relaxed);
+        buffer_->updates.fetch_add(1, std::memory_order_relaxed);
+    };
+    struct PfaddChunk {
+        size_t window;
+        size_t first;
+        size_t count;
+    };
+    std::vector<PfaddChunk> chunks;
+    std::string error;
+    try {
+        BatchExecutor batch(pool_manager_.get());
+        for (const auto& entry : pending) {
+            batch.add({"INCRBY", *entry.key, std::to_string(entry.delta)});
+        }
+        std::vector<std::string_view> args;
+        for (size_t w = 0; w < distinct.size(); ++w) {
+            const auto& elements = distinct[w].second;
+            for (size_t first = 0; first < elements.size(); first += kPfaddChunkSize) {
+                size_t count = std::min(kPfaddChunkSize, elements.size() - first);
+                args.assign({"PFADD", distinct[w].first});
+                args.insert(args.end(), elements.begin() + first, elements.begin() + first + count);
+                batch.add(args);
+                chunks.push_back({w, first, count});
+            }
+        }
+        batch.execute();
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            size_t index = pending.size() + c;
+            if (!batch.ok(index)) {
+                const auto& window = distinct[chunks[c].window];
+                bufferDistinct(window.first, window.second.data() + chunks[c].first, chunks[c].count);
+                if (error.empty()) {
+                    error = batch.error(index);
+                }
+            }
+        }
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const redisReply* reply = batch.reply(i);
+            if (reply && reply->type == REDIS_REPLY_INTEGER) {
+                pending[i].counter->flushed_value.store(reply->integer, std::memory_order_relaxed);
+            } else {
+                restore(pending[i]);
+                if (error.empty()) {
+                    error = batch.ok(i) ? "unexpected reply type" : batch.error(i);
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        // No connection; nothing was sent.
+        for (const auto& entry : pending) {
+            restore(entry);
+        }
+        for (const auto& [key, elements] : distinct) {
+            bufferDistinct(key, elements.data(), elements.size());
+        }
+        throw std::runtime_error(std::string("Failed to flush buffered counters: ") + e.what());
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Failed to flush buffered counters: " + error);
+    }
+}
+
+void CounterService::flusherLoop() {
+    std::unique_lock<std::mutex> lock(flusher_mutex_);
+    while (!stop_flusher_) {
+        flusher_cv_.wait_for(lock, options_.flush_interval, [this]() { return stop_flusher_ || flush_requested_; });
+        if (stop_flusher_) {
+            break;
+        }
+        flush_requested_ = false;
+        lock.unlock();
+        try {
+            flush();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        lock.lock();
+    }
+}
+
+std::future<long long> CounterService::incrementAsync(const std::string& counter_key, long long amount) {
+    return asyncToFuture<long long>([&](AsyncCallback<long long> callback) {
+        incrementAsync(counter_key, amount, std::move(callback));
+    });
+}
+
+void CounterService::incrementAsync(const std::string& counter_key, long long amount,
+                                    AsyncCallback<long long> callback) {
+    integerCommandAsync({"INCRBY", updateKey(counter_key), std::to_string(amount)},
+                        "Failed to increment counter in Redis", std::move(callback));
+}
+
+std::future<long long> CounterService::decrementAsync(const std::string& counter_key, long long amount) {
+    return asyncToFuture<long long>([&](AsyncCallback<long long> callback) {
+        decrementAsync(counter_key, amount, std::move(callback));
+    });
+}
+
+void CounterService::decrementAsync(const std::string& counter_key, long long amount,
+                                    AsyncCallback<long long> callback) {
+    integerCommandAsync({"DECRBY", updateKey(counter_key), std::to_string(amount)},
+                        "Failed to decrement counter in Redis", std::move(callback));
+}
+
+std::future<long long> CounterService::getValueAsync(const std::string& counter_key) {
+    return asyncToFuture<long long>([&](AsyncCallback<long long> callback) {
+        getValueAsync(counter_key, std::move(callback));
+    });
+}
+
+void CounterService::getValueAsync(const std::string& counter_key, AsyncCallback<long long> callback) {
+    if (stripes(counter_key) > 1) {
+        std::vector<std::string> args = storedKeys(counter_key);
+        args.insert(args.begin(), "MGET");
+        asyncEngine().command(args, [callback](const redisReply* reply, std::exception_ptr error) {
+            long long result = 0;
+            if (!error) {
+                try {
+                    if (reply->type != REDIS_REPLY_ARRAY) {
+                        throw std::runtime_error("Unexpected reply type when getting counter value");
+                    }
+                    for (size_t i = 0; i < reply->elements; ++i) {
+                        result += parseCounterValue(reply->element[i]);
+                    }
+                } catch (...) {
+                    error = std::current_exception();
+                }
+            }
+            callback(error ? 0 : result, error);
+        });
+        return;
+    }
+    asyncEngine().command({"GET", counter_key}, [callback](const redisReply* reply, std::exception_ptr error) {
+        long long result = 0;
+        if (!error) {
+            try {
+                result = parseCounterValue(reply);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        callback(error ? 0 : result, error);
+    });
+}
+
+std::future<void> CounterService::deleteCounterAsync(const std::string& counter_key) {
+    return asyncToFuture<void>([&](AsyncCallback<void> callback) {
+        deleteCounterAsync(counter_key, std::move(callback));
+    });
+}
+
+void CounterService::deleteCounterAsync(const std::string& counter_key, AsyncCallback<void> callback) {
+    std::vector<std::string> args = storedKeys(counter_key);
+    args.insert(args.begin(), "DEL");
+    asyncEngine().command(args, [callback](const redisReply*, std::exception_ptr error) {
+        callback(error);
+    });
+}
+
+void CounterService::integerCommandAsync(std::initializer_list<std::string_view> args, const char* error_message,
+                                         AsyncCallback<long long> callback) {
+    asyncEngine().command(args, [callback, error_message](const redisReply* reply, std::exception_ptr error) {
+        if (!error && reply->type != REDIS_REPLY_INTEGER) {
+            error = std::make_exception_ptr(std::runtime_error(error_message));
+        }
+        callback(error ? 0 : reply->integer, error);
+    });
+}
+
+AsyncCommandEngine& CounterService::asyncEngine() {
+    if (!async_engine_) {
+        throw std::runtime_error("CounterService was created without an async engine");
+    }
+    return *async_engine_;
+}
@@ -2,12 +2,53 @@
 #define COUNTER_SERVICE_H
 
 #include <connection_pool_manager/connection_pool_manager.h>
+#include <async_command_engine/async_command_engine.h>
 #include <string>
 #include <memory>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// One update of CounterService::incrementMany().
+struct CounterIncrement {
+    std::string key;
+    long long amount = 1;
+};
+
+struct CounterServiceOptions {
+    // Buffered mode: increment() and decrement() only add to a local delta,
+    // and a background flusher writes the deltas to Redis as one pipelined
+    // batch every flush_interval, or sooner once flush_threshold updates
+    // are buffered (0 flushes on the interval only). Deltas that fail to
+    // flush are kept for the next one; if the connection drops after Redis
+    // applied a delta but before the reply arrived, that delta is applied
+    // twice.
+    bool buffered = false;
+    std::chrono::milliseconds flush_interval{100};
+    size_t flush_threshold = 10000;
+    // Buffered deltas are spread over this many independently locked shards.
+    size_t buffer_shards = 16;
+    // In buffered mode, getValue() adds this service's unflushed delta to the
+    // value in Redis, so callers see their own updates before the flush.
+    bool read_your_writes = true;
+    // Keys per MGET in getValues().
+    size_t mget_chunk_size = 512;
+};
 
 class CounterService {
 public:
-    CounterService(std::shared_ptr<ConnectionPoolManager> pool_manager);
+    // The async engine is optional; without it the *Async operations throw.
+    CounterService(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                   std::shared_ptr<AsyncCommandEngine> async_engine = nullptr,
+                   const CounterServiceOptions& options = CounterServiceOptions());
+    // Flushes whatever is still buffered.
     ~CounterService();
 
     // Deleted copy and move constructors/assignments
@@ -16,13 +57,104 @@ public:
     CounterService(CounterService&&) = delete;
     CounterService& operator=(CounterService&&) = delete;
 
+    // In buffered mode these return an estimate instead of the value Redis
+    // holds: the counter as of its last flush, plus what this service has
+    // buffered since (counted from 0 until the key is first flushed).
     long long increment(const std::string& counter_key, long long amount = 1);
     long long decrement(const std::string& counter_key, long long amount = 1);
     long long getValue(const std::string& counter_key);
+    // Also drops the counter's buffered delta.
     void deleteCounter(const std::string& counter_key);
 
+    // Striped counters spread a hot counter over several keys: the counter
+    // key itself and counter_key + ":stripe:<i>" for i in [1, stripes).
+    // Each thread sends its updates to one randomly chosen stripe, and reads
+    // sum all stripes with one MGET. Every service updating the counter
+    // must use the same stripe count, and the count can only be raised, so
+    // that reads always cover every stripe that was written. Updates of a
+    // striped counter return the new value of the stripe they touched, not
+    // the counter's total.
+    void setStripes(const std::string& counter_key, size_t stripes);
+    size_t stripes(const std::string& counter_key) const; // 1 unless striped
+
+    // Bulk variants. getValues() reads the counters with one MGET per
+    // chunk of keys, all chunks pipelined on one connection, and returns the
+    // values in key order (0 for missing keys and, unlike getValue(),
+    // for keys that hold another type). incrementMany() pipelines
+    // one INCRBY per update and returns the new values in update order; if
+    // some of them fail it throws after the others have been applied.
+    std::vector<long long> getValues(const std::vector<std::string>& counter_keys);
+    std::vector<long long> incrementMany(const std::vector<CounterIncrement>& increments);
+
+    // HyperLogLog counters for approximate distinct counts (about 0.8%
+    // standard error in at most 12 KB per key). addDistinct() sends PFADD
+    // right away or, in buffered mode, collects the elements locally,
+    // deduplicated until the next flush, which sends them as batched PFADDs
+    // in the same pipeline as the counter deltas.
+    void addDistinct(const std::string& hll_key, const std::string& element);
+    void addDistinct(const std::string& hll_key, const std::vector<std::string>& elements);
+    // Estimated number of distinct elements in the union of the given
+    // HyperLogLogs (PFCOUNT). Buffered elements count once flushed.
+    long long countDistinct(const std::string& hll_key);
+    long long countDistinct(const std::vector<std::string>& hll_keys);
+    // Stores the union of the sources in destination (PFMERGE), e.g. to roll
+    // per-shard HyperLogLogs up into one.
+    void mergeDistinct(const std::string& destination, const std::vector<std::string>& sources);
+
+    // Writes all buffered deltas to Redis before returning. Throws
+    // std::runtime_error if some could not be written; those stay buffered.
+    // A no-op unless the service is buffered.
+    void flush();
+    // Updates buffered since the last flush.
+    size_t bufferedUpdates() const;
+    bool buffered() const { return buffer_ != nullptr; }
+    bool hasAsyncEngine() const { return async_engine_ != nullptr; }
+
+    // Non-blocking variants on the async engine. Callbacks run on an engine
+    // event loop thread and must not block. They bypass the write buffer.
+    std::future<long long> incrementAsync(const std::string& counter_key, long long amount = 1);
+    void incrementAsync(const std::string& counter_key, long long amount, AsyncCallback<long long> callback);
+    std::future<long long> decrementAsync(const std::string& counter_key, long long amount = 1);
+    void decrementAsync(const std::string& counter_key, long long amount, AsyncCallback<long long> callback);
+    std::future<long long> getValueAsync(const std::string& counter_key);
+    void getValueAsync(const std::string& counter_key, AsyncCallback<long long> callback);
+    std::future<void> deleteCounterAsync(const std::string& counter_key);
+    void deleteCounterAsync(const std::string& counter_key, AsyncCallback<void> callback);
+
 private:
+    struct WriteBuffer;
+
+    // The key an update of counter_key goes to (its stripe, if striped).
+    std::string updateKey(const std::string& counter_key) const;
+    // Every key holding part of counter_key's value.
+    std::vector<std::string> storedKeys(const std::string& counter_key) const;
+
+    long long bufferedAdd(const std::string& counter_key, long long amount);
+    long long bufferedDelta(const std::string& counter_key) const;
+    void bufferDistinct(const std::string& hll_key, const std::string* elements, size_t count);
+    void flushBuffer();
+    void flusherLoop();
+
+    void integerCommandAsync(std::initializer_list<std::string_view> args, const char* error_message,
+                             AsyncCallback<long long> callback);
+    AsyncCommandEngine& asyncEngine();
+
     std::shared_ptr<ConnectionPoolManager> pool_manager_;
+    std::shared_ptr<AsyncCommandEngine> async_engine_;
+    const CounterServiceOptions options_;
+
+    mutable std::shared_mutex stripes_mutex_;
+    std::unordered_map<std::string, size_t> stripes_; // Striped counters only
+
+    std::unique_ptr<WriteBuffer> buffer_; // Only in buffered mode
+    // Held exclusively while deltas move from the buffer to Redis, so that
+    // read-your-writes reads never see a delta in neither place.
+    std::shared_mutex flush_mutex_;
+    std::mutex flusher_mutex_;
+    std::condition_variable flusher_cv_;
+    bool flush_requested_ = false;
+    bool stop_flusher_ = false;
+    std::thread flusher_thread_;
 };
 
 #endif // COUNTER_SERVICE_H
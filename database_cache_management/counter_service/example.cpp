@@ -36,6 +36,17 @@ int main() {
         counter_service.decrement(page_views_key, 2);
         std::cout << "Page views after 2 decrements: " << counter_service.getValue(page_views_key) << std::endl;
 
+        // Buffered mode for very hot counters: increments stay local and are
+        // written in pipelined batches by a background flusher.
+        CounterServiceOptions buffered_options;
+        buffered_options.buffered = true;
+        CounterService packet_counters(pool_manager, nullptr, buffered_options);
+        for (int i = 0; i < 100000; ++i) {
+            packet_counters.increment("packets:port1");
+        }
+        packet_counters.flush();
+        std::cout << "Packets on port 1: " << counter_service.getValue("packets:port1") << std::endl;
+        packet_counters.deleteCounter("packets:port1");
 
     } catch (const std::exception& e) {
         std::cerr << "An exception occurred: " << e.what() << std::endl;
@@ -0,0 +1,114 @@
+#include "id_allocator.h"
+#include <algorithm>
+#include <stdexcept>
+
+IdAllocator::IdAllocator(std::shared_ptr<CounterService> counter_service, const std::string& counter_key,
+                         const IdAllocatorOptions& options)
+    : counter_service_(counter_service), counter_key_(counter_key), options_(options),
+      block_size_(std::clamp(options.initial_block_size, options.min_block_size, options.max_block_size)) {
+    if (!counter_service_) {
+        throw std::invalid_argument("IdAllocator needs a counter service");
+    }
+    if (counter_service_->buffered() || counter_service_->stripes(counter_key_) > 1) {
+        throw std::invalid_argument("IdAllocator needs an unbuffered service and an unstriped counter");
+    }
+    if (options_.min_block_size == 0 || options_.min_block_size > options_.max_block_size) {
+        throw std::invalid_argument("Invalid ID block size bounds");
+    }
+    // Leaves headroom in the offset bits for threads overrunning a block.
+    if (options_.max_block_size > (kOffsetMask >> 1)) {
+        throw std::invalid_argument("max_block_size is too large");
+    }
+    if (options_.target_block_duration.count() <= 0) {
+        throw std::invalid_argument("target_block_duration must be positive");
+    }
+}
+
+// A prefetch started with std::async is waited for by its future.
+IdAllocator::~IdAllocator() = default;
+
+long long IdAllocator::next() {
+    while (true) {
+        uint64_t state = state_.fetch_add(1, std::memory_order_acq_rel);
+        uint64_t generation = state >> kOffsetBits;
+        uint64_t offset = state & kOffsetMask;
+
+        const Slot& slot = slots_[generation & 1];
+        uint64_t published = slot.generation.load(std::memory_order_acquire);
+        long long first = slot.first.load(std::memory_order_relaxed);
+        uint64_t size = slot.size.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        bool unchanged = slot.generation.load(std::memory_order_relaxed) == published;
+
+        if (published == generation && unchanged && offset < size) {
+            return first + static_cast<long long>(offset);
+        }
+        // The block is used up, or this thread fell so far behind that its
+        // slot was reused; either way the claimed offset is dropped.
+        advance(generation);
+    }
+}
+
+// Moves from the given generation to the next block, unless another thread
+// already did.
+void IdAllocator::advance(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(advance_mutex_);
+    if ((state_.load(std::memory_order_acquire) >> kOffsetBits) != generation) {
+        return;
+    }
+
+    size_t size;
+    long long last;
+    if (prefetch_.valid()) {
+        size = prefetch_size_;
+        last = prefetch_.get(); // Waits if the prefetch is still in flight
+    } else {
+        // First block, or the prefetch failed.
+        size = block_size_.load(std::memory_order_relaxed);
+        blocks_reserved_.fetch_add(1, std::memory_order_relaxed);
+        last = counter_service_->increment(counter_key_, static_cast<long long>(size));
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (generation > 0) {
+        adaptBlockSize(now);
+    }
+    block_started_ = now;
+    current_size_ = size;
+
+    uint64_t next_generation = generation + 1;
+    Slot& slot = slots_[next_generation & 1];
+    slot.generation.store(kNoGeneration, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.first.store(last - static_cast<long long>(size) + 1, std::memory_order_relaxed);
+    slot.size.store(size, std::memory_order_relaxed);
+    slot.generation.store(next_generation, std::memory_order_release);
+    state_.store(next_generation << kOffsetBits, std::memory_order_release);
+
+    prefetch();
+}
+
+void IdAllocator::prefetch() {
+    prefetch_size_ = block_size_.load(std::memory_order_relaxed);
+    blocks_reserved_.fetch_add(1, std::memory_order_relaxed);
+    long long amount = static_cast<long long>(prefetch_size_);
+    if (counter_service_->hasAsyncEngine()) {
+        prefetch_ = counter_service_->incrementAsync(counter_key_, amount);
+    } else {
+        prefetch_ = std::async(std::launch::async, [service = counter_service_, key = counter_key_, amount]() {
+            return service->increment(key, amount);
+        });
+    }
+}
+
+// Sizes the next blocks to last about target_block_duration at the rate the
+// block just used up was drawn, changing by at most 4x per block.
+void IdAllocator::adaptBlockSize(std::chrono::steady_clock::time_point now) {
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - block_started_).count();
+    double rate = static_cast<double>(current_size_) / std::max<long long>(elapsed, 1); // IDs per microsecond
+    double target = std::chrono::duration_cast<std::chrono::microseconds>(options_.target_block_duration).count();
+    double desired = std::clamp(rate * target, current_size_ / 4.0, current_size_ * 4.0);
+    size_t size = static_cast<size_t>(std::clamp(desired, static_cast<double>(options_.min_block_size),
+                                                 static_cast<double>(options_.max_block_size)));
+    block_size_.store(size, std::memory_order_relaxed);
+}
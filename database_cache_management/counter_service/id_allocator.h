@@ -0,0 +1,95 @@
+#ifndef ID_ALLOCATOR_H
+#define ID_ALLOCATOR_H
+
+#include "counter_service.h"
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+struct IdAllocatorOptions {
+    // Block size bounds. Each block is reserved with one INCRBY and is sized
+    // to last about target_block_duration at the recently observed rate.
+    size_t min_block_size = 16;
+    size_t max_block_size = 1 << 20;
+    size_t initial_block_size = 64;
+    std::chrono::milliseconds target_block_duration{1000};
+};
+
+// Unique ID generator on a CounterService counter.
+//
+// Instead of one INCRBY per ID, the allocator reserves a block of IDs with
+// INCRBY <block size> and hands them out locally: next() is one atomic
+// increment as long as the current block lasts. As soon as a block is
+// taken into use the next one is reserved in the background (through the
+// counter's async engine if it has one), so a thread only waits for Redis
+// when IDs are drawn faster than a block can be fetched.
+//
+// IDs are unique across every allocator and increment() caller on the same
+// counter, but not contiguous: IDs left in the current and the prefetched
+// block are never handed out once the allocator is destroyed.
+class IdAllocator {
+public:
+    // The counter service must be unbuffered and the counter unstriped,
+    // since the allocator needs the exact value INCRBY returns.
+    IdAllocator(std::shared_ptr<CounterService> counter_service, const std::string& counter_key,
+                const IdAllocatorOptions& options = IdAllocatorOptions());
+    ~IdAllocator();
+
+    // Deleted copy and move constructors/assignments
+    IdAllocator(const IdAllocator&) = delete;
+    IdAllocator& operator=(const IdAllocator&) = delete;
+    IdAllocator(IdAllocator&&) = delete;
+    IdAllocator& operator=(IdAllocator&&) = delete;
+
+    // Returns a new ID. Throws std::runtime_error if a block is needed and
+    // cannot be reserved.
+    long long next();
+
+    // Size the next reserved block will have.
+    size_t blockSize() const { return block_size_.load(std::memory_order_relaxed); }
+    // Blocks reserved so far, including a prefetch in progress.
+    uint64_t blocksReserved() const { return blocks_reserved_.load(std::memory_order_relaxed); }
+
+private:
+    // A reserved block, published seqlock-style: readers check that the
+    // generation is unchanged around reading first and size.
+    struct Slot {
+        std::atomic<uint64_t> generation{kNoGeneration};
+        std::atomic<long long> first{0};
+        std::atomic<uint64_t> size{0};
+    };
+
+    static constexpr uint64_t kNoGeneration = ~uint64_t(0);
+    static constexpr int kOffsetBits = 32;
+    static constexpr uint64_t kOffsetMask = (uint64_t(1) << kOffsetBits) - 1;
+
+    void advance(uint64_t generation);
+    void prefetch();
+    void adaptBlockSize(std::chrono::steady_clock::time_point now);
+
+    std::shared_ptr<CounterService> counter_service_;
+    const std::string counter_key_;
+    const IdAllocatorOptions options_;
+
+    // Generation of the current block in the high bits, next offset in it
+    // in the low bits; next() claims an ID with one fetch_add.
+    std::atomic<uint64_t> state_{0};
+    // Block of generation g lives in slots_[g % 2]. Generation 0 is empty,
+    // so the first next() reserves the first block.
+    Slot slots_[2];
+
+    std::mutex advance_mutex_; // Guards everything below
+    std::future<long long> prefetch_;
+    size_t prefetch_size_ = 0;
+    std::chrono::steady_clock::time_point block_started_;
+    size_t current_size_ = 0;
+    std::atomic<size_t> block_size_;
+    std::atomic<uint64_t> blocks_reserved_{0};
+};
+
+#endif // ID_ALLOCATOR_H
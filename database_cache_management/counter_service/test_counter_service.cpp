@@ -1,11 +1,16 @@
 #include "counter_service.h"
+#include "id_allocator.h"
 #include <connection_pool_manager/connection_pool_manager.h>
+#include <connection_pool_manager/redis_connection_guard.h>
 #include <gtest/gtest.h>
 #include <vector>
 #include <string>
 #include <thread>
 #include <hiredis/hiredis.h>
 #include <numeric>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
 
 class CounterServiceTest : public ::testing::Test {
 protected:
@@ -63,3 +68,289 @@ TEST_F(CounterServiceTest, ThreadSafety) {
 
     EXPECT_EQ(counter.getValue(counter_key), num_threads * increments_per_thread);
 }
+
+TEST_F(CounterServiceTest, AsyncOperations) {
+    auto engine = std::make_shared<AsyncCommandEngine>(std::vector<std::string>{"127.0.0.1"});
+    CounterService counter(pool_manager, engine);
+
+    EXPECT_EQ(counter.getValueAsync(counter_key).get(), 0);
+
+    // Many increments in flight at once, with no thread per request.
+    std::vector<std::future<long long>> results;
+    for (int i = 0; i < 1000; ++i) {
+        results.push_back(counter.incrementAsync(counter_key));
+    }
+    long long sum = 0;
+    for (auto& result : results) {
+        sum += result.get();
+    }
+    EXPECT_EQ(sum, 1000LL * 1001 / 2);
+    EXPECT_EQ(counter.decrementAsync(counter_key, 10).get(), 990);
+
+    std::promise<long long> value;
+    counter.getValueAsync(counter_key, [&](long long result, std::exception_ptr error) {
+        if (error) {
+            value.set_exception(error);
+        } else {
+            value.set_value(result);
+        }
+    });
+    EXPECT_EQ(value.get_future().get(), 990);
+
+    counter.deleteCounterAsync(counter_key).get();
+    EXPECT_EQ(counter.getValue(counter_key), 0);
+
+    // Single, bulk and async reads reject a value that is not an integer alike.
+    {
+        RedisConnectionGuard conn(pool_manager.get());
+        freeReplyObject(redisCommand(conn.getContext(), "SET %s 12abc", counter_key.c_str()));
+    }
+    EXPECT_THROW(counter.getValue(counter_key), std::runtime_error);
+    EXPECT_THROW(counter.getValues({counter_key}), std::runtime_error);
+    EXPECT_THROW(counter.getValueAsync(counter_key).get(), std::runtime_error);
+    counter.deleteCounter(counter_key);
+
+    // Without an engine the async operations are unavailable.
+    CounterService sync_only(pool_manager);
+    EXPECT_THROW(sync_only.incrementAsync(counter_key), std::runtime_error);
+}
+
+TEST_F(CounterServiceTest, BufferedIncrementsAreWriteCombined) {
+    CounterServiceOptions options;
+    options.buffered = true;
+    options.flush_interval = std::chrono::milliseconds(60000); // Only explicit flushes
+    options.flush_threshold = 0;
+    CounterService buffered(pool_manager, nullptr, options);
+    CounterService direct(pool_manager);
+
+    const int num_threads = 8;
+    const int increments_per_thread = 10000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < increments_per_thread; ++j) {
+                buffered.increment(counter_key);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    buffered.decrement(counter_key, 5);
+
+    // Nothing reached Redis yet, but the buffered service reads its writes.
+    const long long expected = num_threads * increments_per_thread - 5;
+    EXPECT_EQ(direct.getValue(counter_key), 0);
+    EXPECT_EQ(buffered.getValue(counter_key), expected);
+    EXPECT_EQ(buffered.bufferedUpdates(), static_cast<size_t>(num_threads * increments_per_thread + 1));
+
+    buffered.flush();
+    EXPECT_EQ(direct.getValue(counter_key), expected);
+    EXPECT_EQ(buffered.getValue(counter_key), expected);
+    EXPECT_EQ(buffered.bufferedUpdates(), 0u);
+    EXPECT_EQ(buffered.increment(counter_key), expected + 1);
+
+    // Deleting drops the buffered delta along with the key.
+    buffered.deleteCounter(counter_key);
+    buffered.flush();
+    EXPECT_EQ(direct.getValue(counter_key), 0);
+}
+
+TEST_F(CounterServiceTest, BufferedFlushOnThresholdAndShutdown) {
+    CounterServiceOptions options;
+    options.buffered = true;
+    options.flush_interval = std::chrono::milliseconds(60000);
+    options.flush_threshold = 100;
+    CounterService direct(pool_manager);
+    {
+        CounterService buffered(pool_manager, nullptr, options);
+        for (int i = 0; i < 100; ++i) {
+            buffered.increment(counter_key);
+        }
+        // The threshold wakes the background flusher.
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (direct.getValue(counter_key) != 100 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        EXPECT_EQ(direct.getValue(counter_key), 100);
+
+        buffered.increment(counter_key, 7);
+    }
+    // The destructor flushed the rest.
+    EXPECT_EQ(direct.getValue(counter_key), 107);
+
+    options.buffer_shards = 0;
+    EXPECT_THROW(CounterService(pool_manager, nullptr, options), std::invalid_argument);
+}
+
+TEST_F(CounterServiceTest, BulkReadAndIncrement) {
+    CounterServiceOptions options;
+    options.mget_chunk_size = 64; // Several MGET chunks
+    CounterService counter(pool_manager, nullptr, options);
+
+    std::vector<std::string> keys;
+    std::vector<CounterIncrement> increments;
+    for (int i = 0; i < 300; ++i) {
+        keys.push_back("test_bulk_counter:" + std::to_string(i));
+        increments.push_back({keys.back(), i});
+    }
+    for (const auto& key : keys) {
+        counter.deleteCounter(key);
+    }
+
+    std::vector<long long> values = counter.getValues(keys);
+    EXPECT_EQ(values, std::vector<long long>(keys.size(), 0));
+
+    values = counter.incrementMany(increments);
+    for (int i = 0; i < 300; ++i) {
+        EXPECT_EQ(values[i], i);
+    }
+    counter.incrementMany({{keys[0], 5}, {keys[1], -1}});
+
+    values = counter.getValues(keys);
+    ASSERT_EQ(values.size(), keys.size());
+    EXPECT_EQ(values[0], 5);
+    EXPECT_EQ(values[1], 0);
+    EXPECT_EQ(values[299], 299);
+    EXPECT_TRUE(counter.getValues({}).empty());
+
+    // A failing update does not stop the others.
+    {
+        counter.deleteCounter(keys[2]);
+        RedisConnectionGuard conn(pool_manager.get());
+        freeReplyObject(redisCommand(conn.getContext(), "HSET %s f v", keys[2].c_str()));
+    }
+    EXPECT_THROW(counter.incrementMany({{keys[2], 1}, {keys[3], 10}}), std::runtime_error);
+    EXPECT_EQ(counter.getValue(keys[3]), 13);
+    // MGET reports keys of other types as missing.
+    EXPECT_EQ(counter.getValues({keys[2]}), std::vector<long long>{0});
+
+    for (const auto& key : keys) {
+        counter.deleteCounter(key);
+    }
+}
+
+TEST_F(CounterServiceTest, StripedCounters) {
+    CounterService counter(pool_manager);
+    counter.increment(counter_key, 100); // Existing value stays in stripe 0
+    counter.setStripes(counter_key, 8);
+    EXPECT_EQ(counter.stripes(counter_key), 8u);
+
+    const int num_threads = 16;
+    const int increments_per_thread = 50;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < increments_per_thread; ++j) {
+                counter.increment(counter_key);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    counter.decrement(counter_key, 10);
+
+    const long long expected = 100 + num_threads * increments_per_thread - 10;
+    EXPECT_EQ(counter.getValue(counter_key), expected);
+    EXPECT_EQ(counter.getValues({"test_plain_counter", counter_key}), (std::vector<long long>{0, expected}));
+
+    // The updates were spread over more than one stripe.
+    CounterService unstriped(pool_manager);
+    EXPECT_LT(unstriped.getValue(counter_key), expected);
+
+    EXPECT_THROW(counter.setStripes(counter_key, 4), std::invalid_argument);
+    EXPECT_THROW(counter.setStripes(counter_key, 0), std::invalid_argument);
+
+    counter.deleteCounter(counter_key);
+    EXPECT_EQ(counter.getValue(counter_key), 0);
+}
+
+TEST_F(CounterServiceTest, IdAllocatorHandsOutUniqueIds) {
+    auto service = std::make_shared<CounterService>(pool_manager);
+    IdAllocatorOptions options;
+    options.initial_block_size = 16;
+    options.min_block_size = 16;
+    options.target_block_duration = std::chrono::milliseconds(50);
+    IdAllocator allocator(service, counter_key, options);
+
+    const int num_threads = 8;
+    const int ids_per_thread = 20000;
+    std::vector<std::vector<long long>> ids(num_threads);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back([&, i]() {
+            ids[i].reserve(ids_per_thread);
+            for (int j = 0; j < ids_per_thread; ++j) {
+                ids[i].push_back(allocator.next());
+            }
+        });
+    }
+    // IDs from plain increments never collide with the allocator's.
+    std::vector<long long> direct;
+    for (int j = 0; j < 100; ++j) {
+        direct.push_back(service->increment(counter_key));
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::vector<long long> all = direct;
+    for (const auto& thread_ids : ids) {
+        all.insert(all.end(), thread_ids.begin(), thread_ids.end());
+    }
+    std::sort(all.begin(), all.end());
+    EXPECT_EQ(std::adjacent_find(all.begin(), all.end()), all.end());
+    EXPECT_GT(all.front(), 0);
+    EXPECT_LE(all.back(), service->getValue(counter_key));
+
+    // Far fewer round-trips than IDs, and blocks grew with the demand.
+    EXPECT_LT(allocator.blocksReserved(), static_cast<uint64_t>(num_threads * ids_per_thread / 16));
+    EXPECT_GT(allocator.blockSize(), 16u);
+
+    CounterServiceOptions buffered_options;
+    buffered_options.buffered = true;
+    auto buffered = std::make_shared<CounterService>(pool_manager, nullptr, buffered_options);
+    EXPECT_THROW(IdAllocator(buffered, counter_key), std::invalid_argument);
+}
+
+TEST_F(CounterServiceTest, HyperLogLogDistinctCounts) {
+    CounterService direct(pool_manager);
+    const std::vector<std::string> shards = {"test_hll:shard0", "test_hll:shard1", "test_hll:total"};
+    for (const auto& key : shards) {
+        direct.deleteCounter(key);
+    }
+
+    CounterServiceOptions options;
+    options.buffered = true;
+    options.flush_interval = std::chrono::milliseconds(60000);
+    options.flush_threshold = 0;
+    CounterService buffered(pool_manager, nullptr, options);
+
+    // 2000 distinct MACs per shard, each seen many times, 500 on both shards.
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 2000; ++i) {
+            buffered.addDistinct(shards[0], "mac:" + std::to_string(i));
+            buffered.addDistinct(shards[1], "mac:" + std::to_string(i + 1500));
+        }
+    }
+    // Duplicates within a flush window are dropped locally.
+    EXPECT_EQ(buffered.bufferedUpdates(), 4000u);
+    EXPECT_EQ(buffered.countDistinct(shards[0]), 0);
+
+    buffered.flush();
+    auto near = [](long long estimate, double exact) { return std::abs(estimate - exact) < exact * 0.05; };
+    EXPECT_TRUE(near(buffered.countDistinct(shards[0]), 2000));
+    EXPECT_TRUE(near(buffered.countDistinct({shards[0], shards[1]}), 3500));
+
+    direct.mergeDistinct(shards[2], {shards[0], shards[1]});
+    EXPECT_TRUE(near(direct.countDistinct(shards[2]), 3500));
+
+    // Unbuffered adds go straight to Redis.
+    direct.addDistinct(shards[2], std::vector<std::string>{"new:1", "new:2", "new:3"});
+    EXPECT_TRUE(near(direct.countDistinct(shards[2]), 3503));
+
+    for (const auto& key : shards) {
+        direct.deleteCounter(key);
+    }
+}
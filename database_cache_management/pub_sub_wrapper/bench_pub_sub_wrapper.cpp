@@ -0,0 +1,157 @@
+#include <pub_sub_wrapper/pub_sub_wrapper.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <ctime>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Subscriber throughput benchmark for PubSubWrapper.
+// Make sure Redis is running on localhost:6379.
+//
+// Usage: pub_sub_wrapper_bench [messages] [publishers] [dispatch_threads]
+// Publishers in a child process flood the subscribed channels with
+// pipelined PUBLISH batches. The rate is measured from the first publish
+// until the callbacks have seen every message, for exact-channel and for
+// pattern subscriptions, together with the subscriber's own CPU time per
+// message (the publishers do not count towards it).
+
+namespace {
+
+const size_t kBatchSize = 1000;
+
+struct Result {
+    double messages_per_second = 0;
+    double cpu_ns_per_message = 0;
+};
+
+double processCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void publishAll(const std::vector<std::string>& names, long long messages, int publishers) {
+    auto pool = std::make_shared<ConnectionPoolManager>(std::vector<std::string>{"127.0.0.1"}, publishers);
+    PubSubWrapper<int> pub_sub(pool);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < publishers; ++t) {
+        threads.emplace_back([&, t]() {
+            std::vector<std::pair<std::string, int>> batch;
+            for (long long i = t; i < messages; i += publishers) {
+                batch.emplace_back(names[i % names.size()], static_cast<int>(i));
+                if (batch.size() == kBatchSize) {
+                    pub_sub.publishBatch(batch);
+                    batch.clear();
+                }
+            }
+            if (!batch.empty()) {
+                pub_sub.publishBatch(batch);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+Result run(bool patterns, int channels, long long messages, int publishers, int dispatch_threads) {
+    std::vector<std::string> names;
+    for (int c = 0; c < channels; ++c) {
+        names.push_back("bench_channel:" + std::to_string(c) + (patterns ? ":update" : ""));
+    }
+
+    // Forked before any thread exists; the child publishes once told to.
+    int go[2];
+    if (pipe(go) != 0) {
+        throw std::runtime_error("Failed to create pipe");
+    }
+    pid_t child = fork();
+    if (child < 0) {
+        throw std::runtime_error("Failed to fork the publisher process");
+    }
+    if (child == 0) {
+        close(go[1]);
+        char byte;
+        int status = 1;
+        if (read(go[0], &byte, 1) == 1) {
+            try {
+                publishAll(names, messages, publishers);
+                status = 0;
+            } catch (const std::exception& e) {
+                std::cerr << "Publisher failed: " << e.what() << std::endl;
+            }
+        }
+        _exit(status);
+    }
+    close(go[0]);
+
+    auto pool = std::make_shared<ConnectionPoolManager>(std::vector<std::string>{"127.0.0.1"}, 1);
+    PubSubOptions options;
+    options.dispatch_threads = dispatch_threads;
+    PubSubWrapper<int> pub_sub(pool, options);
+
+    std::atomic<long long> received{0};
+    for (int c = 0; c < channels; ++c) {
+        if (patterns) {
+            pub_sub.psubscribe("bench_channel:" + std::to_string(c) + ":*", [&](const std::string&, const int&) {
+                received.fetch_add(1, std::memory_order_relaxed);
+            }).get();
+        } else {
+            pub_sub.subscribe(names[c], [&](const int&) { received.fetch_add(1, std::memory_order_relaxed); }).get();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    double cpu_start = processCpuSeconds();
+    if (write(go[1], "g", 1) != 1) {
+        throw std::runtime_error("Failed to start the publisher process");
+    }
+    close(go[1]);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (received.load(std::memory_order_relaxed) < messages && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu_seconds = processCpuSeconds() - cpu_start;
+    int status = 0;
+    waitpid(child, &status, 0);
+    long long count = received.load();
+    if (count < messages) {
+        std::cerr << "Only " << count << " of " << messages << " messages arrived" << std::endl;
+    }
+    Result result;
+    result.messages_per_second = count / seconds;
+    result.cpu_ns_per_message = count > 0 ? cpu_seconds * 1e9 / count : 0;
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    const long long messages = argc > 1 ? std::stoll(argv[1]) : 500000;
+    const int publishers = argc > 2 ? std::stoi(argv[2]) : 4;
+    const int dispatch_threads = argc > 3 ? std::stoi(argv[3]) : 2;
+
+    try {
+        std::cout << messages << " messages, " << publishers << " publishers, " << dispatch_threads
+                  << " dispatch threads" << std::endl;
+        std::cout << "mode\tchannels\tmsgs/sec\tsubscriber ns/msg" << std::endl;
+        for (bool patterns : {false, true}) {
+            for (int channels : {1, 100, 1000}) {
+                Result result = run(patterns, channels, messages, publishers, dispatch_threads);
+                std::cout << (patterns ? "pattern" : "channel") << "\t" << channels << "\t"
+                          << static_cast<long long>(result.messages_per_second) << "\t"
+                          << static_cast<long long>(result.cpu_ns_per_message) << std::endl;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "An exception occurred: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,250 @@
+#ifndef DISPATCH_QUEUE_H
+#define DISPATCH_QUEUE_H
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <iostream>
+#include <stdexcept>
+#include <cstdint>
+#include <cstddef>
+
+// What DispatchQueue::push() does when the key's queue is full.
+enum class BackpressurePolicy {
+    Block,         // Wait for room; the producer stops reading meanwhile
+    DropOldest,    // Discard the oldest queued task
+    CoalesceLatest // Replace a queued task with the same coalescing key; block if there is none
+};
+
+struct DispatchStats {
+    size_t queue_depth = 0;     // Tasks queued right now
+    size_t max_queue_depth = 0; // Highest depth seen
+    uint64_t enqueued = 0;
+    uint64_t dispatched = 0;
+    uint64_t dropped = 0;   // DropOldest
+    uint64_t coalesced = 0; // CoalesceLatest replacements
+    uint64_t blocked = 0;   // Pushes that had to wait for room
+};
+
+// Bounded multi-worker task queue with per-key ordering.
+//
+// Every key is served by one worker (key modulo the worker count), so
+// tasks pushed under the same key run one at a time and in push order,
+// while a slow task only delays the keys sharing its worker. Each worker
+// owns an equal share of the capacity. Workers are only signalled when
+// they sleep, so a busy worker drains a burst without a wake-up per task.
+class DispatchQueue {
+public:
+    DispatchQueue(size_t threads, size_t capacity, BackpressurePolicy policy)
+        : policy_(policy), capacity_per_worker_(threads > 0 ? (capacity + threads - 1) / threads : 0) {
+        if (threads == 0 || capacity == 0) {
+            throw std::invalid_argument("DispatchQueue needs at least one thread and a positive capacity");
+        }
+        workers_.reserve(threads);
+        for (size_t i = 0; i < threads; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (auto& worker : workers_) {
+            worker->thread = std::thread(&DispatchQueue::workerLoop, this, worker.get());
+        }
+    }
+
+    // Tasks still queued are discarded.
+    ~DispatchQueue() {
+        for (auto& worker : workers_) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            worker->stop = true;
+        }
+        for (auto& worker : workers_) {
+            worker->not_empty.notify_all();
+            worker->not_full.notify_all();
+            worker->thread.join();
+        }
+    }
+
+    // Deleted copy and move constructors/assignments
+    DispatchQueue(const DispatchQueue&) = delete;
+    DispatchQueue& operator=(const DispatchQueue&) = delete;
+    DispatchQueue(DispatchQueue&&) = delete;
+    DispatchQueue& operator=(DispatchQueue&&) = delete;
+
+    void push(uint64_t key, std::function<void()> task) {
+        push(key, key, std::move(task));
+    }
+
+    // Under CoalesceLatest, a task only replaces a queued one with the same
+    // key and coalesce_key, so tasks sharing a key (and its ordering) can
+    // still keep their latest states apart, e.g. per channel of a pattern.
+    void push(uint64_t key, uint64_t coalesce_key, std::function<void()> task) {
+        Worker& worker = workerFor(key);
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        if (policy_ == BackpressurePolicy::CoalesceLatest) {
+            auto latest = worker.latest.find({key, coalesce_key});
+            if (latest != worker.latest.end()) {
+                worker.queue[latest->second - worker.head_sequence].run = std::move(task);
+                coalesced_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        if (worker.queue.size() >= capacity_per_worker_) {
+            if (policy_ == BackpressurePolicy::DropOldest) {
+                popFront(worker);
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                blocked_.fetch_add(1, std::memory_order_relaxed);
+                ++worker.full_waiters;
+                worker.not_full.wait(lock, [&] { return worker.stop || worker.queue.size() < capacity_per_worker_; });
+                --worker.full_waiters;
+                if (worker.stop) {
+                    return;
+                }
+            }
+        }
+        if (policy_ == BackpressurePolicy::CoalesceLatest) {
+            worker.latest[{key, coalesce_key}] = worker.head_sequence + worker.queue.size();
+        }
+        worker.queue.push_back(Task{key, coalesce_key, std::move(task)});
+        enqueued_.fetch_add(1, std::memory_order_relaxed);
+        size_t depth = depth_.fetch_add(1, std::memory_order_relaxed) + 1;
+        size_t max_depth = max_depth_.load(std::memory_order_relaxed);
+        while (depth > max_depth && !max_depth_.compare_exchange_weak(max_depth, depth, std::memory_order_relaxed)) {
+        }
+        bool wake = worker.sleeping;
+        lock.unlock();
+        if (wake) {
+            worker.not_empty.notify_one();
+        }
+    }
+
+    // Waits until no task of the key is running, unless called from the
+    // key's own worker.
+    void quiesce(uint64_t key) {
+        Worker& worker = workerFor(key);
+        if (std::this_thread::get_id() == worker.thread.get_id()) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock(worker.mutex);
+        ++worker.quiesce_waiters;
+        worker.idle.wait(lock, [&] { return !worker.running || worker.running_key != key; });
+        --worker.quiesce_waiters;
+    }
+
+    DispatchStats stats() const {
+        DispatchStats stats;
+        stats.queue_depth = depth_.load(std::memory_order_relaxed);
+        stats.max_queue_depth = max_depth_.load(std::memory_order_relaxed);
+        stats.enqueued = enqueued_.load(std::memory_order_relaxed);
+        stats.dispatched = dispatched_.load(std::memory_order_relaxed);
+        stats.dropped = dropped_.load(std::memory_order_relaxed);
+        stats.coalesced = coalesced_.load(std::memory_order_relaxed);
+        stats.blocked = blocked_.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    struct Task {
+        uint64_t key;
+        uint64_t coalesce_key;
+        std::function<void()> run;
+    };
+
+    using CoalesceSlot = std::pair<uint64_t, uint64_t>; // Key and coalesce_key
+
+    struct CoalesceSlotHash {
+        size_t operator()(const CoalesceSlot& slot) const {
+            return std::hash<uint64_t>()(slot.first * 0x9e3779b97f4a7c15ULL ^ slot.second);
+        }
+    };
+
+    struct alignas(64) Worker {
+        std::mutex mutex; // Guards everything below but thread
+        std::condition_variable not_empty;
+        std::condition_variable not_full;
+        std::condition_variable idle;
+        std::deque<Task> queue;
+        uint64_t head_sequence = 0; // Sequence number of queue.front()
+        // CoalesceLatest: sequence number of each slot's queued task.
+        std::unordered_map<CoalesceSlot, uint64_t, CoalesceSlotHash> latest;
+        uint64_t running_key = 0;
+        bool running = false;
+        bool sleeping = false;
+        int full_waiters = 0;
+        int quiesce_waiters = 0;
+        bool stop = false;
+        std::thread thread;
+    };
+
+    Worker& workerFor(uint64_t key) { return *workers_[key % workers_.size()]; }
+
+    // Called with the worker's mutex held.
+    void popFront(Worker& worker) {
+        if (policy_ == BackpressurePolicy::CoalesceLatest) {
+            const Task& front = worker.queue.front();
+            auto it = worker.latest.find({front.key, front.coalesce_key});
+            if (it != worker.latest.end() && it->second == worker.head_sequence) {
+                worker.latest.erase(it);
+            }
+        }
+        worker.queue.pop_front();
+        ++worker.head_sequence;
+        depth_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void workerLoop(Worker* worker) {
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        while (true) {
+            while (!worker->stop && worker->queue.empty()) {
+                worker->sleeping = true;
+                worker->not_empty.wait(lock);
+                worker->sleeping = false;
+            }
+            if (worker->stop) {
+                break;
+            }
+            std::function<void()> run = std::move(worker->queue.front().run);
+            worker->running_key = worker->queue.front().key;
+            worker->running = true;
+            popFront(*worker);
+            bool room = worker->full_waiters > 0;
+            lock.unlock();
+            if (room) {
+                worker->not_full.notify_one();
+            }
+
+            try {
+                run();
+            } catch (const std::exception& e) {
+                std::cerr << "Error in dispatched task: " << e.what() << std::endl;
+            }
+            run = nullptr; // Drop the task's captures outside the lock
+            dispatched_.fetch_add(1, std::memory_order_relaxed);
+
+            lock.lock();
+            worker->running = false;
+            if (worker->quiesce_waiters > 0) {
+                worker->idle.notify_all();
+            }
+        }
+    }
+
+    const BackpressurePolicy policy_;
+    const size_t capacity_per_worker_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    std::atomic<size_t> depth_{0};
+    std::atomic<size_t> max_depth_{0};
+    std::atomic<uint64_t> enqueued_{0};
+    std::atomic<uint64_t> dispatched_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> blocked_{0};
+};
+
+#endif // DISPATCH_QUEUE_H
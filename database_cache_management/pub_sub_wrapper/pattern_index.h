@@ -0,0 +1,317 @@
+#ifndef PATTERN_INDEX_H
+#define PATTERN_INDEX_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <cstddef>
+
+// Routing index of Redis glob patterns (PSUBSCRIBE syntax: *, ?, [...]
+// and backslash escapes).
+//
+// Patterns are stored in a trie under their literal prefix, the part before
+// the first special character. Prefix patterns ("PORT_TABLE:*") sit on
+// their node directly; anything else is kept in its node's glob list and
+// matched with globMatch() as a fallback. A prefix pattern covers every
+// pattern whose literal prefix starts with its own, so only the patterns
+// no prefix pattern covers (roots()) need a Redis subscription. A pmessage
+// received through one of them is routed with match(), which walks the
+// channel down the trie once and finds every covered pattern it matches.
+template<typename V>
+class PatternIndex {
+public:
+    // Returns false if the pattern is already registered.
+    bool insert(const std::string& pattern, V value) {
+        Node* node = &root_;
+        size_t literal = literalPrefixLength(pattern);
+        for (size_t i = 0; i < literal; ++i) {
+            auto& child = node->children[pattern[i]];
+            if (!child) {
+                child = std::make_unique<Node>();
+            }
+            node = child.get();
+        }
+        if (isPrefixPattern(pattern)) {
+            if (node->prefix) {
+                return false;
+            }
+            node->prefix.emplace(std::move(value));
+        } else {
+            for (const auto& glob : node->globs) {
+                if (glob.first == pattern) {
+                    return false;
+                }
+            }
+            node->globs.emplace_back(pattern, std::move(value));
+        }
+        ++size_;
+        return true;
+    }
+
+    bool erase(const std::string& pattern) {
+        if (!eraseFrom(root_, pattern, 0, literalPrefixLength(pattern))) {
+            return false;
+        }
+        --size_;
+        return true;
+    }
+
+    V* find(const std::string& pattern) {
+        Node* node = nodeOf(pattern);
+        if (!node) {
+            return nullptr;
+        }
+        if (isPrefixPattern(pattern)) {
+            return node->prefix ? &*node->prefix : nullptr;
+        }
+        for (auto& glob : node->globs) {
+            if (glob.first == pattern) {
+                return &glob.second;
+            }
+        }
+        return nullptr;
+    }
+
+    const V* find(const std::string& pattern) const { return const_cast<PatternIndex*>(this)->find(pattern); }
+
+    size_t size() const { return size_; }
+
+    // The root whose Redis subscription delivers the pattern's messages:
+    // the shortest prefix pattern covering it, or the pattern itself.
+    std::string coverOf(const std::string& pattern) const {
+        const Node* node = &root_;
+        size_t literal = literalPrefixLength(pattern);
+        for (size_t depth = 0; node; ++depth) {
+            if (node->prefix) {
+                return pattern.substr(0, depth) + "*";
+            }
+            if (depth == literal) {
+                break;
+            }
+            auto it = node->children.find(pattern[depth]);
+            node = it == node->children.end() ? nullptr : it->second.get();
+        }
+        return pattern;
+    }
+
+    // Patterns that need a Redis subscription.
+    std::vector<std::string> roots() const {
+        std::vector<std::string> roots;
+        std::string path;
+        collectRoots(root_, path, roots);
+        return roots;
+    }
+
+    // Calls visit(value) for every pattern that is delivered through the
+    // Redis subscription `via` and matches the channel. Allocation-free, so
+    // it can run per message.
+    template<typename F>
+    void match(std::string_view via, std::string_view channel, F&& visit) const {
+        const Node* node = nodeOf(via);
+        if (!node) {
+            return;
+        }
+        if (!isPrefixPattern(via)) {
+            for (const auto& glob : node->globs) {
+                if (glob.first == via && globMatch(via, channel)) {
+                    visit(glob.second);
+                }
+            }
+            return;
+        }
+
+        size_t depth = via.size() - 1;
+        if (channel.substr(0, depth) != via.substr(0, depth)) {
+            return;
+        }
+        while (node) {
+            if (node->prefix) {
+                visit(*node->prefix);
+            }
+            for (const auto& glob : node->globs) {
+                if (globMatch(glob.first, channel)) {
+                    visit(glob.second);
+                }
+            }
+            if (depth == channel.size()) {
+                break;
+            }
+            auto it = node->children.find(channel[depth++]);
+            node = it == node->children.end() ? nullptr : it->second.get();
+        }
+    }
+
+    // Calls visit(pattern, value) for every registered pattern.
+    template<typename F>
+    void forEach(F&& visit) {
+        std::string path;
+        forEachIn(root_, path, visit);
+    }
+
+    // "<literal>*" with nothing special in the literal part.
+    static bool isPrefixPattern(std::string_view pattern) {
+        return !pattern.empty() && literalPrefixLength(pattern) == pattern.size() - 1 && pattern.back() == '*';
+    }
+
+    static size_t literalPrefixLength(std::string_view pattern) {
+        size_t length = pattern.find_first_of("*?[\\");
+        return length == std::string_view::npos ? pattern.size() : length;
+    }
+
+    // Redis glob matching (same rules as the server's stringmatchlen).
+    static bool globMatch(std::string_view pattern, std::string_view text) {
+        return globMatch(pattern.data(), pattern.size(), text.data(), text.size());
+    }
+
+    static bool globMatch(const char* pattern, size_t pattern_length, const char* text, size_t text_length) {
+        size_t p = 0;
+        size_t t = 0;
+        while (p < pattern_length && t < text_length) {
+            switch (pattern[p]) {
+            case '*':
+                while (p + 1 < pattern_length && pattern[p + 1] == '*') {
+                    ++p;
+                }
+                if (p + 1 == pattern_length) {
+                    return true;
+                }
+                for (; t < text_length; ++t) {
+                    if (globMatch(pattern + p + 1, pattern_length - p - 1, text + t, text_length - t)) {
+                        return true;
+                    }
+                }
+                return false;
+            case '?':
+                ++t;
+                break;
+            case '[': {
+                ++p;
+                bool negate = p < pattern_length && pattern[p] == '^';
+                if (negate) {
+                    ++p;
+                }
+                bool matched = false;
+                while (p < pattern_length && pattern[p] != ']') {
+                    if (pattern[p] == '\\' && p + 1 < pattern_length) {
+                        ++p;
+                        matched |= pattern[p] == text[t];
+                    } else if (p + 2 < pattern_length && pattern[p + 1] == '-') {
+                        char low = std::min(pattern[p], pattern[p + 2]);
+                        char high = std::max(pattern[p], pattern[p + 2]);
+                        matched |= text[t] >= low && text[t] <= high;
+                        p += 2;
+                    } else {
+                        matched |= pattern[p] == text[t];
+                    }
+                    ++p;
+                }
+                if (matched == negate) {
+                    return false;
+                }
+                ++t;
+                break;
+            }
+            case '\\':
+                if (p + 1 < pattern_length) {
+                    ++p;
+                }
+                [[fallthrough]];
+            default:
+                if (pattern[p] != text[t]) {
+                    return false;
+                }
+                ++t;
+                break;
+            }
+            ++p;
+        }
+        while (p < pattern_length && pattern[p] == '*') {
+            ++p;
+        }
+        return p == pattern_length && t == text_length;
+    }
+
+private:
+    struct Node {
+        std::unordered_map<char, std::unique_ptr<Node>> children;
+        std::optional<V> prefix;                      // The pattern "<path>*"
+        std::vector<std::pair<std::string, V>> globs; // Other patterns with literal prefix <path>
+
+        bool empty() const { return children.empty() && !prefix && globs.empty(); }
+    };
+
+    Node* nodeOf(std::string_view pattern) const {
+        const Node* node = &root_;
+        size_t literal = literalPrefixLength(pattern);
+        for (size_t i = 0; i < literal && node; ++i) {
+            auto it = node->children.find(pattern[i]);
+            node = it == node->children.end() ? nullptr : it->second.get();
+        }
+        return const_cast<Node*>(node);
+    }
+
+    bool eraseFrom(Node& node, const std::string& pattern, size_t depth, size_t literal) {
+        if (depth < literal) {
+            auto it = node.children.find(pattern[depth]);
+            if (it == node.children.end() || !eraseFrom(*it->second, pattern, depth + 1, literal)) {
+                return false;
+            }
+            if (it->second->empty()) {
+                node.children.erase(it);
+            }
+            return true;
+        }
+        if (isPrefixPattern(pattern)) {
+            bool found = node.prefix.has_value();
+            node.prefix.reset();
+            return found;
+        }
+        for (auto it = node.globs.begin(); it != node.globs.end(); ++it) {
+            if (it->first == pattern) {
+                node.globs.erase(it);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    template<typename F>
+    void forEachIn(Node& node, std::string& path, F& visit) {
+        if (node.prefix) {
+            visit(path + "*", *node.prefix);
+        }
+        for (auto& glob : node.globs) {
+            visit(glob.first, glob.second);
+        }
+        for (auto& [c, child] : node.children) {
+            path.push_back(c);
+            forEachIn(*child, path, visit);
+            path.pop_back();
+        }
+    }
+
+    void collectRoots(const Node& node, std::string& path, std::vector<std::string>& roots) const {
+        if (node.prefix) {
+            roots.push_back(path + "*"); // Covers everything below
+            return;
+        }
+        for (const auto& glob : node.globs) {
+            roots.push_back(glob.first);
+        }
+        for (const auto& [c, child] : node.children) {
+            path.push_back(c);
+            collectRoots(*child, path, roots);
+            path.pop_back();
+        }
+    }
+
+    Node root_;
+    size_t size_ = 0;
+};
+
+#endif // PATTERN_INDEX_H
@@ -7,173 +7,916 @@
 #include <nlohmann/json.hpp>
 #include <connection_pool_manager/connection_pool_manager.h>
 #include <connection_pool_manager/redis_connection_guard.h>
+#include <connection_pool_manager/batch_executor.h>
+#include "dispatch_queue.h"
+#include "serializers.h"
+#include "pattern_index.h"
 #include <hiredis/hiredis.h>
 #include <iostream>
 #include <future>
-#include <random>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstring>
+#include <cerrno>
+#include <string_view>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 using json = nlohmann::json;
 
-template<typename T>
+struct PubSubOptions {
+    // Subscriptions are spread over this many dedicated connections (by
+    // channel hash), opened outside the command pool and all served by one
+    // reader thread.
+    int subscriber_connections = 1;
+    // Delay between attempts to reopen a lost subscriber connection. Its
+    // channels are subscribed again once it is back.
+    std::chrono::milliseconds reconnect_interval{1000};
+    // Callbacks run on dispatch_threads workers, not on the reader. Each
+    // channel is served by one worker, so its messages are handled in
+    // order, and a slow callback only holds up the channels sharing its
+    // worker.
+    int dispatch_threads = 2;
+    // Messages waiting for their callbacks, split evenly over the workers.
+    // When a worker's share is full, backpressure_policy decides;
+    // CoalesceLatest keeps the latest message of each channel, also for
+    // pattern callbacks.
+    size_t dispatch_queue_capacity = 10000;
+    BackpressurePolicy backpressure_policy = BackpressurePolicy::Block;
+    // Background publisher for publishAsync() and publishAcknowledged():
+    // queued messages are sent in pipelined PUBLISH bursts of up to
+    // publish_batch_size on one pooled connection, so a burst of messages
+    // costs a round-trip per batch rather than per message. Publishing
+    // blocks while publish_queue_capacity messages are waiting.
+    bool background_publisher = false;
+    size_t publish_batch_size = 512;
+    size_t publish_queue_capacity = 100000;
+};
+
+struct PublisherStats {
+    size_t queued = 0;      // Waiting for the background publisher
+    uint64_t published = 0; // Acknowledged by Redis
+    uint64_t failed = 0;
+    uint64_t bursts = 0;    // Pipelined batches sent
+};
+
+// Typed Redis pub/sub.
+//
+// Publishing borrows a connection from the pool per message. Subscribing
+// does not touch the pool: every channel is multiplexed onto a few
+// dedicated subscriber connections, and a single reader thread sends
+// SUBSCRIBE/UNSUBSCRIBE as channels come and go and routes each incoming
+// message to its channel's callback. The routing tables belong to the
+// reader and only change through the control requests it processes, so
+// routing a message takes no lock and copies nothing: the reply itself is
+// handed to the callback's worker and decoded from hiredis' buffer. The
+// reader only hands messages to a bounded dispatch queue, so slow
+// callbacks do not stop it from draining the sockets (unless the Block
+// policy applies backpressure).
+//
+// Pattern subscriptions go through a PatternIndex: Redis is only asked to
+// PSUBSCRIBE the patterns no registered prefix pattern covers, and each
+// pmessage is routed locally to every handler whose pattern matches its
+// channel. While that cover changes (a covering prefix pattern is added or
+// removed), a message may reach a pattern handler twice.
+//
+// Messages are encoded by the Serializer policy (see serializers.h) and sent
+// binary-safe.
+template<typename T, typename Serializer = JsonSerializer>
 class PubSubWrapper {
 public:
-    PubSubWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager);
+    PubSubWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                  const PubSubOptions& options = PubSubOptions());
     ~PubSubWrapper();
 
+    // Deleted copy and move constructors/assignments
+    PubSubWrapper(const PubSubWrapper&) = delete;
+    PubSubWrapper& operator=(const PubSubWrapper&) = delete;
+    PubSubWrapper(PubSubWrapper&&) = delete;
+    PubSubWrapper& operator=(PubSubWrapper&&) = delete;
+
+    // The future is ready once Redis has confirmed the subscription.
+    // Subscribing to a channel that is already subscribed keeps the
+    // existing callback.
     std::future<void> subscribe(const std::string& channel, std::function<void(const T&)> callback);
     void publish(const std::string& channel, const T& message);
+    // Publishes (channel, message) pairs pipelined on one connection and
+    // returns each message's receiver count, in order. Throws
+    // std::runtime_error if any of them failed.
+    std::vector<long long> publishBatch(const std::vector<std::pair<std::string, T>>& messages);
+
+    // Background publisher; these throw std::logic_error unless
+    // PubSubOptions::background_publisher is set. publishAsync() is
+    // fire-and-forget (failures are logged and counted), the future of
+    // publishAcknowledged() carries the receiver count or the error.
+    void publishAsync(const std::string& channel, const T& message);
+    std::future<long long> publishAcknowledged(const std::string& channel, const T& message);
+    // Waits until every message queued so far has been sent.
+    void flushPublishes();
+    PublisherStats publisherStats() const;
+    // The channel's callback is not called anymore once this returns (when
+    // called from one of the channel's callbacks, once that returns).
     void unsubscribe(const std::string& channel);
 
+    // Glob pattern subscriptions (PSUBSCRIBE syntax); callbacks also get
+    // the channel. The future is ready once the pattern's messages are
+    // being received. Subscribing to a registered pattern keeps the
+    // existing callback; punsubscribe() behaves like unsubscribe().
+    std::future<void> psubscribe(const std::string& pattern,
+                                 std::function<void(const std::string& channel, const T&)> callback);
+    void punsubscribe(const std::string& pattern);
+
+    size_t subscriptionCount() const;
+    size_t patternCount() const;
+    DispatchStats dispatchStats() const { return m_dispatch->stats(); }
+
 private:
-    void listener_thread(const std::string& channel, ConnectionPoolManager* pool_manager, std::shared_ptr<std::promise<void>> promise);
+    // Shared with queued messages, which are skipped once it is inactive.
+    // The id is the route's dispatch key.
+    struct Route {
+        Route(const std::string& channel, uint64_t id, std::function<void(const T&)> callback)
+            : channel(channel), id(id), callback(std::move(callback)) {}
+        const std::string channel;
+        const uint64_t id;
+        const std::function<void(const T&)> callback;
+        std::atomic<bool> active{true};
+    };
+
+    struct Subscription {
+        std::shared_ptr<Route> route;
+        size_t connection = 0;
+        std::vector<std::promise<void>> waiters; // subscribe() calls waiting for confirmation
+    };
+
+    struct PatternRoute {
+        PatternRoute(const std::string& pattern, uint64_t id,
+                     std::function<void(const std::string&, const T&)> callback)
+            : pattern(pattern), id(id), callback(std::move(callback)) {}
+        const std::string pattern;
+        const uint64_t id;
+        const std::function<void(const std::string&, const T&)> callback;
+        std::atomic<bool> active{true};
+    };
+
+    struct PatternSubscription {
+        std::shared_ptr<PatternRoute> route;
+        std::vector<std::promise<void>> waiters; // psubscribe() calls waiting for confirmation
+    };
+
+    struct QueuedPublish {
+        std::string channel;
+        std::string payload;
+        std::shared_ptr<std::promise<long long>> ack; // nullptr for fire-and-forget
+    };
+
+    enum class ControlOp { Subscribe, Unsubscribe, PatternSubscribe, PatternUnsubscribe };
+
+    struct ControlRequest {
+        ControlOp op;
+        std::shared_ptr<Route> route;                // Subscribe, Unsubscribe
+        std::shared_ptr<PatternRoute> pattern_route; // PatternSubscribe, PatternUnsubscribe
+        size_t connection = 0;
+    };
+
+    // Frees the reply once the reader and every queued delivery are done.
+    using ReplyPtr = std::shared_ptr<redisReply>;
+
+    // Reader thread only.
+    struct SubscriberConnection {
+        redisContext* context = nullptr;
+        std::chrono::steady_clock::time_point next_attempt{};
+        // Channels subscribed on this connection, and whether Redis has
+        // confirmed them yet.
+        std::unordered_map<std::string, bool> channels;
+        std::unordered_map<std::string, bool> patterns; // Likewise, for PSUBSCRIBE
+    };
+
+    void listenerThread();
+    void processControl();
+    void connect(size_t index);
+    void closeConnection(size_t index);
+    bool readReplies(size_t index);
+    void handleReply(size_t index, const ReplyPtr& reply);
+    void confirm(const std::string& channel);
+    void syncPatterns();
+    void confirmPatterns();
+    void dispatchPattern(const ReplyPtr& reply);
+    static void deliverPattern(const PatternRoute& route, const redisReply& reply);
+    void dispatch(const ReplyPtr& reply);
+    static void deliver(const Route& route, const redisReply& payload);
+    bool sendCommand(size_t index, const char* command, const std::string& channel);
+    void wake();
+    void signalReader();
+    static std::string encode(const T& message) { return Serializer::template encode<T>(message); }
+    void enqueuePublish(QueuedPublish publish);
+    void publisherThread();
+    void sendBurst(std::vector<QueuedPublish>& burst);
 
     std::shared_ptr<ConnectionPoolManager> m_pool_manager;
-    std::map<std::string, std::thread> m_listener_threads;
-    std::map<std::string, bool> m_listening;
-    std::map<std::string, std::function<void(const T&)>> m_callbacks;
-    std::mutex m_mutex;
-    std::string m_quit_message;
+    const PubSubOptions m_options;
+
+    mutable std::mutex m_mutex; // Guards the subscription registry and m_control
+    std::unordered_map<std::string, Subscription> m_subscriptions;
+    std::unordered_map<std::string, PatternSubscription> m_patterns;
+    std::vector<ControlRequest> m_control;
+    uint64_t m_next_route_id = 0;
+
+    std::optional<DispatchQueue> m_dispatch; // Reset before the connections close
+
+    // Reader thread only; the keys view Route::channel.
+    std::unordered_map<std::string_view, std::shared_ptr<Route>> m_channel_routes;
+    PatternIndex<std::shared_ptr<PatternRoute>> m_pattern_routes;
+
+    std::vector<SubscriberConnection> m_connections;
+    int m_wake_fd = -1; // eventfd; wakes the reader for control requests and shutdown
+    std::atomic<bool> m_wake_pending{false}; // A wake-up is on its way; later ones are redundant
+    std::atomic<bool> m_stop{false};
+    std::thread m_listener;
+
+    mutable std::mutex m_publish_mutex; // Guards the publisher state below
+    std::condition_variable m_publish_ready;
+    std::condition_variable m_publish_space; // Room in the queue, or the publisher went idle
+    std::deque<QueuedPublish> m_publish_queue;
+    bool m_publish_busy = false; // A burst is being sent
+    bool m_publish_stop = false;
+    uint64_t m_published = 0;
+    uint64_t m_publish_failed = 0;
+    uint64_t m_publish_bursts = 0;
+    std::thread m_publisher;
 };
 
-template<typename T>
-PubSubWrapper<T>::PubSubWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager)
-    : m_pool_manager(pool_manager) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> distrib(0, 255);
-    for (int i = 0; i < 16; ++i) {
-        m_quit_message += std::to_string(distrib(gen));
+template<typename T, typename Serializer>
+PubSubWrapper<T, Serializer>::PubSubWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager, const PubSubOptions& options)
+    : m_pool_manager(pool_manager), m_options(options),
+      m_dispatch(std::in_place, std::max(options.dispatch_threads, 1), options.dispatch_queue_capacity,
+                 options.backpressure_policy) {
+    if (!m_pool_manager) {
+        throw std::invalid_argument("PubSubWrapper needs a connection pool");
+    }
+    if (m_options.subscriber_connections <= 0 || m_options.dispatch_threads <= 0) {
+        throw std::invalid_argument("subscriber_connections and dispatch_threads must be positive");
+    }
+    if (m_options.background_publisher && (m_options.publish_batch_size == 0 || m_options.publish_queue_capacity == 0)) {
+        throw std::invalid_argument("publish_batch_size and publish_queue_capacity must be positive");
+    }
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake_fd < 0) {
+        throw std::runtime_error("Failed to create subscriber wake-up eventfd");
+    }
+    m_connections.resize(m_options.subscriber_connections);
+    for (size_t i = 0; i < m_connections.size(); ++i) {
+        connect(i);
+    }
+    m_listener = std::thread(&PubSubWrapper<T, Serializer>::listenerThread, this);
+    if (m_options.background_publisher) {
+        m_publisher = std::thread(&PubSubWrapper<T, Serializer>::publisherThread, this);
     }
 }
 
-template<typename T>
-PubSubWrapper<T>::~PubSubWrapper() {
-    std::vector<std::string> channels;
+template<typename T, typename Serializer>
+PubSubWrapper<T, Serializer>::~PubSubWrapper() {
+    // Messages still queued for the background publisher are sent first.
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        for (auto const& [channel, thread] : m_listener_threads) {
-            channels.push_back(channel);
-        }
+        std::lock_guard<std::mutex> lock(m_publish_mutex);
+        m_publish_stop = true;
     }
-    for (const auto& channel : channels) {
-        unsubscribe(channel);
+    m_publish_ready.notify_all();
+    if (m_publisher.joinable()) {
+        m_publisher.join();
     }
-}
 
-#include <future>
+    m_stop = true;
+    signalReader(); // Not coalesced: the reader may be past its m_stop check
 
-template<typename T>
-std::future<void> PubSubWrapper<T>::subscribe(const std::string& channel, std::function<void(const T&)> callback) {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_listening.find(channel) != m_listening.end()) {
-        auto promise = std::make_shared<std::promise<void>>();
-        promise->set_value();
-        return promise->get_future();
+    if (m_listener.joinable()) {
+        m_listener.join();
     }
+    // Callbacks may still subscribe or unsubscribe, which needs the
+    // connections and the eventfd, until the dispatch workers are joined.
+    m_dispatch.reset();
+    // Closing the connections drops their subscriptions in Redis.
+    for (size_t i = 0; i < m_connections.size(); ++i) {
+        closeConnection(i);
+    }
+    close(m_wake_fd);
+}
 
-    m_listening[channel] = true;
-    m_callbacks[channel] = callback;
-
-    auto promise = std::make_shared<std::promise<void>>();
-    m_listener_threads[channel] = std::thread(&PubSubWrapper<T>::listener_thread, this, channel, m_pool_manager.get(), promise);
-    return promise->get_future();
+template<typename T, typename Serializer>
+std::future<void> PubSubWrapper<T, Serializer>::subscribe(const std::string& channel, std::function<void(const T&)> callback) {
+    std::promise<void> promise;
+    std::future<void> future = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto [it, inserted] = m_subscriptions.try_emplace(channel);
+        if (!inserted) {
+            if (it->second.waiters.empty()) {
+                promise.set_value(); // Already confirmed
+            } else {
+                it->second.waiters.push_back(std::move(promise));
+            }
+            return future;
+        }
+        it->second.route = std::make_shared<Route>(channel, m_next_route_id++, std::move(callback));
+        it->second.connection = std::hash<std::string>()(channel) % m_connections.size();
+        it->second.waiters.push_back(std::move(promise));
+        m_control.push_back({ControlOp::Subscribe, it->second.route, nullptr, it->second.connection});
+    }
+    wake();
+    return future;
 }
 
-template<typename T>
-void PubSubWrapper<T>::publish(const std::string& channel, const T& message) {
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::publish(const std::string& channel, const T& message) {
     RedisConnectionGuard guard(m_pool_manager.get());
-    json j = message;
-    std::string message_str = j.dump();
-    redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "PUBLISH %s %s", channel.c_str(), message_str.c_str());
+    std::string message_str = encode(message);
+    redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "PUBLISH %b %b", channel.data(), channel.size(),
+                                                  message_str.data(), message_str.size());
     if (reply == nullptr) {
         throw std::runtime_error("Failed to publish message");
     }
     freeReplyObject(reply);
 }
 
-template<typename T>
-void PubSubWrapper<T>::unsubscribe(const std::string& channel) {
-    std::thread thread_to_join;
+template<typename T, typename Serializer>
+std::vector<long long> PubSubWrapper<T, Serializer>::publishBatch(const std::vector<std::pair<std::string, T>>& messages) {
+    std::vector<long long> receivers;
+    if (messages.empty()) {
+        return receivers;
+    }
+    BatchExecutor batch(m_pool_manager.get());
+    for (const auto& [channel, message] : messages) {
+        std::string payload = encode(message);
+        batch.add({"PUBLISH", channel, payload});
+    }
+    batch.execute();
+    if (batch.failures() > 0) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!batch.ok(i)) {
+                throw std::runtime_error("Failed to publish " + std::to_string(batch.failures()) + " of " +
+                                         std::to_string(batch.size()) + " messages: " + batch.error(i));
+            }
+        }
+    }
+    receivers.reserve(messages.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        receivers.push_back(batch.integer(i));
+    }
+    return receivers;
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::publishAsync(const std::string& channel, const T& message) {
+    enqueuePublish({channel, encode(message), nullptr});
+}
+
+template<typename T, typename Serializer>
+std::future<long long> PubSubWrapper<T, Serializer>::publishAcknowledged(const std::string& channel, const T& message) {
+    auto ack = std::make_shared<std::promise<long long>>();
+    std::future<long long> future = ack->get_future();
+    enqueuePublish({channel, encode(message), std::move(ack)});
+    return future;
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::enqueuePublish(QueuedPublish publish) {
+    if (!m_options.background_publisher) {
+        throw std::logic_error("The background publisher is not enabled");
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_publish_mutex);
+        m_publish_space.wait(lock, [&] { return m_publish_queue.size() < m_options.publish_queue_capacity; });
+        m_publish_queue.push_back(std::move(publish));
+    }
+    m_publish_ready.notify_one();
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::flushPublishes() {
+    std::unique_lock<std::mutex> lock(m_publish_mutex);
+    m_publish_space.wait(lock, [&] { return m_publish_queue.empty() && !m_publish_busy; });
+}
+
+template<typename T, typename Serializer>
+PublisherStats PubSubWrapper<T, Serializer>::publisherStats() const {
+    std::lock_guard<std::mutex> lock(m_publish_mutex);
+    PublisherStats stats;
+    stats.queued = m_publish_queue.size();
+    stats.published = m_published;
+    stats.failed = m_publish_failed;
+    stats.bursts = m_publish_bursts;
+    return stats;
+}
+
+// Sends whatever accumulated while the previous burst was in flight, so
+// bursts grow with the publishing rate.
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::publisherThread() {
+    std::vector<QueuedPublish> burst;
+    std::unique_lock<std::mutex> lock(m_publish_mutex);
+    while (true) {
+        m_publish_ready.wait(lock, [&] { return m_publish_stop || !m_publish_queue.empty(); });
+        if (m_publish_queue.empty()) {
+            break; // Stopping, and everything has been sent
+        }
+        size_t count = std::min(m_publish_queue.size(), m_options.publish_batch_size);
+        burst.assign(std::make_move_iterator(m_publish_queue.begin()),
+                     std::make_move_iterator(m_publish_queue.begin() + count));
+        m_publish_queue.erase(m_publish_queue.begin(), m_publish_queue.begin() + count);
+        m_publish_busy = true;
+        lock.unlock();
+        m_publish_space.notify_all();
+
+        sendBurst(burst);
+
+        lock.lock();
+        m_publish_busy = false;
+        m_publish_space.notify_all();
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::sendBurst(std::vector<QueuedPublish>& burst) {
+    uint64_t published = 0;
+    size_t handled = 0;
+    try {
+        BatchExecutor batch(m_pool_manager.get());
+        for (const auto& publish : burst) {
+            batch.add({"PUBLISH", publish.channel, publish.payload});
+        }
+        batch.execute();
+        for (; handled < burst.size(); ++handled) {
+            QueuedPublish& publish = burst[handled];
+            if (batch.ok(handled)) {
+                ++published;
+                if (publish.ack) {
+                    publish.ack->set_value(batch.integer(handled));
+                }
+            } else if (publish.ack) {
+                publish.ack->set_exception(std::make_exception_ptr(std::runtime_error(batch.error(handled))));
+            }
+        }
+        if (published < burst.size()) {
+            std::cerr << "Failed to publish " << burst.size() - published << " of " << burst.size()
+                      << " messages" << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to publish a batch of " << burst.size() << " messages: " << e.what() << std::endl;
+        for (; handled < burst.size(); ++handled) {
+            if (burst[handled].ack) {
+                burst[handled].ack->set_exception(std::current_exception());
+            }
+        }
+    }
+    std::lock_guard<std::mutex> lock(m_publish_mutex);
+    m_published += published;
+    m_publish_failed += burst.size() - published;
+    ++m_publish_bursts;
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::unsubscribe(const std::string& channel) {
+    uint64_t route_id;
     {
         std::lock_guard<std::mutex> lock(m_mutex);
-        auto it = m_listening.find(channel);
-        if (it == m_listening.end() || !it->second) {
+        auto it = m_subscriptions.find(channel);
+        if (it == m_subscriptions.end()) {
             return;
         }
-        it->second = false;
+        // Pending subscribe() futures are released; nothing will arrive.
+        for (auto& waiter : it->second.waiters) {
+            waiter.set_value();
+        }
+        it->second.route->active = false;
+        route_id = it->second.route->id;
+        m_control.push_back({ControlOp::Unsubscribe, it->second.route, nullptr, it->second.connection});
+        m_subscriptions.erase(it);
+    }
+    wake();
+    // Messages still queued are skipped; wait for one being handled.
+    m_dispatch->quiesce(route_id);
+}
 
-        RedisConnectionGuard guard(m_pool_manager.get());
-        redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "PUBLISH %s %s", channel.c_str(), m_quit_message.c_str());
-        freeReplyObject(reply);
+template<typename T, typename Serializer>
+size_t PubSubWrapper<T, Serializer>::subscriptionCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_subscriptions.size();
+}
 
-        auto thread_it = m_listener_threads.find(channel);
-        if (thread_it != m_listener_threads.end()) {
-            thread_to_join = std::move(thread_it->second);
-            m_listener_threads.erase(thread_it);
+template<typename T, typename Serializer>
+std::future<void> PubSubWrapper<T, Serializer>::psubscribe(
+    const std::string& pattern, std::function<void(const std::string& channel, const T&)> callback) {
+    std::promise<void> promise;
+    std::future<void> future = promise.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto [it, inserted] = m_patterns.try_emplace(pattern);
+        if (!inserted) {
+            if (it->second.waiters.empty()) {
+                promise.set_value(); // Already confirmed
+            } else {
+                it->second.waiters.push_back(std::move(promise));
+            }
+            return future;
         }
-        m_callbacks.erase(channel);
-        m_listening.erase(channel);
+        it->second.route = std::make_shared<PatternRoute>(pattern, m_next_route_id++, std::move(callback));
+        it->second.waiters.push_back(std::move(promise));
+        m_control.push_back({ControlOp::PatternSubscribe, nullptr, it->second.route, 0});
     }
+    wake();
+    return future;
+}
 
-    if (thread_to_join.joinable()) {
-        thread_to_join.join();
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::punsubscribe(const std::string& pattern) {
+    uint64_t route_id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_patterns.find(pattern);
+        if (it == m_patterns.end()) {
+            return;
+        }
+        for (auto& waiter : it->second.waiters) {
+            waiter.set_value();
+        }
+        it->second.route->active = false;
+        route_id = it->second.route->id;
+        m_control.push_back({ControlOp::PatternUnsubscribe, nullptr, it->second.route, 0});
+        m_patterns.erase(it);
     }
+    wake();
+    m_dispatch->quiesce(route_id);
 }
 
-template<typename T>
-void PubSubWrapper<T>::listener_thread(const std::string& channel, ConnectionPoolManager* pool_manager, std::shared_ptr<std::promise<void>> promise) {
-    RedisConnectionGuard guard(pool_manager);
-    redisContext* context = guard.getContext();
+template<typename T, typename Serializer>
+size_t PubSubWrapper<T, Serializer>::patternCount() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_patterns.size();
+}
 
-    redisReply* reply = (redisReply*)redisCommand(context, "SUBSCRIBE %s", channel.c_str());
-    freeReplyObject(reply);
-    promise->set_value();
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::wake() {
+    // The reader clears the flag before it takes the control queue, so a
+    // request queued while it is set is still picked up.
+    if (!m_wake_pending.exchange(true, std::memory_order_acq_rel)) {
+        signalReader();
+    }
+}
 
-    while (true) {
-        bool listening;
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            auto it = m_listening.find(channel);
-            if (it == m_listening.end()) {
-                break;
-            }
-            listening = it->second;
-        }
-        if (!listening) break;
-
-        if (redisGetReply(context, (void**)&reply) == REDIS_OK) {
-            if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 3) {
-                if (strcmp(reply->element[0]->str, "message") == 0) {
-                    if (strcmp(reply->element[2]->str, m_quit_message.c_str()) == 0) {
-                        break;
-                    }
-                    try {
-                        T message = json::parse(reply->element[2]->str);
-                        std::function<void(const T&)> callback;
-                        {
-                            std::lock_guard<std::mutex> lock(m_mutex);
-                            auto it = m_callbacks.find(channel);
-                            if (it != m_callbacks.end()) {
-                                callback = it->second;
-                            }
-                        }
-                        if (callback) {
-                            callback(message);
-                        }
-                    } catch (const std::exception& e) {
-                        std::cerr << "Error parsing message: " << e.what() << std::endl;
-                    }
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::signalReader() {
+    uint64_t one = 1;
+    // EAGAIN means the counter is saturated, which is a pending wake-up too.
+    if (write(m_wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+        std::cerr << "Failed to wake the subscriber thread: " << strerror(errno) << std::endl;
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::listenerThread() {
+    std::vector<pollfd> fds;
+    std::vector<size_t> polled; // Connection index of fds[i + 1]
+    while (!m_stop) {
+        m_wake_pending.exchange(false, std::memory_order_acq_rel);
+        processControl();
+
+        auto now = std::chrono::steady_clock::now();
+        fds.assign(1, pollfd{m_wake_fd, POLLIN, 0});
+        polled.clear();
+        int timeout_ms = -1;
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+            SubscriberConnection& connection = m_connections[i];
+            if (!connection.context && now >= connection.next_attempt) {
+                connect(i);
+            }
+            if (connection.context) {
+                fds.push_back(pollfd{connection.context->fd, POLLIN, 0});
+                polled.push_back(i);
+            } else {
+                auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(connection.next_attempt - now);
+                int wait_ms = static_cast<int>(std::max<long long>(wait.count(), 0));
+                timeout_ms = timeout_ms < 0 ? wait_ms : std::min(timeout_ms, wait_ms);
+            }
+        }
+
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+            if (errno != EINTR) {
+                std::cerr << "Subscriber poll failed: " << strerror(errno) << std::endl;
+            }
+            continue;
+        }
+        if (fds[0].revents) {
+            uint64_t count;
+            if (read(m_wake_fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+                std::cerr << "Failed to read the subscriber wake-up eventfd: " << strerror(errno) << std::endl;
+            }
+        }
+        for (size_t i = 0; i < polled.size(); ++i) {
+            if (fds[i + 1].revents && !readReplies(polled[i])) {
+                std::cerr << "Redis connection error in subscriber connection " << polled[i] << std::endl;
+                closeConnection(polled[i]);
+            }
+        }
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::processControl() {
+    std::vector<ControlRequest> requests;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        requests.swap(m_control);
+    }
+    bool patterns_changed = false;
+    for (auto& request : requests) {
+        SubscriberConnection& connection = m_connections[request.connection];
+        if (request.op == ControlOp::Subscribe) {
+            const std::string& channel = request.route->channel;
+            m_channel_routes.erase(channel); // The key must view the new route's channel
+            m_channel_routes.emplace(channel, request.route);
+            auto it = connection.channels.find(channel);
+            if (it == connection.channels.end()) {
+                connection.channels.emplace(channel, false);
+                if (connection.context) {
+                    sendCommand(request.connection, "SUBSCRIBE", channel);
                 }
+            } else if (it->second) {
+                confirm(channel);
+            }
+        } else if (request.op == ControlOp::Unsubscribe) {
+            const std::string& channel = request.route->channel;
+            auto it = m_channel_routes.find(channel);
+            if (it == m_channel_routes.end() || it->second != request.route) {
+                continue; // Subscribed again in the meantime
             }
-            freeReplyObject(reply);
+            m_channel_routes.erase(it);
+            if (connection.channels.erase(channel) > 0 && connection.context) {
+                sendCommand(request.connection, "UNSUBSCRIBE", channel);
+            }
+        } else if (request.op == ControlOp::PatternSubscribe) {
+            m_pattern_routes.erase(request.pattern_route->pattern);
+            m_pattern_routes.insert(request.pattern_route->pattern, request.pattern_route);
+            patterns_changed = true;
         } else {
-            std::cerr << "Redis connection error in listener thread for channel " << channel << std::endl;
-            break;
+            const std::string& pattern = request.pattern_route->pattern;
+            std::shared_ptr<PatternRoute>* route = m_pattern_routes.find(pattern);
+            if (route && *route == request.pattern_route) {
+                m_pattern_routes.erase(pattern);
+                patterns_changed = true;
+            }
         }
     }
+    if (patterns_changed) {
+        syncPatterns();
+    }
+}
 
-    reply = (redisReply*)redisCommand(context, "UNSUBSCRIBE %s", channel.c_str());
-    freeReplyObject(reply);
+// Brings the PSUBSCRIBEd patterns in line with the index's roots. New roots
+// are subscribed before replaced ones are dropped, so no message falls
+// through the gap.
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::syncPatterns() {
+    std::unordered_set<std::string> wanted;
+    for (const auto& root : m_pattern_routes.roots()) {
+        size_t index = std::hash<std::string>()(root) % m_connections.size();
+        wanted.insert(root);
+        if (m_connections[index].patterns.emplace(root, false).second && m_connections[index].context) {
+            sendCommand(index, "PSUBSCRIBE", root);
+        }
+    }
+    for (size_t index = 0; index < m_connections.size(); ++index) {
+        auto& patterns = m_connections[index].patterns;
+        for (auto it = patterns.begin(); it != patterns.end();) {
+            if (wanted.count(it->first)) {
+                ++it;
+                continue;
+            }
+            if (m_connections[index].context) {
+                sendCommand(index, "PUNSUBSCRIBE", it->first);
+            }
+            it = patterns.erase(it);
+        }
+    }
+    confirmPatterns();
+}
+
+// Releases psubscribe() callers whose pattern's root has been confirmed.
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::confirmPatterns() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& [pattern, subscription] : m_patterns) {
+        if (subscription.waiters.empty() || !m_pattern_routes.find(pattern)) {
+            continue; // Confirmed, or its request is still queued
+        }
+        std::string root = m_pattern_routes.coverOf(pattern);
+        const auto& patterns = m_connections[std::hash<std::string>()(root) % m_connections.size()].patterns;
+        auto it = patterns.find(root);
+        if (it != patterns.end() && it->second) {
+            for (auto& waiter : subscription.waiters) {
+                waiter.set_value();
+            }
+            subscription.waiters.clear();
+        }
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::connect(size_t index) {
+    SubscriberConnection& connection = m_connections[index];
+    connection.next_attempt = std::chrono::steady_clock::now() + m_options.reconnect_interval;
+    connection.context = m_pool_manager->openDedicatedConnection(index);
+    if (!connection.context) {
+        return;
+    }
+    for (auto& [channel, confirmed] : connection.channels) {
+        confirmed = false;
+        if (!sendCommand(index, "SUBSCRIBE", channel)) {
+            return;
+        }
+    }
+    for (auto& [pattern, confirmed] : connection.patterns) {
+        confirmed = false;
+        if (!sendCommand(index, "PSUBSCRIBE", pattern)) {
+            return;
+        }
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::closeConnection(size_t index) {
+    SubscriberConnection& connection = m_connections[index];
+    if (connection.context) {
+        redisFree(connection.context);
+        connection.context = nullptr;
+    }
+}
+
+template<typename T, typename Serializer>
+bool PubSubWrapper<T, Serializer>::sendCommand(size_t index, const char* command, const std::string& channel) {
+    redisContext* context = m_connections[index].context;
+    const char* argv[2] = {command, channel.data()};
+    size_t argvlen[2] = {strlen(command), channel.size()};
+    int done = 0;
+    if (redisAppendCommandArgv(context, 2, argv, argvlen) != REDIS_OK) {
+        return false;
+    }
+    while (!done) {
+        if (redisBufferWrite(context, &done) != REDIS_OK) {
+            std::cerr << "Failed to send " << command << " for channel " << channel << std::endl;
+            closeConnection(index);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads what the socket has and handles every complete reply in it.
+template<typename T, typename Serializer>
+bool PubSubWrapper<T, Serializer>::readReplies(size_t index) {
+    redisContext* context = m_connections[index].context;
+    if (redisBufferRead(context) != REDIS_OK) {
+        return false;
+    }
+    while (true) {
+        void* raw = nullptr;
+        if (redisGetReplyFromReader(context, &raw) != REDIS_OK) {
+            return false;
+        }
+        if (!raw) {
+            return true;
+        }
+        handleReply(index, ReplyPtr(static_cast<redisReply*>(raw), freeReplyObject));
+        if (!m_connections[index].context) {
+            return true; // Closed by a failed send
+        }
+    }
+}
+
+namespace pub_sub_detail {
+
+inline bool isKind(const redisReply* reply, std::string_view kind) {
+    return std::string_view(reply->str, reply->len) == kind;
+}
+
+} // namespace pub_sub_detail
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::handleReply(size_t index, const ReplyPtr& reply) {
+    using pub_sub_detail::isKind;
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements < 3 || reply->element[0]->type != REDIS_REPLY_STRING ||
+        reply->element[1]->type != REDIS_REPLY_STRING) {
+        return;
+    }
+    const redisReply* kind = reply->element[0];
+    if (reply->elements == 4) {
+        // pmessage: pattern, channel, payload
+        if (isKind(kind, "pmessage") && reply->element[2]->type == REDIS_REPLY_STRING &&
+            reply->element[3]->type == REDIS_REPLY_STRING) {
+            dispatchPattern(reply);
+        }
+    } else if (isKind(kind, "message")) {
+        if (reply->element[2]->type == REDIS_REPLY_STRING) {
+            dispatch(reply);
+        }
+    } else if (isKind(kind, "subscribe")) {
+        std::string channel(reply->element[1]->str, reply->element[1]->len);
+        auto it = m_connections[index].channels.find(channel);
+        if (it != m_connections[index].channels.end()) {
+            it->second = true;
+            confirm(channel);
+        }
+    } else if (isKind(kind, "psubscribe")) {
+        auto it = m_connections[index].patterns.find(std::string(reply->element[1]->str, reply->element[1]->len));
+        if (it != m_connections[index].patterns.end()) {
+            it->second = true;
+            confirmPatterns();
+        }
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::confirm(const std::string& channel) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_subscriptions.find(channel);
+    if (it != m_subscriptions.end()) {
+        for (auto& waiter : it->second.waiters) {
+            waiter.set_value();
+        }
+        it->second.waiters.clear();
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::dispatch(const ReplyPtr& reply) {
+    const redisReply* channel = reply->element[1];
+    auto it = m_channel_routes.find(std::string_view(channel->str, channel->len));
+    if (it == m_channel_routes.end()) {
+        return; // Unsubscribed, UNSUBSCRIBE not processed by Redis yet
+    }
+    // Parsing happens on the worker as well.
+    m_dispatch->push(it->second->id, [route = it->second, reply]() { deliver(*route, *reply->element[2]); });
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::dispatchPattern(const ReplyPtr& reply) {
+    const redisReply* via = reply->element[1];
+    const redisReply* channel = reply->element[2];
+    m_pattern_routes.match(std::string_view(via->str, via->len), std::string_view(channel->str, channel->len),
+                           [&](const std::shared_ptr<PatternRoute>& route) {
+        // Queued under the pattern's route, so each handler sees its
+        // messages in order; CoalesceLatest keeps each channel's latest.
+        m_dispatch->push(route->id, std::hash<std::string_view>()(std::string_view(channel->str, channel->len)),
+                        [route, reply]() { deliverPattern(*route, *reply); });
+    });
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::deliverPattern(const PatternRoute& route, const redisReply& reply) {
+    if (!route.active.load(std::memory_order_acquire)) {
+        return;
+    }
+    const redisReply* payload = reply.element[3];
+    std::optional<T> message;
+    try {
+        message.emplace(Serializer::template decode<T>(payload->str, payload->len));
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing message: " << e.what() << std::endl;
+        return;
+    }
+    std::string channel(reply.element[2]->str, reply.element[2]->len);
+    try {
+        route.callback(channel, *message);
+    } catch (const std::exception& e) {
+        std::cerr << "Error in pattern callback for channel " << channel << ": " << e.what() << std::endl;
+    }
+}
+
+template<typename T, typename Serializer>
+void PubSubWrapper<T, Serializer>::deliver(const Route& route, const redisReply& payload) {
+    if (!route.active.load(std::memory_order_acquire)) {
+        return;
+    }
+    std::optional<T> message;
+    try {
+        message.emplace(Serializer::template decode<T>(payload.str, payload.len));
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing message: " << e.what() << std::endl;
+        return;
+    }
+    try {
+        route.callback(*message);
+    } catch (const std::exception& e) {
+        std::cerr << "Error in callback for channel " << route.channel << ": " << e.what() << std::endl;
+    }
 }
 
 #endif // PUB_SUB_WRAPPER_H
@@ -0,0 +1,86 @@
+#ifndef PUB_SUB_SERIALIZERS_H
+#define PUB_SUB_SERIALIZERS_H
+
+#include <string>
+#include <cstring>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <nlohmann/json.hpp>
+
+// Message codecs for PubSubWrapper. A serializer provides
+//
+//   template<typename T> static std::string encode(const T& message);
+//   template<typename T> static T decode(const char* data, size_t size);
+//
+// where decode() throws on malformed input. Encoded messages are sent
+// binary-safe, so they may contain any bytes.
+
+// JSON text, through the type's nlohmann to_json/from_json.
+struct JsonSerializer {
+    template<typename T>
+    static std::string encode(const T& message) {
+        nlohmann::json j = message;
+        return j.dump();
+    }
+
+    template<typename T>
+    static T decode(const char* data, size_t size) {
+        return nlohmann::json::parse(data, data + size).template get<T>();
+    }
+};
+
+// MessagePack, through the same to_json/from_json conversions; more
+// compact than JSON text and cheaper to parse.
+struct MessagePackSerializer {
+    template<typename T>
+    static std::string encode(const T& message) {
+        std::string out;
+        nlohmann::json::to_msgpack(nlohmann::json(message), out);
+        return out;
+    }
+
+    template<typename T>
+    static T decode(const char* data, size_t size) {
+        return nlohmann::json::from_msgpack(data, data + size).template get<T>();
+    }
+};
+
+// CBOR, through the same to_json/from_json conversions.
+struct CborSerializer {
+    template<typename T>
+    static std::string encode(const T& message) {
+        std::string out;
+        nlohmann::json::to_cbor(nlohmann::json(message), out);
+        return out;
+    }
+
+    template<typename T>
+    static T decode(const char* data, size_t size) {
+        return nlohmann::json::from_cbor(data, data + size).template get<T>();
+    }
+};
+
+// The object's bytes as they are, for trivially copyable messages shared
+// by processes of the same build (no versioning, native byte order).
+struct RawSerializer {
+    template<typename T>
+    static std::string encode(const T& message) {
+        static_assert(std::is_trivially_copyable<T>::value, "RawSerializer needs a trivially copyable type");
+        return std::string(reinterpret_cast<const char*>(&message), sizeof(T));
+    }
+
+    template<typename T>
+    static T decode(const char* data, size_t size) {
+        static_assert(std::is_trivially_copyable<T>::value, "RawSerializer needs a trivially copyable type");
+        if (size != sizeof(T)) {
+            throw std::runtime_error("Raw message has " + std::to_string(size) + " bytes, expected " +
+                                     std::to_string(sizeof(T)));
+        }
+        T message;
+        std::memcpy(&message, data, sizeof(T));
+        return message;
+    }
+};
+
+#endif // PUB_SUB_SERIALIZERS_H
@@ -8,6 +8,33 @@
 #include <mutex>
 #include <condition_variable>
 #include <future>
+#include <atomic>
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+struct RouteUpdate {
+    uint32_t prefix;
+    uint8_t length;
+    uint32_t next_hop;
+};
+
+struct PortState {
+    std::string name;
+    bool up = false;
+    int speed = 0;
+};
+
+void to_json(json& j, const PortState& state) {
+    j = json{{"name", state.name}, {"up", state.up}, {"speed", state.speed}};
+}
+
+void from_json(const json& j, PortState& state) {
+    j.at("name").get_to(state.name);
+    j.at("up").get_to(state.up);
+    j.at("speed").get_to(state.speed);
+}
 
 class PubSubWrapperTest : public ::testing::Test {
 protected:
@@ -67,6 +94,28 @@ TEST_F(PubSubWrapperTest, Unsubscribe) {
     ASSERT_FALSE(cv.wait_for(lock, std::chrono::milliseconds(100), [&] { return message_received; }));
 }
 
+// The wrapper joins its dispatch workers before tearing down the
+// connections a running callback may still subscribe on.
+TEST_F(PubSubWrapperTest, CallbackSubscribesDuringDestruction) {
+    auto* pub_sub = new PubSubWrapper<std::string>(pool_manager);
+    std::promise<void> started;
+    std::atomic<bool> subscribed{false};
+    pub_sub->subscribe("shutdown_channel", [&](const std::string&) {
+        started.set_value();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        pub_sub->subscribe("late_channel", [](const std::string&) {});
+        subscribed = true;
+    }).get();
+
+    pub_sub->publish("shutdown_channel", "bye");
+    started.get_future().get();
+    testing::internal::CaptureStderr();
+    delete pub_sub;
+    std::string errors = testing::internal::GetCapturedStderr();
+    EXPECT_TRUE(subscribed);
+    EXPECT_EQ(errors.find("Failed to wake"), std::string::npos) << errors;
+}
+
 TEST_F(PubSubWrapperTest, MalformedJSON) {
     PubSubWrapper<int> pub_sub(pool_manager);
     bool message_received = false;
@@ -89,3 +138,406 @@ TEST_F(PubSubWrapperTest, MalformedJSON) {
     std::unique_lock<std::mutex> lock(m);
     ASSERT_FALSE(cv.wait_for(lock, std::chrono::milliseconds(100), [&] { return message_received; }));
 }
+
+TEST_F(PubSubWrapperTest, ManyChannelsShareSubscriberConnections) {
+    // A single pooled connection: subscriptions must not hold on to it.
+    auto small_pool = std::make_shared<ConnectionPoolManager>(std::vector<std::string>{"127.0.0.1"}, 1);
+    PubSubOptions options;
+    options.subscriber_connections = 2;
+    PubSubWrapper<int> pub_sub(small_pool, options);
+
+    const int channels = 50;
+    std::mutex m;
+    std::condition_variable cv;
+    std::map<std::string, int> received;
+    std::vector<std::future<void>> futures;
+    for (int i = 0; i < channels; ++i) {
+        std::string channel = "mux_channel:" + std::to_string(i);
+        futures.push_back(pub_sub.subscribe(channel, [&, channel](const int& value) {
+            std::lock_guard<std::mutex> lock(m);
+            received[channel] += value;
+            cv.notify_one();
+        }));
+    }
+    for (auto& future : futures) {
+        ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    }
+    EXPECT_EQ(pub_sub.subscriptionCount(), static_cast<size_t>(channels));
+
+    for (int i = 0; i < channels; ++i) {
+        pub_sub.publish("mux_channel:" + std::to_string(i), i);
+    }
+    {
+        std::unique_lock<std::mutex> lock(m);
+        ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return received.size() == channels; }));
+        for (int i = 0; i < channels; ++i) {
+            EXPECT_EQ(received["mux_channel:" + std::to_string(i)], i);
+        }
+    }
+
+    // Channels come and go without disturbing the others.
+    for (int i = 0; i < channels; i += 2) {
+        pub_sub.unsubscribe("mux_channel:" + std::to_string(i));
+    }
+    EXPECT_EQ(pub_sub.subscriptionCount(), static_cast<size_t>(channels / 2));
+    pub_sub.subscribe("mux_channel:0", [&](const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        received["resubscribed"] += value;
+        cv.notify_one();
+    }).get();
+    for (int i = 0; i < channels; ++i) {
+        pub_sub.publish("mux_channel:" + std::to_string(i), 1000);
+    }
+    std::unique_lock<std::mutex> lock(m);
+    ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] {
+        return received["resubscribed"] == 1000 && received["mux_channel:49"] == 1049;
+    }));
+    EXPECT_EQ(received["mux_channel:2"], 2);
+    EXPECT_EQ(received["mux_channel:3"], 1003);
+}
+
+TEST(DispatchQueueTest, BackpressurePolicies) {
+    for (auto policy : {BackpressurePolicy::DropOldest, BackpressurePolicy::CoalesceLatest, BackpressurePolicy::Block}) {
+        DispatchQueue queue(1, 4, policy);
+        const uint64_t slow = 1;
+        const uint64_t updates = 2;
+        std::promise<void> started;
+        std::promise<void> release;
+        std::shared_future<void> released = release.get_future().share();
+        queue.push(slow, [&started, released] {
+            started.set_value();
+            released.wait();
+        });
+        started.get_future().wait();
+
+        // The worker is busy, so everything below queues up.
+        std::mutex m;
+        std::vector<int> handled;
+        std::thread producer([&] {
+            for (int i = 0; i < 10; ++i) {
+                queue.push(updates, [&m, &handled, i] {
+                    std::lock_guard<std::mutex> lock(m);
+                    handled.push_back(i);
+                });
+            }
+        });
+        if (policy == BackpressurePolicy::Block) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+            while (queue.stats().blocked == 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            EXPECT_EQ(queue.stats().queue_depth, 4u);
+        } else {
+            producer.join();
+        }
+        release.set_value();
+        if (producer.joinable()) {
+            producer.join();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (queue.stats().queue_depth > 0 && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        queue.quiesce(updates);
+        DispatchStats stats = queue.stats();
+        std::lock_guard<std::mutex> lock(m);
+        if (policy == BackpressurePolicy::DropOldest) {
+            EXPECT_EQ(handled, (std::vector<int>{6, 7, 8, 9}));
+            EXPECT_EQ(stats.dropped, 6u);
+        } else if (policy == BackpressurePolicy::CoalesceLatest) {
+            EXPECT_EQ(handled, (std::vector<int>{9}));
+            EXPECT_EQ(stats.coalesced, 9u);
+        } else {
+            EXPECT_EQ(handled, (std::vector<int>{0, 1, 2, 3, 4, 5, 6, 7, 8, 9}));
+            EXPECT_GT(stats.blocked, 0u);
+        }
+        EXPECT_LE(stats.max_queue_depth, 4u);
+    }
+}
+
+TEST_F(PubSubWrapperTest, SlowCallbacksDoNotStallTheReader) {
+    PubSubOptions options;
+    options.dispatch_threads = 4;
+    PubSubWrapper<int> pub_sub(pool_manager, options);
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<int> ordered;
+    int slow_calls = 0;
+    pub_sub.subscribe("dispatch_slow", [&](const int&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        std::lock_guard<std::mutex> lock(m);
+        ++slow_calls;
+        cv.notify_one();
+    }).get();
+    pub_sub.subscribe("dispatch_ordered", [&](const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        ordered.push_back(value);
+        cv.notify_one();
+    }).get();
+
+    for (int i = 0; i < 5; ++i) {
+        pub_sub.publish("dispatch_slow", i);
+    }
+    const int messages = 500;
+    for (int i = 0; i < messages; ++i) {
+        pub_sub.publish("dispatch_ordered", i);
+    }
+
+    std::unique_lock<std::mutex> lock(m);
+    ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return ordered.size() == messages && slow_calls == 5; }));
+    for (int i = 0; i < messages; ++i) {
+        ASSERT_EQ(ordered[i], i);
+    }
+    lock.unlock();
+    DispatchStats stats = pub_sub.dispatchStats();
+    EXPECT_EQ(stats.enqueued, static_cast<uint64_t>(messages + 5));
+    EXPECT_EQ(stats.dropped, 0u);
+}
+
+TEST_F(PubSubWrapperTest, BatchedAndBackgroundPublishing) {
+    PubSubOptions options;
+    options.background_publisher = true;
+    options.publish_batch_size = 64;
+    PubSubWrapper<int> pub_sub(pool_manager, options);
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<int> received;
+    pub_sub.subscribe("publish_batch", [&](const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        received.push_back(value);
+        cv.notify_one();
+    }).get();
+
+    std::vector<std::pair<std::string, int>> batch;
+    for (int i = 0; i < 100; ++i) {
+        batch.emplace_back(i % 2 == 0 ? "publish_batch" : "publish_batch_nobody", i);
+    }
+    auto receivers = pub_sub.publishBatch(batch);
+    ASSERT_EQ(receivers.size(), 100u);
+    EXPECT_EQ(receivers[0], 1);
+    EXPECT_EQ(receivers[1], 0);
+
+    for (int i = 100; i < 1000; ++i) {
+        pub_sub.publishAsync("publish_batch", i);
+    }
+    auto acknowledged = pub_sub.publishAcknowledged("publish_batch", 1000);
+    auto unheard = pub_sub.publishAcknowledged("publish_batch_nobody", 0);
+    EXPECT_EQ(acknowledged.get(), 1);
+    EXPECT_EQ(unheard.get(), 0);
+    pub_sub.flushPublishes();
+
+    PublisherStats stats = pub_sub.publisherStats();
+    EXPECT_EQ(stats.published, 902u);
+    EXPECT_EQ(stats.failed, 0u);
+    EXPECT_EQ(stats.queued, 0u);
+    // Coalesced into bursts of at most publish_batch_size.
+    EXPECT_GE(stats.bursts, 902u / 64);
+    EXPECT_LT(stats.bursts, 902u);
+
+    std::unique_lock<std::mutex> lock(m);
+    ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] { return received.size() == 951; }));
+    for (size_t i = 1; i < received.size(); ++i) {
+        ASSERT_LT(received[i - 1], received[i]);
+    }
+    lock.unlock();
+
+    PubSubWrapper<int> plain(pool_manager);
+    EXPECT_THROW(plain.publishAsync("publish_batch", 1), std::logic_error);
+}
+
+template<typename Serializer>
+void roundTripPortState(std::shared_ptr<ConnectionPoolManager> pool_manager, const std::string& channel) {
+    PubSubWrapper<PortState, Serializer> pub_sub(pool_manager);
+    std::promise<PortState> received;
+    pub_sub.subscribe(channel, [&](const PortState& state) { received.set_value(state); }).get();
+
+    // Embedded NULs survive the trip.
+    PortState sent{std::string("Ethernet\0" "8", 10), true, 100000};
+    pub_sub.publish(channel, sent);
+    auto future = received.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    PortState state = future.get();
+    EXPECT_EQ(state.name, sent.name);
+    EXPECT_TRUE(state.up);
+    EXPECT_EQ(state.speed, 100000);
+}
+
+TEST_F(PubSubWrapperTest, SerializerPolicies) {
+    roundTripPortState<JsonSerializer>(pool_manager, "codec_json");
+    roundTripPortState<MessagePackSerializer>(pool_manager, "codec_msgpack");
+    roundTripPortState<CborSerializer>(pool_manager, "codec_cbor");
+    EXPECT_LT(MessagePackSerializer::encode(PortState{"Ethernet8", true, 100000}).size(),
+              JsonSerializer::encode(PortState{"Ethernet8", true, 100000}).size());
+
+    // Raw structs are sent as their bytes, zeros included.
+    PubSubWrapper<RouteUpdate, RawSerializer> routes(pool_manager);
+    std::promise<RouteUpdate> received;
+    routes.subscribe("codec_raw", [&](const RouteUpdate& update) { received.set_value(update); }).get();
+    RouteUpdate update{};
+    update.prefix = 0x0a000000;
+    update.length = 8;
+    update.next_hop = 0x0a000001;
+    routes.publishBatch({{"codec_raw", update}});
+    auto future = received.get_future();
+    ASSERT_EQ(future.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    RouteUpdate got = future.get();
+    EXPECT_EQ(got.prefix, update.prefix);
+    EXPECT_EQ(got.length, 8);
+    EXPECT_EQ(got.next_hop, update.next_hop);
+
+    EXPECT_THROW(RawSerializer::decode<RouteUpdate>("short", 5), std::runtime_error);
+}
+
+TEST(PatternIndexTest, GlobMatchingAndCover) {
+    using Index = PatternIndex<int>;
+    EXPECT_TRUE(Index::globMatch("PORT_TABLE:*", "PORT_TABLE:Ethernet0"));
+    EXPECT_TRUE(Index::globMatch("h?llo", "hello"));
+    EXPECT_TRUE(Index::globMatch("h[ae]llo", "hallo"));
+    EXPECT_FALSE(Index::globMatch("h[^e]llo", "hello"));
+    EXPECT_TRUE(Index::globMatch("Ethernet[0-9]", "Ethernet7"));
+    EXPECT_FALSE(Index::globMatch("Ethernet[0-9]", "Ethernet10"));
+    EXPECT_TRUE(Index::globMatch("a\\*b", "a*b"));
+    EXPECT_FALSE(Index::globMatch("a\\*b", "axb"));
+    EXPECT_TRUE(Index::globMatch("*", ""));
+    EXPECT_TRUE(Index::globMatch("a*b*c", "aXbYc"));
+    EXPECT_FALSE(Index::globMatch("a*b*c", "aXbY"));
+
+    Index index;
+    EXPECT_TRUE(index.insert("PORT_TABLE:Ethernet*", 1));
+    EXPECT_TRUE(index.insert("PORT_TABLE:Ethernet[0-9]", 2));
+    EXPECT_TRUE(index.insert("*:Ethernet8", 3));
+    EXPECT_FALSE(index.insert("PORT_TABLE:Ethernet*", 4));
+    // PORT_TABLE:Ethernet* covers PORT_TABLE:Ethernet[0-9].
+    EXPECT_EQ(index.roots().size(), 2u);
+
+    // A broader prefix pattern folds the PORT_TABLE patterns into one root.
+    EXPECT_TRUE(index.insert("PORT_TABLE:*", 5));
+    auto roots = index.roots();
+    std::sort(roots.begin(), roots.end());
+    EXPECT_EQ(roots, (std::vector<std::string>{"*:Ethernet8", "PORT_TABLE:*"}));
+    EXPECT_EQ(index.coverOf("PORT_TABLE:Ethernet[0-9]"), "PORT_TABLE:*");
+    EXPECT_EQ(index.coverOf("*:Ethernet8"), "*:Ethernet8");
+
+    std::vector<int> matched;
+    index.match("PORT_TABLE:*", "PORT_TABLE:Ethernet8", [&](int value) { matched.push_back(value); });
+    std::sort(matched.begin(), matched.end());
+    EXPECT_EQ(matched, (std::vector<int>{1, 2, 5}));
+    matched.clear();
+    index.match("PORT_TABLE:*", "PORT_TABLE:Ethernet12", [&](int value) { matched.push_back(value); });
+    std::sort(matched.begin(), matched.end());
+    EXPECT_EQ(matched, (std::vector<int>{1, 5}));
+
+    EXPECT_TRUE(index.erase("PORT_TABLE:*"));
+    EXPECT_FALSE(index.erase("PORT_TABLE:*"));
+    EXPECT_EQ(index.roots().size(), 2u);
+    EXPECT_EQ(index.size(), 3u);
+}
+
+TEST_F(PubSubWrapperTest, PatternSubscriptions) {
+    std::mutex m;
+    std::condition_variable cv;
+    std::map<std::string, std::vector<std::string>> received; // Pattern to channels
+    // Declared after what its callbacks use: retried publishes may still be
+    // in flight when the test ends.
+    PubSubWrapper<int> pub_sub(pool_manager);
+    auto handler = [&](const std::string& pattern) {
+        return [&, pattern](const std::string& channel, const int&) {
+            std::lock_guard<std::mutex> lock(m);
+            received[pattern].push_back(channel);
+            cv.notify_one();
+        };
+    };
+    for (const char* pattern : {"PSUB_PORT:*", "PSUB_PORT:Ethernet*", "PSUB_PORT:Ethernet[0-9]", "*:Ethernet8"}) {
+        ASSERT_EQ(pub_sub.psubscribe(pattern, handler(pattern)).wait_for(std::chrono::seconds(5)),
+                  std::future_status::ready);
+    }
+    EXPECT_EQ(pub_sub.patternCount(), 4u);
+
+    pub_sub.publish("PSUB_PORT:Ethernet8", 1);
+    pub_sub.publish("PSUB_PORT:Ethernet12", 2);
+    pub_sub.publish("PSUB_VLAN:Vlan100", 3);
+    pub_sub.publish("PSUB_PORT:Loopback0", 4);
+    {
+        // Handlers run on different workers, so wait for all of them.
+        std::unique_lock<std::mutex> lock(m);
+        ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] {
+            return received["PSUB_PORT:*"].size() == 3 && received["PSUB_PORT:Ethernet*"].size() == 2 &&
+                   received["PSUB_PORT:Ethernet[0-9]"].size() == 1 && received["*:Ethernet8"].size() == 1;
+        }));
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100)); // Let any duplicate arrive
+        lock.lock();
+        EXPECT_EQ(received["PSUB_PORT:*"],
+                  (std::vector<std::string>{"PSUB_PORT:Ethernet8", "PSUB_PORT:Ethernet12", "PSUB_PORT:Loopback0"}));
+        EXPECT_EQ(received["PSUB_PORT:Ethernet*"],
+                  (std::vector<std::string>{"PSUB_PORT:Ethernet8", "PSUB_PORT:Ethernet12"}));
+        EXPECT_EQ(received["PSUB_PORT:Ethernet[0-9]"], (std::vector<std::string>{"PSUB_PORT:Ethernet8"}));
+        EXPECT_EQ(received["*:Ethernet8"], (std::vector<std::string>{"PSUB_PORT:Ethernet8"}));
+        received.clear();
+    }
+
+    // Dropping the covering pattern keeps the others subscribed (once their
+    // own PSUBSCRIBEs are through).
+    pub_sub.punsubscribe("PSUB_PORT:*");
+    std::unique_lock<std::mutex> lock(m);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while ((received["PSUB_PORT:Ethernet[0-9]"].empty() || received["PSUB_PORT:Ethernet*"].empty()) &&
+           std::chrono::steady_clock::now() < deadline) {
+        lock.unlock();
+        pub_sub.publish("PSUB_PORT:Ethernet3", 5);
+        lock.lock();
+        cv.wait_for(lock, std::chrono::milliseconds(20));
+    }
+    EXPECT_FALSE(received["PSUB_PORT:Ethernet[0-9]"].empty());
+    EXPECT_FALSE(received["PSUB_PORT:Ethernet*"].empty());
+    EXPECT_TRUE(received["PSUB_PORT:*"].empty());
+    lock.unlock();
+}
+
+TEST_F(PubSubWrapperTest, PatternCoalescingKeepsEachChannelsLatest) {
+    std::mutex m;
+    std::condition_variable cv;
+    std::map<std::string, std::vector<int>> received; // Channel to messages
+    std::promise<void> started;
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    PubSubOptions options;
+    options.dispatch_threads = 1;
+    options.backpressure_policy = BackpressurePolicy::CoalesceLatest;
+    PubSubWrapper<int> pub_sub(pool_manager, options);
+    ASSERT_EQ(pub_sub.psubscribe("COALESCE_PORT:*", [&](const std::string& channel, const int& value) {
+        if (channel == "COALESCE_PORT:gate") {
+            started.set_value();
+            released.wait();
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m);
+        received[channel].push_back(value);
+        cv.notify_one();
+    }).wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    // The handler is busy, so the updates below queue up and coalesce.
+    pub_sub.publish("COALESCE_PORT:gate", 0);
+    ASSERT_EQ(started.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    for (int i = 1; i <= 5; ++i) {
+        pub_sub.publish("COALESCE_PORT:Ethernet0", i);
+        pub_sub.publish("COALESCE_PORT:Ethernet4", 10 + i);
+    }
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (pub_sub.dispatchStats().coalesced < 8 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    release.set_value();
+
+    std::unique_lock<std::mutex> lock(m);
+    ASSERT_TRUE(cv.wait_for(lock, std::chrono::seconds(5), [&] {
+        return received["COALESCE_PORT:Ethernet0"].size() == 1 && received["COALESCE_PORT:Ethernet4"].size() == 1;
+    }));
+    EXPECT_EQ(received["COALESCE_PORT:Ethernet0"], (std::vector<int>{5}));
+    EXPECT_EQ(received["COALESCE_PORT:Ethernet4"], (std::vector<int>{15}));
+    EXPECT_EQ(pub_sub.dispatchStats().coalesced, 8u);
+    lock.unlock();
+}
@@ -0,0 +1,106 @@
+#include "coroutine_executor.h"
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+// Fire-and-forget coroutine: starts suspended so spawn() can post it, and
+// frees its own frame when it finishes.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() noexcept {
+            return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_always initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template<typename OnFinished>
+DetachedTask runDetached(Task<void> task, OnFinished on_finished) {
+    try {
+        co_await std::move(task);
+    } catch (const std::exception& e) {
+        std::cerr << "Spawned coroutine failed: " << e.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Spawned coroutine failed with an unknown exception" << std::endl;
+    }
+    on_finished();
+}
+
+} // namespace
+
+CoroutineExecutor::CoroutineExecutor(int threads) {
+    if (threads <= 0) {
+        throw std::invalid_argument("Coroutine executor needs at least one thread");
+    }
+    workers_.reserve(threads);
+    for (int i = 0; i < threads; ++i) {
+        workers_.emplace_back(&CoroutineExecutor::workerLoop, this);
+    }
+}
+
+CoroutineExecutor::~CoroutineExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    ready_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void CoroutineExecutor::post(std::coroutine_handle<> handle) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ready_.push_back(handle);
+    }
+    ready_cv_.notify_one();
+}
+
+void CoroutineExecutor::spawn(Task<void> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++active_;
+    }
+    DetachedTask detached = runDetached(std::move(task), [this]() { taskFinished(); });
+    post(detached.handle);
+}
+
+void CoroutineExecutor::taskFinished() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--active_ == 0) {
+        idle_cv_.notify_all();
+    }
+}
+
+void CoroutineExecutor::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this]() { return active_ == 0; });
+}
+
+size_t CoroutineExecutor::active() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_;
+}
+
+void CoroutineExecutor::workerLoop() {
+    while (true) {
+        std::coroutine_handle<> handle;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            ready_cv_.wait(lock, [this]() { return stop_ || !ready_.empty(); });
+            if (stop_) {
+                return;
+            }
+            handle = ready_.front();
+            ready_.pop_front();
+        }
+        handle.resume();
+    }
+}
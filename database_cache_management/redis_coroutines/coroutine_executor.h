@@ -0,0 +1,99 @@
+#ifndef COROUTINE_EXECUTOR_H
+#define COROUTINE_EXECUTOR_H
+
+#include "task.h"
+#include <coroutine>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small thread pool that resumes coroutines.
+//
+// Redis replies arrive on the async engine's event loop threads, which must
+// never block, so the coroutine awaitables hand the resumption to an
+// executor and the coroutine body runs on one of its worker threads. A few
+// workers can drive thousands of suspended coroutines.
+class CoroutineExecutor {
+public:
+    explicit CoroutineExecutor(int threads = 1);
+    // Stops the workers. Coroutines still suspended at that point are
+    // abandoned, so wait for them first with waitIdle().
+    ~CoroutineExecutor();
+
+    // Deleted copy and move constructors/assignments
+    CoroutineExecutor(const CoroutineExecutor&) = delete;
+    CoroutineExecutor& operator=(const CoroutineExecutor&) = delete;
+    CoroutineExecutor(CoroutineExecutor&&) = delete;
+    CoroutineExecutor& operator=(CoroutineExecutor&&) = delete;
+
+    // Queues a suspended coroutine to be resumed on a worker thread.
+    void post(std::coroutine_handle<> handle);
+
+    // co_await executor.schedule() continues the coroutine on a worker.
+    auto schedule() {
+        struct ScheduleAwaiter {
+            CoroutineExecutor* executor;
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { executor->post(handle); }
+            void await_resume() const noexcept {}
+        };
+        return ScheduleAwaiter{this};
+    }
+
+    // Starts the task on a worker and lets it run to completion on its own.
+    // An exception escaping the task is logged and dropped.
+    void spawn(Task<void> task);
+
+    // Blocks until every spawned task has finished.
+    void waitIdle();
+    // Spawned tasks that have not finished yet.
+    size_t active() const;
+
+private:
+    void workerLoop();
+    void taskFinished();
+
+    std::vector<std::thread> workers_;
+    mutable std::mutex mutex_;
+    std::condition_variable ready_cv_;
+    std::condition_variable idle_cv_;
+    std::deque<std::coroutine_handle<>> ready_;
+    size_t active_ = 0;
+    bool stop_ = false;
+};
+
+namespace task_detail {
+
+template<typename T>
+Task<void> fulfil(Task<T> task, std::shared_ptr<std::promise<T>> result) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await std::move(task);
+            result->set_value();
+        } else {
+            result->set_value(co_await std::move(task));
+        }
+    } catch (...) {
+        result->set_exception(std::current_exception());
+    }
+}
+
+} // namespace task_detail
+
+// Runs the task on the executor and blocks the calling thread until it
+// finishes, returning its result or rethrowing its exception. Must not be
+// called from a worker of the same executor.
+template<typename T>
+T syncWait(CoroutineExecutor& executor, Task<T> task) {
+    auto result = std::make_shared<std::promise<T>>();
+    std::future<T> future = result->get_future();
+    executor.spawn(task_detail::fulfil(std::move(task), result));
+    return future.get();
+}
+
+#endif // COROUTINE_EXECUTOR_H
@@ -0,0 +1,55 @@
+#include "redis_coroutine_client.h"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+// One table update: bump the version and record it, then let the entry
+// expire if nothing refreshes it.
+Task<void> updateTable(RedisCoroutineClient& redis, int table) {
+    std::string key = "coroutine_example:table:" + std::to_string(table);
+    long long version = co_await redis.incrBy(key + ":version", 1);
+    co_await redis.hset(key, "version", std::to_string(version));
+    co_await redis.expire(key, 60);
+    co_await redis.expire(key + ":version", 60);
+}
+
+Task<void> orderedUpdates(RedisCoroutineClient& redis) {
+    // A lease sends its commands on one connection, in order.
+    ConnectionLease lease = co_await redis.lease();
+    co_await lease.hset("coroutine_example:status", "phase", "draining");
+    co_await lease.hset("coroutine_example:status", "phase", "done");
+    std::optional<std::string> phase = co_await lease.hget("coroutine_example:status", "phase");
+    std::cout << "Status phase: " << phase.value_or("(nil)") << std::endl;
+    co_await lease.del("coroutine_example:status");
+}
+
+} // namespace
+
+int main() {
+    try {
+        auto engine = std::make_shared<AsyncCommandEngine>(std::vector<std::string>{"127.0.0.1"});
+        auto executor = std::make_shared<CoroutineExecutor>(2);
+        RedisCoroutineClient redis(engine, executor);
+
+        // Thousands of concurrent updates on two worker threads.
+        const int tables = 10000;
+        auto start = std::chrono::steady_clock::now();
+        for (int table = 0; table < tables; ++table) {
+            executor->spawn(updateTable(redis, table));
+        }
+        executor->waitIdle();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        std::cout << tables << " table updates completed in " << elapsed.count() << " ms" << std::endl;
+
+        syncWait(*executor, orderedUpdates(redis));
+    } catch (const std::exception& e) {
+        std::cerr << "An exception occurred: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
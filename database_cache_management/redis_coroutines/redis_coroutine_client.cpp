@@ -0,0 +1,174 @@
+#include "redis_coroutine_client.h"
+#include <hiredis/hiredis.h>
+#include <stdexcept>
+
+namespace coroutine_replies {
+
+long long integer(const redisReply* reply) {
+    if (reply->type != REDIS_REPLY_INTEGER) {
+        throw std::runtime_error("Unexpected reply type, expected integer");
+    }
+    return reply->integer;
+}
+
+std::optional<std::string> string(const redisReply* reply) {
+    if (reply->type == REDIS_REPLY_NIL) {
+        return std::nullopt;
+    }
+    if (reply->type != REDIS_REPLY_STRING && reply->type != REDIS_REPLY_STATUS) {
+        throw std::runtime_error("Unexpected reply type, expected string");
+    }
+    return std::string(reply->str, reply->len);
+}
+
+bool boolean(const redisReply* reply) {
+    return integer(reply) == 1;
+}
+
+} // namespace coroutine_replies
+
+template<typename T>
+CommandAwaitable<T> RedisCoroutineCommands::send(std::vector<std::string> args, T (*convert)(const redisReply*)) {
+    if (engine_ == nullptr) {
+        throw std::logic_error("Command on a released connection lease");
+    }
+    return CommandAwaitable<T>(engine_, executor_, std::move(args), convert, connection_);
+}
+
+CommandAwaitable<long long> RedisCoroutineCommands::incrBy(const std::string& key, long long delta) {
+    return send<long long>({"INCRBY", key, std::to_string(delta)}, coroutine_replies::integer);
+}
+
+CommandAwaitable<std::optional<std::string>> RedisCoroutineCommands::get(const std::string& key) {
+    return send<std::optional<std::string>>({"GET", key}, coroutine_replies::string);
+}
+
+CommandAwaitable<long long> RedisCoroutineCommands::hset(const std::string& key, const std::string& field,
+                                                         const std::string& value) {
+    return send<long long>({"HSET", key, field, value}, coroutine_replies::integer);
+}
+
+CommandAwaitable<std::optional<std::string>> RedisCoroutineCommands::hget(const std::string& key,
+                                                                          const std::string& field) {
+    return send<std::optional<std::string>>({"HGET", key, field}, coroutine_replies::string);
+}
+
+CommandAwaitable<bool> RedisCoroutineCommands::expire(const std::string& key, long long seconds) {
+    return send<bool>({"EXPIRE", key, std::to_string(seconds)}, coroutine_replies::boolean);
+}
+
+CommandAwaitable<long long> RedisCoroutineCommands::publish(const std::string& channel, const std::string& message) {
+    return send<long long>({"PUBLISH", channel, message}, coroutine_replies::integer);
+}
+
+CommandAwaitable<bool> RedisCoroutineCommands::del(const std::string& key) {
+    return send<bool>({"DEL", key}, coroutine_replies::boolean);
+}
+
+ConnectionLease::ConnectionLease(RedisCoroutineClient* client, size_t slot)
+    : RedisCoroutineCommands(client->engine_holder_.get(), client->executor_holder_.get(),
+                             slot % client->engine_holder_->connectionCount()),
+      client_(client), slot_(slot) {
+}
+
+ConnectionLease::ConnectionLease(ConnectionLease&& other) noexcept
+    : RedisCoroutineCommands(other.engine_, other.executor_, other.connection_),
+      client_(other.client_), slot_(other.slot_) {
+    other.client_ = nullptr;
+    other.engine_ = nullptr;
+}
+
+ConnectionLease& ConnectionLease::operator=(ConnectionLease&& other) noexcept {
+    if (this != &other) {
+        release();
+        engine_ = other.engine_;
+        executor_ = other.executor_;
+        connection_ = other.connection_;
+        client_ = other.client_;
+        slot_ = other.slot_;
+        other.client_ = nullptr;
+        other.engine_ = nullptr;
+    }
+    return *this;
+}
+
+ConnectionLease::~ConnectionLease() {
+    release();
+}
+
+void ConnectionLease::release() {
+    if (client_) {
+        client_->releaseSlot(slot_);
+        client_ = nullptr;
+        engine_ = nullptr;
+    }
+}
+
+RedisCoroutineClient::RedisCoroutineClient(std::shared_ptr<AsyncCommandEngine> engine,
+                                           std::shared_ptr<CoroutineExecutor> executor,
+                                           const CoroutineClientOptions& options)
+    : RedisCoroutineCommands(engine.get(), executor.get(), std::nullopt),
+      engine_holder_(std::move(engine)), executor_holder_(std::move(executor)) {
+    if (!engine_holder_ || !executor_holder_) {
+        throw std::invalid_argument("Coroutine client needs an async engine and an executor");
+    }
+    if (options.max_leases == 0) {
+        throw std::invalid_argument("max_leases must be positive");
+    }
+    // Handed out from the back, so slot 0 goes first.
+    for (size_t slot = options.max_leases; slot > 0; --slot) {
+        free_slots_.push_back(slot - 1);
+    }
+}
+
+RedisCoroutineClient::~RedisCoroutineClient() = default;
+
+bool RedisCoroutineClient::tryAcquire(size_t& slot) {
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    if (free_slots_.empty()) {
+        return false;
+    }
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+    return true;
+}
+
+// Parks the coroutine unless a slot was freed since await_ready() looked.
+bool RedisCoroutineClient::LeaseAwaitable::await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard<std::mutex> lock(client_->lease_mutex_);
+    if (!client_->free_slots_.empty()) {
+        slot_ = client_->free_slots_.back();
+        client_->free_slots_.pop_back();
+        return false;
+    }
+    handle_ = handle;
+    client_->lease_waiters_.push_back(this);
+    return true;
+}
+
+// Passes the slot straight to the longest waiting coroutine, if any, so
+// waiters are served in order and cannot be overtaken.
+void RedisCoroutineClient::releaseSlot(size_t slot) {
+    LeaseAwaitable* waiter = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(lease_mutex_);
+        if (lease_waiters_.empty()) {
+            free_slots_.push_back(slot);
+            return;
+        }
+        waiter = lease_waiters_.front();
+        lease_waiters_.pop_front();
+        waiter->slot_ = slot;
+    }
+    executor_->post(waiter->handle_);
+}
+
+size_t RedisCoroutineClient::availableLeases() const {
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    return free_slots_.size();
+}
+
+size_t RedisCoroutineClient::leaseWaiters() const {
+    std::lock_guard<std::mutex> lock(lease_mutex_);
+    return lease_waiters_.size();
+}
@@ -0,0 +1,208 @@
+#ifndef REDIS_COROUTINE_CLIENT_H
+#define REDIS_COROUTINE_CLIENT_H
+
+#include "task.h"
+#include "coroutine_executor.h"
+#include <async_command_engine/async_command_engine.h>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Reply conversions used by the awaitables below. They throw
+// std::runtime_error for an unexpected reply type.
+namespace coroutine_replies {
+long long integer(const redisReply* reply);
+std::optional<std::string> string(const redisReply* reply); // nullopt for nil
+bool boolean(const redisReply* reply);                       // Integer reply 1
+} // namespace coroutine_replies
+
+// Awaitable for one command on the async engine. The coroutine suspends
+// until the reply arrives and is then resumed on the executor, so it never
+// runs on an engine event loop thread. Error replies and connection errors
+// are rethrown from the co_await.
+template<typename T>
+class CommandAwaitable {
+public:
+    using Converter = T (*)(const redisReply*);
+
+    CommandAwaitable(AsyncCommandEngine* engine, CoroutineExecutor* executor, std::vector<std::string> args,
+                     Converter convert, std::optional<size_t> connection = std::nullopt)
+        : engine_(engine), executor_(executor), args_(std::move(args)), convert_(convert),
+          connection_(connection) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        AsyncCommandEngine::ReplyCallback callback = [this, handle](const redisReply* reply, std::exception_ptr error) {
+            // Runs on the event loop thread: convert while the reply is
+            // valid, then leave the rest of the coroutine to the executor.
+            if (error) {
+                error_ = error;
+            } else {
+                try {
+                    result_.emplace(convert_(reply));
+                } catch (...) {
+                    error_ = std::current_exception();
+                }
+            }
+            executor_->post(handle);
+        };
+        if (connection_) {
+            engine_->commandOn(*connection_, args_, std::move(callback));
+        } else {
+            engine_->command(args_, std::move(callback));
+        }
+    }
+
+    T await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*result_);
+    }
+
+private:
+    AsyncCommandEngine* engine_;
+    CoroutineExecutor* executor_;
+    std::vector<std::string> args_;
+    Converter convert_;
+    std::optional<size_t> connection_;
+    std::optional<T> result_;
+    std::exception_ptr error_;
+};
+
+// The co_await-able core operations, shared by the client and its leases.
+class RedisCoroutineCommands {
+public:
+    CommandAwaitable<long long> incrBy(const std::string& key, long long delta);
+    CommandAwaitable<std::optional<std::string>> get(const std::string& key);
+    // Returns the number of fields that were added (0 if field existed).
+    CommandAwaitable<long long> hset(const std::string& key, const std::string& field, const std::string& value);
+    CommandAwaitable<std::optional<std::string>> hget(const std::string& key, const std::string& field);
+    // Returns false if the key does not exist.
+    CommandAwaitable<bool> expire(const std::string& key, long long seconds);
+    // Returns the number of subscribers that received the message.
+    CommandAwaitable<long long> publish(const std::string& channel, const std::string& message);
+    // Returns false if the key did not exist.
+    CommandAwaitable<bool> del(const std::string& key);
+
+protected:
+    RedisCoroutineCommands(AsyncCommandEngine* engine, CoroutineExecutor* executor,
+                           std::optional<size_t> connection)
+        : engine_(engine), executor_(executor), connection_(connection) {}
+
+    template<typename T>
+    CommandAwaitable<T> send(std::vector<std::string> args, T (*convert)(const redisReply*));
+
+    AsyncCommandEngine* engine_;
+    CoroutineExecutor* executor_;
+    std::optional<size_t> connection_;
+};
+
+class RedisCoroutineClient;
+
+// Coroutine counterpart of RedisConnectionGuard: holds one of the client's
+// lease slots and sends its commands on a single engine connection, so they
+// execute in the order they are awaited. The slot is released by the
+// destructor or release(). A lease must not outlive its client.
+//
+// Leases share the engine's pipelined connections with other traffic, so
+// they order commands but do not isolate connection state: no MULTI, WATCH
+// or SELECT.
+class ConnectionLease : public RedisCoroutineCommands {
+public:
+    ConnectionLease(ConnectionLease&& other) noexcept;
+    ConnectionLease& operator=(ConnectionLease&& other) noexcept;
+    ~ConnectionLease();
+
+    // Deleted copy constructor/assignment
+    ConnectionLease(const ConnectionLease&) = delete;
+    ConnectionLease& operator=(const ConnectionLease&) = delete;
+
+    // Hands the slot to the next waiting coroutine. Commands on a released
+    // lease throw std::logic_error.
+    void release();
+
+    // Engine connection the commands are sent on.
+    size_t connection() const { return connection_.value_or(0); }
+
+private:
+    friend class RedisCoroutineClient;
+    ConnectionLease(RedisCoroutineClient* client, size_t slot);
+
+    RedisCoroutineClient* client_;
+    size_t slot_;
+};
+
+struct CoroutineClientOptions {
+    // Leases that can be held at once; lease() suspends beyond that.
+    size_t max_leases = 64;
+};
+
+// co_await-able Redis operations on the async command engine.
+//
+//   Task<void> update(RedisCoroutineClient& redis, std::string table) {
+//       long long version = co_await redis.incrBy(table + ":version", 1);
+//       co_await redis.hset(table, "version", std::to_string(version));
+//   }
+//   executor->spawn(update(redis, "routes"));
+//
+// Commands from any number of coroutines are pipelined by the engine, and the
+// coroutines are resumed on the executor's threads.
+class RedisCoroutineClient : public RedisCoroutineCommands {
+public:
+    RedisCoroutineClient(std::shared_ptr<AsyncCommandEngine> engine, std::shared_ptr<CoroutineExecutor> executor,
+                         const CoroutineClientOptions& options = CoroutineClientOptions());
+    ~RedisCoroutineClient();
+
+    // Deleted copy and move constructors/assignments
+    RedisCoroutineClient(const RedisCoroutineClient&) = delete;
+    RedisCoroutineClient& operator=(const RedisCoroutineClient&) = delete;
+    RedisCoroutineClient(RedisCoroutineClient&&) = delete;
+    RedisCoroutineClient& operator=(RedisCoroutineClient&&) = delete;
+
+    class LeaseAwaitable {
+    public:
+        bool await_ready() { return client_->tryAcquire(slot_); }
+        bool await_suspend(std::coroutine_handle<> handle);
+        ConnectionLease await_resume() { return ConnectionLease(client_, slot_); }
+
+    private:
+        friend class RedisCoroutineClient;
+        explicit LeaseAwaitable(RedisCoroutineClient* client) : client_(client) {}
+
+        RedisCoroutineClient* client_;
+        size_t slot_ = 0;
+        std::coroutine_handle<> handle_;
+    };
+
+    // co_await client.lease() yields a ConnectionLease, suspending (not
+    // blocking the thread) while all lease slots are taken.
+    LeaseAwaitable lease() { return LeaseAwaitable(this); }
+
+    size_t availableLeases() const;
+    // Coroutines suspended in lease().
+    size_t leaseWaiters() const;
+
+    CoroutineExecutor& executor() { return *executor_holder_; }
+
+private:
+    friend class ConnectionLease;
+
+    bool tryAcquire(size_t& slot);
+    void releaseSlot(size_t slot);
+
+    std::shared_ptr<AsyncCommandEngine> engine_holder_;
+    std::shared_ptr<CoroutineExecutor> executor_holder_;
+    mutable std::mutex lease_mutex_;
+    std::vector<size_t> free_slots_;
+    std::deque<LeaseAwaitable*> lease_waiters_;
+};
+
+#endif // REDIS_COROUTINE_CLIENT_H
@@ -0,0 +1,120 @@
+#ifndef REDIS_COROUTINES_TASK_H
+#define REDIS_COROUTINES_TASK_H
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+template<typename T = void>
+class Task;
+
+namespace task_detail {
+
+struct PromiseBase {
+    // Resumed when the task finishes; nothing if the task was never awaited.
+    std::coroutine_handle<> continuation = std::noop_coroutine();
+    std::exception_ptr error;
+
+    struct FinalAwaiter {
+        bool await_ready() const noexcept { return false; }
+        template<typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            // Symmetric transfer, so long chains of awaits do not grow the stack.
+            return handle.promise().continuation;
+        }
+        void await_resume() const noexcept {}
+    };
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error = std::current_exception(); }
+};
+
+template<typename T>
+struct Promise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object() noexcept;
+    template<typename U>
+    void return_value(U&& result) { value.emplace(std::forward<U>(result)); }
+    T take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template<>
+struct Promise<void> : PromiseBase {
+    Task<void> get_return_object() noexcept;
+    void return_void() const noexcept {}
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} // namespace task_detail
+
+// Lazily started coroutine producing a T.
+//
+// The body does not run until the task is awaited; the awaiting coroutine is
+// resumed when it finishes, with its result or its exception. A task is
+// move-only and owns its coroutine frame. To start one from ordinary code,
+// hand it to CoroutineExecutor::spawn() or syncWait().
+template<typename T>
+class Task {
+public:
+    using promise_type = task_detail::Promise<T>;
+
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    // Deleted copy constructor/assignment
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+    T await_resume() { return handle_.promise().take(); }
+
+private:
+    friend promise_type;
+    explicit Task(std::coroutine_handle<promise_type> handle) noexcept : handle_(handle) {}
+
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace task_detail {
+
+template<typename T>
+Task<T> Promise<T>::get_return_object() noexcept {
+    return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() noexcept {
+    return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+} // namespace task_detail
+
+#endif // REDIS_COROUTINES_TASK_H
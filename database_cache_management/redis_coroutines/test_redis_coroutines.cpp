@@ -0,0 +1,147 @@
+#include "redis_coroutine_client.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// We will use a live Redis server for integration testing.
+// Make sure Redis is running on localhost:6379.
+
+namespace {
+
+std::shared_ptr<AsyncCommandEngine> makeEngine(int connections = 1) {
+    AsyncEngineOptions options;
+    options.connections_per_loop = connections;
+    return std::make_shared<AsyncCommandEngine>(std::vector<std::string>{"127.0.0.1"}, options);
+}
+
+Task<void> deleteKey(RedisCoroutineClient& redis, std::string key) {
+    co_await redis.del(key);
+}
+
+Task<long long> readCounter(RedisCoroutineClient& redis, std::string key) {
+    std::optional<std::string> value = co_await redis.get(key);
+    co_return value ? std::stoll(*value) : 0;
+}
+
+Task<void> basicOperations(RedisCoroutineClient& redis) {
+    co_await deleteKey(redis, "coro_counter");
+    co_await deleteKey(redis, "coro_hash");
+
+    EXPECT_EQ(co_await redis.incrBy("coro_counter", 5), 5);
+    EXPECT_EQ(co_await redis.incrBy("coro_counter", -2), 3);
+    EXPECT_EQ(co_await redis.get("coro_counter"), std::optional<std::string>("3"));
+    EXPECT_EQ(co_await redis.get("coro_missing"), std::nullopt);
+
+    EXPECT_EQ(co_await redis.hset("coro_hash", "field", std::string("a\0b", 3)), 1);
+    EXPECT_EQ(co_await redis.hset("coro_hash", "field", "c"), 0);
+    EXPECT_EQ(co_await redis.hget("coro_hash", "field"), std::optional<std::string>("c"));
+    EXPECT_EQ(co_await redis.hget("coro_hash", "other"), std::nullopt);
+
+    EXPECT_TRUE(co_await redis.expire("coro_counter", 60));
+    EXPECT_FALSE(co_await redis.expire("coro_missing", 60));
+    EXPECT_EQ(co_await redis.publish("coro_channel", "hello"), 0);
+
+    co_await deleteKey(redis, "coro_counter");
+    co_await deleteKey(redis, "coro_hash");
+}
+
+Task<void> incrementTwice(RedisCoroutineClient& redis, std::atomic<int>& failures) {
+    try {
+        co_await redis.incrBy("coro_concurrent", 1);
+        co_await redis.incrBy("coro_concurrent", 1);
+    } catch (const std::exception&) {
+        ++failures;
+    }
+}
+
+Task<void> useLease(RedisCoroutineClient& redis, std::atomic<int>& holders, std::atomic<int>& max_holders) {
+    ConnectionLease lease = co_await redis.lease();
+    int now = ++holders;
+    int seen = max_holders.load();
+    while (now > seen && !max_holders.compare_exchange_weak(seen, now)) {
+    }
+    // Commands on one lease run in order on its connection.
+    long long first = co_await lease.incrBy("coro_leased", 1);
+    long long second = co_await lease.incrBy("coro_leased", 1);
+    EXPECT_GT(second, first);
+    --holders;
+}
+
+Task<std::string> wrongType(RedisCoroutineClient& redis) {
+    co_await deleteKey(redis, "coro_wrong_type");
+    co_await redis.hset("coro_wrong_type", "field", "value");
+    std::string message;
+    try {
+        co_await redis.incrBy("coro_wrong_type", 1);
+    } catch (const std::runtime_error& e) {
+        message = e.what();
+    }
+    co_await deleteKey(redis, "coro_wrong_type");
+    co_return message;
+}
+
+Task<long long> failingTask(RedisCoroutineClient& redis) {
+    co_await redis.hset("coro_wrong_type", "field", "value");
+    long long value = co_await redis.incrBy("coro_wrong_type", 1);
+    co_return value;
+}
+
+} // namespace
+
+TEST(RedisCoroutinesTest, BasicOperations) {
+    auto executor = std::make_shared<CoroutineExecutor>();
+    RedisCoroutineClient redis(makeEngine(), executor);
+    syncWait(*executor, basicOperations(redis));
+}
+
+TEST(RedisCoroutinesTest, ThousandsOfConcurrentCoroutines) {
+    auto executor = std::make_shared<CoroutineExecutor>(2);
+    RedisCoroutineClient redis(makeEngine(2), executor);
+    syncWait(*executor, deleteKey(redis, "coro_concurrent"));
+
+    const int coroutines = 5000;
+    std::atomic<int> failures{0};
+    for (int i = 0; i < coroutines; ++i) {
+        executor->spawn(incrementTwice(redis, failures));
+    }
+    executor->waitIdle();
+
+    EXPECT_EQ(failures.load(), 0);
+    EXPECT_EQ(syncWait(*executor, readCounter(redis, "coro_concurrent")), 2 * coroutines);
+    syncWait(*executor, deleteKey(redis, "coro_concurrent"));
+}
+
+TEST(RedisCoroutinesTest, LeaseExhaustionSuspendsInsteadOfBlocking) {
+    // A single worker thread: a lease() that blocked the thread would
+    // deadlock, since the holders could never be resumed to release.
+    auto executor = std::make_shared<CoroutineExecutor>(1);
+    CoroutineClientOptions options;
+    options.max_leases = 2;
+    RedisCoroutineClient redis(makeEngine(2), executor, options);
+    syncWait(*executor, deleteKey(redis, "coro_leased"));
+
+    std::atomic<int> holders{0};
+    std::atomic<int> max_holders{0};
+    for (int i = 0; i < 20; ++i) {
+        executor->spawn(useLease(redis, holders, max_holders));
+    }
+    executor->waitIdle();
+
+    EXPECT_EQ(max_holders.load(), 2);
+    EXPECT_EQ(redis.availableLeases(), 2u);
+    EXPECT_EQ(redis.leaseWaiters(), 0u);
+    EXPECT_EQ(syncWait(*executor, readCounter(redis, "coro_leased")), 40);
+    syncWait(*executor, deleteKey(redis, "coro_leased"));
+}
+
+TEST(RedisCoroutinesTest, ErrorsPropagateToTheAwaiter) {
+    auto executor = std::make_shared<CoroutineExecutor>();
+    RedisCoroutineClient redis(makeEngine(), executor);
+
+    EXPECT_NE(syncWait(*executor, wrongType(redis)).find("WRONGTYPE"), std::string::npos);
+    EXPECT_THROW(syncWait(*executor, failingTask(redis)), std::runtime_error);
+    syncWait(*executor, deleteKey(redis, "coro_wrong_type"));
+}
@@ -1,50 +1,168 @@
 #include "rollback_manager.h"
 #include "connection_pool_manager/redis_connection_guard.h"
 #include <hiredis/hiredis.h>
+#include <algorithm>
 #include <chrono>
 #include <stdexcept>
 
-RollbackManager::RollbackManager(std::shared_ptr<ConnectionPoolManager> pool_manager)
-    : pool_manager_(std::move(pool_manager)) {}
+namespace {
 
-std::string RollbackManager::saveSnapshot(const std::string& config_name, const json& config_data) {
-    RedisConnectionGuard guard(pool_manager_.get());
-    redisContext* context = guard.getContext();
-
-    long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
-        std::chrono::system_clock::now().time_since_epoch()).count();
-    std::string timestamp_str = std::to_string(timestamp);
+constexpr char kDeltaPrefix = '~';
+const std::string kChainPrefix = "~chain:";
 
-    redisReply* reply = (redisReply*)redisCommand(context, "HSET %s %s %s",
-        config_name.c_str(), timestamp_str.c_str(), config_data.dump().c_str());
+using ReplyPtr = std::unique_ptr<redisReply, decltype(&freeReplyObject)>;
 
+// Runs a command on context; failures throw runtime_error prefixed by what.
+ReplyPtr runCommand(redisContext* context, const std::vector<std::string>& args, const std::string& what) {
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+    ReplyPtr reply((redisReply*)redisCommandArgv(context, static_cast<int>(argv.size()), argv.data(),
+                                                 argvlen.data()), freeReplyObject);
     if (!reply) {
-        throw std::runtime_error("Failed to save snapshot: " + std::string(context->errstr));
+        throw std::runtime_error(what + std::string(context->errstr));
+    }
+    if (reply->type == REDIS_REPLY_ERROR) {
+        throw std::runtime_error(what + std::string(reply->str, reply->len));
     }
+    return reply;
+}
 
-    freeReplyObject(reply);
-    return timestamp_str;
+// Elements of an array reply; nullopt for nil elements.
+std::vector<std::optional<std::string>> replyStrings(const redisReply* reply) {
+    std::vector<std::optional<std::string>> values;
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        values.reserve(reply->elements);
+        for (size_t i = 0; i < reply->elements; ++i) {
+            const redisReply* element = reply->element[i];
+            if (element->type == REDIS_REPLY_NIL) {
+                values.emplace_back();
+            } else {
+                values.emplace_back(std::string(element->str, element->len));
+            }
+        }
+    }
+    return values;
 }
 
-json RollbackManager::getSnapshot(const std::string& config_name, const std::string& timestamp) {
-    RedisConnectionGuard guard(pool_manager_.get());
-    redisContext* context = guard.getContext();
+bool isDelta(const std::string& record) {
+    return !record.empty() && record[0] == kDeltaPrefix;
+}
 
-    redisReply* reply = (redisReply*)redisCommand(context, "HGET %s %s",
-        config_name.c_str(), timestamp.c_str());
+bool isChainField(const std::string& field) {
+    return field.compare(0, kChainPrefix.size(), kChainPrefix) == 0;
+}
 
-    if (!reply) {
-        throw std::runtime_error("Failed to get snapshot: " + std::string(context->errstr));
+std::string chainField(const std::string& timestamp) {
+    return kChainPrefix + timestamp;
+}
+
+std::vector<std::string> splitChain(const std::string& chain) {
+    std::vector<std::string> ids;
+    size_t start = 0;
+    while (start < chain.size()) {
+        size_t end = chain.find(',', start);
+        if (end == std::string::npos) {
+            end = chain.size();
+        }
+        ids.push_back(chain.substr(start, end - start));
+        start = end + 1;
+    }
+    return ids;
+}
+
+std::string joinChain(std::vector<std::string>::const_iterator begin, std::vector<std::string>::const_iterator end) {
+    std::string chain;
+    for (auto it = begin; it != end; ++it) {
+        if (!chain.empty()) {
+            chain.push_back(',');
+        }
+        chain += *it;
+    }
+    return chain;
+}
+
+std::vector<std::string> snapshotFields(const std::vector<std::optional<std::string>>& fields) {
+    std::vector<std::string> snapshots;
+    for (const auto& field : fields) {
+        if (field && !isChainField(*field)) {
+            snapshots.push_back(*field);
+        }
+    }
+    return snapshots;
+}
+
+} // namespace
+
+// State shared by the steps of deleteSnapshotAsync().
+struct RollbackManager::AsyncDelete {
+    std::string config_name;
+    std::string timestamp;
+    AsyncCallback<void> callback;
+    DeletePlan plan;
+    std::vector<std::vector<std::string>> commands;
+
+    std::mutex mutex; // Guards the fields below while children are rebuilt
+    std::vector<json> children;
+    size_t remaining = 0;
+    std::exception_ptr error;
+};
+
+RollbackManager::RollbackManager(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                                 std::shared_ptr<AsyncCommandEngine> async_engine,
+                                 const RollbackOptions& options)
+    : pool_manager_(std::move(pool_manager)), async_engine_(std::move(async_engine)), options_(options),
+      cache_(options.snapshot_cache_size) {
+    if (options_.keyframe_interval == 0) {
+        throw std::invalid_argument("RollbackManager keyframe_interval must be at least 1");
+    }
+}
+
+std::string RollbackManager::saveSnapshot(const std::string& config_name, const json& config_data) {
+    PreparedSave save = prepareSave(config_name, config_data);
+    {
+        RedisConnectionGuard guard(pool_manager_.get());
+        runCommand(guard.getContext(), save.command, "Failed to save snapshot: ");
     }
+    commitSave(config_name, save);
+    return save.timestamp;
+}
 
-    if (reply->type == REDIS_REPLY_NIL) {
-        freeReplyObject(reply);
+json RollbackManager::getSnapshot(const std::string& config_name, const std::string& timestamp) {
+    // The connection goes back to the pool between the two round trips.
+    std::vector<std::optional<std::string>> values;
+    {
+        RedisConnectionGuard guard(pool_manager_.get());
+        ReplyPtr reply = runCommand(guard.getContext(), {"HMGET", config_name, timestamp, chainField(timestamp)},
+                                    "Failed to get snapshot: ");
+        values = replyStrings(reply.get());
+    }
+    if (values.size() != 2 || !values[0]) {
         return json{};
     }
+    if (auto cached = cache_.get(config_name, timestamp)) {
+        cache_hits_.fetch_add(1, std::memory_order_relaxed);
+        return *cached;
+    }
+    const std::string& record = *values[0];
+    if (!isDelta(record)) {
+        return readKeyframe(config_name, timestamp, record);
+    }
 
-    json snapshot = json::parse(reply->str);
-    freeReplyObject(reply);
-    return snapshot;
+    std::shared_ptr<const json> start;
+    std::vector<std::string> ids = planRebuild(config_name, values[1], start);
+    std::vector<std::optional<std::string>> records;
+    if (!ids.empty()) {
+        std::vector<std::string> args = {"HMGET", config_name};
+        args.insert(args.end(), ids.begin(), ids.end());
+        RedisConnectionGuard guard(pool_manager_.get());
+        ReplyPtr reply = runCommand(guard.getContext(), args, "Failed to get snapshot: ");
+        records = replyStrings(reply.get());
+    }
+    return rebuild(config_name, timestamp, record, ids, records, std::move(start));
 }
 
 std::vector<std::string> RollbackManager::listSnapshots(const std::string& config_name) {
@@ -57,27 +175,441 @@ std::vector<std::string> RollbackManager::listSnapshots(const std::string& confi
         throw std::runtime_error("Failed to list snapshots: " + std::string(context->errstr));
     }
 
-    std::vector<std::string> snapshots;
-    if (reply->type == REDIS_REPLY_ARRAY) {
-        for (size_t i = 0; i < reply->elements; ++i) {
-            snapshots.push_back(reply->element[i]->str);
-        }
-    }
-
+    std::vector<std::string> snapshots = snapshotFields(replyStrings(reply));
     freeReplyObject(reply);
     return snapshots;
 }
 
 void RollbackManager::deleteSnapshot(const std::string& config_name, const std::string& timestamp) {
+    std::vector<std::string> chain_fields;
+    std::vector<std::optional<std::string>> chains;
+    {
+        RedisConnectionGuard guard(pool_manager_.get());
+        ReplyPtr keys = runCommand(guard.getContext(), {"HKEYS", config_name}, "Failed to delete snapshot: ");
+        for (auto& field : replyStrings(keys.get())) {
+            if (field && isChainField(*field)) {
+                chain_fields.push_back(std::move(*field));
+            }
+        }
+        if (!chain_fields.empty()) {
+            std::vector<std::string> args = {"HMGET", config_name};
+            args.insert(args.end(), chain_fields.begin(), chain_fields.end());
+            chains = replyStrings(runCommand(guard.getContext(), args, "Failed to delete snapshot: ").get());
+        }
+    }
+
+    DeletePlan plan = planDelete(timestamp, chain_fields, chains);
+    std::vector<json> children;
+    for (const auto& child : plan.children) {
+        children.push_back(getSnapshot(config_name, child));
+    }
+
     RedisConnectionGuard guard(pool_manager_.get());
-    redisContext* context = guard.getContext();
+    for (const auto& command : deleteCommands(config_name, timestamp, plan, children)) {
+        runCommand(guard.getContext(), command, "Failed to delete snapshot: ");
+    }
+    forgetSnapshot(config_name, timestamp);
+}
 
-    redisReply* reply = (redisReply*)redisCommand(context, "HDEL %s %s",
-        config_name.c_str(), timestamp.c_str());
+std::future<std::string> RollbackManager::saveSnapshotAsync(const std::string& config_name, const json& config_data) {
+    return asyncToFuture<std::string>([&](AsyncCallback<std::string> callback) {
+        saveSnapshotAsync(config_name, config_data, std::move(callback));
+    });
+}
 
-    if (!reply) {
-        throw std::runtime_error("Failed to delete snapshot: " + std::string(context->errstr));
+void RollbackManager::saveSnapshotAsync(const std::string& config_name, const json& config_data,
+                                        AsyncCallback<std::string> callback) {
+    AsyncCommandEngine& engine = asyncEngine();
+    auto save = std::make_shared<PreparedSave>(prepareSave(config_name, config_data));
+    engine.command(save->command, [this, config_name, save, callback](const redisReply*, std::exception_ptr error) {
+        if (!error) {
+            commitSave(config_name, *save);
+        }
+        callback(error ? std::string() : save->timestamp, error);
+    });
+}
+
+std::future<json> RollbackManager::getSnapshotAsync(const std::string& config_name, const std::string& timestamp) {
+    return asyncToFuture<json>([&](AsyncCallback<json> callback) {
+        getSnapshotAsync(config_name, timestamp, std::move(callback));
+    });
+}
+
+void RollbackManager::getSnapshotAsync(const std::string& config_name, const std::string& timestamp,
+                                       AsyncCallback<json> callback) {
+    asyncEngine().command({"HMGET", config_name, timestamp, chainField(timestamp)},
+                          [this, config_name, timestamp, callback](const redisReply* reply, std::exception_ptr error) {
+        json snapshot;
+        std::vector<std::string> args;
+        std::vector<std::string> ids;
+        std::shared_ptr<const json> start;
+        std::string record;
+        if (!error) {
+            try {
+                std::vector<std::optional<std::string>> values = replyStrings(reply);
+                if (values.size() == 2 && values[0]) {
+                    record = std::move(*values[0]);
+                    if (auto cached = cache_.get(config_name, timestamp)) {
+                        cache_hits_.fetch_add(1, std::memory_order_relaxed);
+                        snapshot = *cached;
+                    } else if (!isDelta(record)) {
+                        snapshot = readKeyframe(config_name, timestamp, record);
+                    } else {
+                        ids = planRebuild(config_name, values[1], start);
+                        if (ids.empty()) {
+                            snapshot = rebuild(config_name, timestamp, record, ids, {}, start);
+                        } else {
+                            args = {"HMGET", config_name};
+                            args.insert(args.end(), ids.begin(), ids.end());
+                        }
+                    }
+                }
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        if (error || args.empty()) {
+            callback(error ? json{} : std::move(snapshot), error);
+            return;
+        }
+
+        // A delta whose chain is not cached: fetch the rest of the chain.
+        try {
+            asyncEngine().command(args, [this, config_name, timestamp, record, ids, start, callback](
+                                            const redisReply* reply, std::exception_ptr error) {
+                json snapshot;
+                if (!error) {
+                    try {
+                        snapshot = rebuild(config_name, timestamp, record, ids, replyStrings(reply), start);
+                    } catch (...) {
+                        error = std::current_exception();
+                    }
+                }
+                callback(error ? json{} : std::move(snapshot), error);
+            });
+        } catch (...) {
+            callback(json{}, std::current_exception());
+        }
+    });
+}
+
+std::future<std::vector<std::string>> RollbackManager::listSnapshotsAsync(const std::string& config_name) {
+    return asyncToFuture<std::vector<std::string>>([&](AsyncCallback<std::vector<std::string>> callback) {
+        listSnapshotsAsync(config_name, std::move(callback));
+    });
+}
+
+void RollbackManager::listSnapshotsAsync(const std::string& config_name,
+                                         AsyncCallback<std::vector<std::string>> callback) {
+    asyncEngine().command({"HKEYS", config_name}, [callback](const redisReply* reply, std::exception_ptr error) {
+        std::vector<std::string> snapshots;
+        if (!error) {
+            snapshots = snapshotFields(replyStrings(reply));
+        }
+        callback(std::move(snapshots), error);
+    });
+}
+
+std::future<void> RollbackManager::deleteSnapshotAsync(const std::string& config_name, const std::string& timestamp) {
+    return asyncToFuture<void>([&](AsyncCallback<void> callback) {
+        deleteSnapshotAsync(config_name, timestamp, std::move(callback));
+    });
+}
+
+void RollbackManager::deleteSnapshotAsync(const std::string& config_name, const std::string& timestamp,
+                                          AsyncCallback<void> callback) {
+    auto state = std::make_shared<AsyncDelete>();
+    state->config_name = config_name;
+    state->timestamp = timestamp;
+    state->callback = std::move(callback);
+
+    // Rebuilds the children in parallel, then writes them back as keyframes.
+    auto rewrite = [this, state] {
+        if (state->plan.children.empty()) {
+            state->commands = deleteCommands(state->config_name, state->timestamp, state->plan, {});
+            deleteStepAsync(state, 0);
+            return;
+        }
+        state->children.resize(state->plan.children.size());
+        state->remaining = state->plan.children.size();
+        for (size_t i = 0; i < state->plan.children.size(); ++i) {
+            getSnapshotAsync(state->config_name, state->plan.children[i],
+                             [this, state, i](json document, std::exception_ptr error) {
+                std::exception_ptr failure;
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->children[i] = std::move(document);
+                    if (error && !state->error) {
+                        state->error = error;
+                    }
+                    if (--state->remaining > 0) {
+                        return;
+                    }
+                    failure = state->error;
+                }
+                if (failure) {
+                    state->callback(failure);
+                    return;
+                }
+                state->commands = deleteCommands(state->config_name, state->timestamp, state->plan,
+                                                 state->children);
+                deleteStepAsync(state, 0);
+            });
+        }
+    };
+
+    asyncEngine().command({"HKEYS", config_name}, [this, state, rewrite](const redisReply* reply,
+                                                                          std::exception_ptr error) {
+        if (error) {
+            state->callback(error);
+            return;
+        }
+        std::vector<std::string> chain_fields;
+        for (auto& field : replyStrings(reply)) {
+            if (field && isChainField(*field)) {
+                chain_fields.push_back(std::move(*field));
+            }
+        }
+        if (chain_fields.empty()) {
+            rewrite();
+            return;
+        }
+        std::vector<std::string> args = {"HMGET", state->config_name};
+        args.insert(args.end(), chain_fields.begin(), chain_fields.end());
+        asyncEngine().command(args, [state, chain_fields, rewrite](const redisReply* reply,
+                                                                   std::exception_ptr error) {
+            if (error) {
+                state->callback(error);
+                return;
+            }
+            state->plan = planDelete(state->timestamp, chain_fields, replyStrings(reply));
+            rewrite();
+        });
+    });
+}
+
+RollbackStats RollbackManager::stats() const {
+    RollbackStats stats;
+    stats.keyframes_saved = keyframes_saved_.load(std::memory_order_relaxed);
+    stats.deltas_saved = deltas_saved_.load(std::memory_order_relaxed);
+    stats.patches_applied = patches_applied_.load(std::memory_order_relaxed);
+    stats.cache_hits = cache_hits_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+AsyncCommandEngine& RollbackManager::asyncEngine() {
+    if (!async_engine_) {
+        throw std::runtime_error("RollbackManager was created without an async engine");
     }
+    return *async_engine_;
+}
 
-    freeReplyObject(reply);
+RollbackManager::PreparedSave RollbackManager::prepareSave(const std::string& config_name, const json& config_data) {
+    long long timestamp = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    Head base;
+    {
+        std::lock_guard<std::mutex> lock(heads_mutex_);
+        Head& head = heads_[config_name];
+        // Timestamps name the snapshots, so two saves never share one.
+        timestamp = std::max(timestamp, head.reserved + 1);
+        head.reserved = timestamp;
+        base = head;
+    }
+
+    PreparedSave save;
+    save.timestamp = std::to_string(timestamp);
+    save.document = std::make_shared<const json>(config_data);
+    std::string record = config_data.dump();
+    // The diff runs outside the lock; it is the expensive part of a save.
+    if (base.document && base.chain.size() + 1 < options_.keyframe_interval) {
+        std::string patch = kDeltaPrefix + json::diff(*base.document, config_data).dump();
+        if (patch.size() <= options_.max_delta_ratio * record.size()) {
+            record = std::move(patch);
+            save.chain = base.chain;
+            save.chain.push_back(std::to_string(base.timestamp));
+        }
+    }
+
+    save.command = {"HSET", config_name, save.timestamp, std::move(record)};
+    if (!save.chain.empty()) {
+        save.command.push_back(chainField(save.timestamp));
+        save.command.push_back(joinChain(save.chain.begin(), save.chain.end()));
+    }
+    return save;
+}
+
+void RollbackManager::commitSave(const std::string& config_name, const PreparedSave& save) {
+    if (save.chain.empty()) {
+        keyframes_saved_.fetch_add(1, std::memory_order_relaxed);
+        cache_.put(config_name, save.timestamp, save.document);
+    } else {
+        deltas_saved_.fetch_add(1, std::memory_order_relaxed);
+    }
+    long long timestamp = std::stoll(save.timestamp);
+    std::lock_guard<std::mutex> lock(heads_mutex_);
+    Head& head = heads_[config_name];
+    // Concurrent saves may complete out of order; the newest stays the base.
+    if (!head.document || timestamp > head.timestamp) {
+        head.timestamp = timestamp;
+        head.chain = save.chain;
+        head.document = save.document;
+    }
+}
+
+std::vector<std::string> RollbackManager::planRebuild(const std::string& config_name,
+                                                      const std::optional<std::string>& chain,
+                                                      std::shared_ptr<const json>& start) {
+    if (!chain) {
+        throw std::runtime_error("Snapshot chain missing for a delta of " + config_name);
+    }
+    std::vector<std::string> ids = splitChain(*chain);
+    // Replay from the newest snapshot of the chain already in memory.
+    for (size_t i = ids.size(); i > 0; --i) {
+        if ((start = cache_.get(config_name, ids[i - 1]))) {
+            cache_hits_.fetch_add(1, std::memory_order_relaxed);
+            ids.erase(ids.begin(), ids.begin() + i);
+            break;
+        }
+    }
+    return ids;
+}
+
+json RollbackManager::rebuild(const std::string& config_name, const std::string& timestamp, const std::string& record,
+                              const std::vector<std::string>& ids,
+                              const std::vector<std::optional<std::string>>& records,
+                              std::shared_ptr<const json> start) {
+    if (records.size() != ids.size()) {
+        throw std::runtime_error("Unexpected reply while rebuilding snapshot " + timestamp);
+    }
+    // Replay from the newest keyframe fetched. Deleting a snapshot turns its
+    // children into keyframes, so a chain recorded before another manager
+    // deleted one of its links still resolves past the gap.
+    json document;
+    size_t next = ids.size();
+    while (next > 0 && !(records[next - 1] && !isDelta(*records[next - 1]))) {
+        --next;
+    }
+    if (next > 0) {
+        document = json::parse(*records[next - 1]);
+    } else if (start) {
+        document = *start;
+    } else {
+        throw std::runtime_error("Snapshot chain of " + timestamp + " in " + config_name +
+                                 " has no keyframe left");
+    }
+    for (; next < ids.size(); ++next) {
+        if (!records[next]) {
+            throw std::runtime_error("Snapshot " + ids[next] + " of " + config_name + " is missing; " +
+                                     timestamp + " builds on it");
+        }
+        const std::string& link = *records[next];
+        document.patch_inplace(json::parse(link.begin() + 1, link.end()));
+        patches_applied_.fetch_add(1, std::memory_order_relaxed);
+    }
+    document.patch_inplace(json::parse(record.begin() + 1, record.end()));
+    patches_applied_.fetch_add(1, std::memory_order_relaxed);
+
+    cache_.put(config_name, timestamp, std::make_shared<const json>(document));
+    return document;
+}
+
+json RollbackManager::readKeyframe(const std::string& config_name, const std::string& timestamp,
+                                   const std::string& record) {
+    auto document = std::make_shared<const json>(json::parse(record));
+    cache_.put(config_name, timestamp, document);
+    return *document;
+}
+
+RollbackManager::DeletePlan RollbackManager::planDelete(const std::string& timestamp,
+                                                        const std::vector<std::string>& chain_fields,
+                                                        const std::vector<std::optional<std::string>>& chains) {
+    DeletePlan plan;
+    for (size_t i = 0; i < chain_fields.size() && i < chains.size(); ++i) {
+        if (!chains[i]) {
+            continue;
+        }
+        std::vector<std::string> ids = splitChain(*chains[i]);
+        auto it = std::find(ids.begin(), ids.end(), timestamp);
+        if (it == ids.end()) {
+            continue;
+        }
+        std::string dependent = chain_fields[i].substr(kChainPrefix.size());
+        if (it + 1 == ids.end()) {
+            plan.children.push_back(std::move(dependent));
+        } else {
+            plan.rechained.emplace_back(std::move(dependent), joinChain(it + 1, ids.end()));
+        }
+    }
+    return plan;
+}
+
+std::vector<std::vector<std::string>> RollbackManager::deleteCommands(const std::string& config_name,
+                                                                      const std::string& timestamp,
+                                                                      const DeletePlan& plan,
+                                                                      const std::vector<json>& children) {
+    // Dependents are made readable without the snapshot before it goes, so
+    // a reader sees either the old chains or the new ones.
+    std::vector<std::vector<std::string>> commands;
+    std::vector<std::string> hset = {"HSET", config_name};
+    for (size_t i = 0; i < plan.children.size(); ++i) {
+        hset.push_back(plan.children[i]);
+        hset.push_back(children[i].dump());
+    }
+    for (const auto& [dependent, chain] : plan.rechained) {
+        hset.push_back(chainField(dependent));
+        hset.push_back(chain);
+    }
+    if (hset.size() > 2) {
+        commands.push_back(std::move(hset));
+    }
+
+    std::vector<std::string> hdel = {"HDEL", config_name, timestamp, chainField(timestamp)};
+    for (const auto& child : plan.children) {
+        hdel.push_back(chainField(child));
+    }
+    commands.push_back(std::move(hdel));
+    return commands;
+}
+
+void RollbackManager::forgetSnapshot(const std::string& config_name, const std::string& timestamp) {
+    cache_.erase(config_name, timestamp);
+    std::lock_guard<std::mutex> lock(heads_mutex_);
+    auto it = heads_.find(config_name);
+    if (it == heads_.end() || !it->second.document) {
+        return;
+    }
+    Head& head = it->second;
+    if (std::to_string(head.timestamp) == timestamp) {
+        // The next save is a keyframe.
+        head.document.reset();
+        head.chain.clear();
+        return;
+    }
+    auto link = std::find(head.chain.begin(), head.chain.end(), timestamp);
+    if (link != head.chain.end()) {
+        head.chain.erase(head.chain.begin(), link + 1);
+    }
+}
+
+void RollbackManager::deleteStepAsync(std::shared_ptr<AsyncDelete> state, size_t command) {
+    if (command == state->commands.size()) {
+        forgetSnapshot(state->config_name, state->timestamp);
+        state->callback(nullptr);
+        return;
+    }
+    // One command at a time: the engine does not order commands on
+    // different connections.
+    try {
+        asyncEngine().command(state->commands[command], [this, state, command](const redisReply*,
+                                                                               std::exception_ptr error) {
+            if (error) {
+                state->callback(error);
+                return;
+            }
+            deleteStepAsync(state, command + 1);
+        });
+    } catch (...) {
+        state->callback(std::current_exception());
+    }
 }
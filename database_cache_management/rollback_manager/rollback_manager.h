@@ -4,22 +4,145 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <cstdint>
+#include <unordered_map>
 #include <connection_pool_manager/connection_pool_manager.h>
+#include <async_command_engine/async_command_engine.h>
 #include <nlohmann/json.hpp>
+#include "snapshot_cache.h"
 
 using json = nlohmann::json;
 
+struct RollbackOptions {
+    // Every keyframe_interval-th snapshot of a config is stored in full (a
+    // keyframe); the ones in between as a JSON Patch (RFC 6902) against the
+    // snapshot saved before them. 1 stores every snapshot in full.
+    size_t keyframe_interval = 16;
+    // A patch longer than this fraction of the full document is stored as
+    // a keyframe instead.
+    double max_delta_ratio = 0.5;
+    // Snapshots kept parsed in memory after a read or rebuild, least
+    // recently used out first. A rebuild replays from the newest cached
+    // snapshot of its chain instead of fetching the keyframe.
+    size_t snapshot_cache_size = 8;
+};
+
+struct RollbackStats {
+    uint64_t keyframes_saved = 0;
+    uint64_t deltas_saved = 0;
+    uint64_t patches_applied = 0; // While rebuilding snapshots
+    uint64_t cache_hits = 0;      // Reads served or replayed from a cached snapshot
+};
+
+// Timestamped JSON config snapshots, one Redis hash per config.
+//
+// Snapshots are delta-encoded. A keyframe field holds the full document; a
+// delta field holds "~" and a JSON Patch against its base, and the field
+// "~chain:<timestamp>" lists the snapshots it builds on, keyframe first.
+// Both are written by one HSET, so readers never see half a delta.
+// getSnapshot() fetches the chain with one HMGET and replays it;
+// listSnapshots() hides the chain fields. Deleting a snapshot that others
+// build on first turns its direct dependents into keyframes. Snapshots
+// written before delta encoding read as keyframes.
+//
+// A manager diffs against the last snapshot it saved of the config (and
+// keeps that document in memory), so its first save of a config is a
+// keyframe. A snapshot deleted by another manager while this one saves a
+// delta against it leaves that delta unreadable.
 class RollbackManager {
 public:
-    explicit RollbackManager(std::shared_ptr<ConnectionPoolManager> pool_manager);
+    // The async engine is optional; without it the *Async operations throw.
+    explicit RollbackManager(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                             std::shared_ptr<AsyncCommandEngine> async_engine = nullptr,
+                             const RollbackOptions& options = RollbackOptions());
+
+    // Deleted copy and move constructors/assignments
+    RollbackManager(const RollbackManager&) = delete;
+    RollbackManager& operator=(const RollbackManager&) = delete;
+    RollbackManager(RollbackManager&&) = delete;
+    RollbackManager& operator=(RollbackManager&&) = delete;
 
     std::string saveSnapshot(const std::string& config_name, const json& config_data);
     json getSnapshot(const std::string& config_name, const std::string& timestamp);
     std::vector<std::string> listSnapshots(const std::string& config_name);
     void deleteSnapshot(const std::string& config_name, const std::string& timestamp);
 
+    // Non-blocking variants on the async engine. Callbacks run on an engine
+    // event loop thread and must not block; the manager must outlive them.
+    std::future<std::string> saveSnapshotAsync(const std::string& config_name, const json& config_data);
+    void saveSnapshotAsync(const std::string& config_name, const json& config_data,
+                           AsyncCallback<std::string> callback);
+    std::future<json> getSnapshotAsync(const std::string& config_name, const std::string& timestamp);
+    void getSnapshotAsync(const std::string& config_name, const std::string& timestamp,
+                          AsyncCallback<json> callback);
+    std::future<std::vector<std::string>> listSnapshotsAsync(const std::string& config_name);
+    void listSnapshotsAsync(const std::string& config_name, AsyncCallback<std::vector<std::string>> callback);
+    std::future<void> deleteSnapshotAsync(const std::string& config_name, const std::string& timestamp);
+    void deleteSnapshotAsync(const std::string& config_name, const std::string& timestamp,
+                             AsyncCallback<void> callback);
+
+    RollbackStats stats() const;
+
 private:
+    // A snapshot ready to be written.
+    struct PreparedSave {
+        std::string timestamp;
+        std::vector<std::string> command; // The HSET
+        std::vector<std::string> chain;   // Empty for a keyframe
+        std::shared_ptr<const json> document;
+    };
+
+    // What deleting a snapshot does to the snapshots built on it.
+    struct DeletePlan {
+        std::vector<std::string> children; // Built directly on it; become keyframes
+        // Deeper dependents and their chains, which now start at a child.
+        std::vector<std::pair<std::string, std::string>> rechained;
+    };
+
+    // The last snapshot this manager saved of a config.
+    struct Head {
+        long long reserved = 0; // Newest timestamp handed to a save
+        long long timestamp = 0;
+        std::vector<std::string> chain;
+        std::shared_ptr<const json> document;
+    };
+
+    struct AsyncDelete;
+
+    AsyncCommandEngine& asyncEngine();
+    PreparedSave prepareSave(const std::string& config_name, const json& config_data);
+    void commitSave(const std::string& config_name, const PreparedSave& save);
+    std::vector<std::string> planRebuild(const std::string& config_name, const std::optional<std::string>& chain,
+                                         std::shared_ptr<const json>& start);
+    json rebuild(const std::string& config_name, const std::string& timestamp, const std::string& record,
+                 const std::vector<std::string>& ids, const std::vector<std::optional<std::string>>& records,
+                 std::shared_ptr<const json> start);
+    json readKeyframe(const std::string& config_name, const std::string& timestamp, const std::string& record);
+    static DeletePlan planDelete(const std::string& timestamp, const std::vector<std::string>& chain_fields,
+                                 const std::vector<std::optional<std::string>>& chains);
+    static std::vector<std::vector<std::string>> deleteCommands(const std::string& config_name,
+                                                                const std::string& timestamp,
+                                                                const DeletePlan& plan,
+                                                                const std::vector<json>& children);
+    void forgetSnapshot(const std::string& config_name, const std::string& timestamp);
+    void deleteStepAsync(std::shared_ptr<AsyncDelete> state, size_t command);
+
     std::shared_ptr<ConnectionPoolManager> pool_manager_;
+    std::shared_ptr<AsyncCommandEngine> async_engine_;
+    const RollbackOptions options_;
+
+    std::mutex heads_mutex_;
+    std::unordered_map<std::string, Head> heads_;
+    SnapshotCache cache_;
+
+    std::atomic<uint64_t> keyframes_saved_{0};
+    std::atomic<uint64_t> deltas_saved_{0};
+    std::atomic<uint64_t> patches_applied_{0};
+    std::atomic<uint64_t> cache_hits_{0};
 };
 
 #endif // ROLLBACK_MANAGER_H
@@ -0,0 +1,88 @@
+#ifndef SNAPSHOT_CACHE_H
+#define SNAPSHOT_CACHE_H
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <unordered_map>
+#include <cstddef>
+#include <nlohmann/json.hpp>
+
+// Thread-safe LRU cache of parsed snapshots, keyed by config name and
+// timestamp. Documents are shared, so a hit costs no copy until the caller
+// makes one.
+class SnapshotCache {
+public:
+    explicit SnapshotCache(size_t capacity) : capacity_(capacity) {}
+
+    // Deleted copy and move constructors/assignments
+    SnapshotCache(const SnapshotCache&) = delete;
+    SnapshotCache& operator=(const SnapshotCache&) = delete;
+    SnapshotCache(SnapshotCache&&) = delete;
+    SnapshotCache& operator=(SnapshotCache&&) = delete;
+
+    std::shared_ptr<const nlohmann::json> get(const std::string& config_name, const std::string& timestamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key(config_name, timestamp));
+        if (it == index_.end()) {
+            return nullptr;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    void put(const std::string& config_name, const std::string& timestamp,
+             std::shared_ptr<const nlohmann::json> document) {
+        if (capacity_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string entry_key = key(config_name, timestamp);
+        auto it = index_.find(entry_key);
+        if (it != index_.end()) {
+            it->second->second = std::move(document);
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return;
+        }
+        entries_.emplace_front(entry_key, std::move(document));
+        index_.emplace(std::move(entry_key), entries_.begin());
+        if (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+    void erase(const std::string& config_name, const std::string& timestamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(key(config_name, timestamp));
+        if (it != index_.end()) {
+            entries_.erase(it->second);
+            index_.erase(it);
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const nlohmann::json>>;
+
+    static std::string key(const std::string& config_name, const std::string& timestamp) {
+        std::string entry_key;
+        entry_key.reserve(config_name.size() + timestamp.size() + 1);
+        entry_key.append(config_name).push_back('\0');
+        entry_key.append(timestamp);
+        return entry_key;
+    }
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::list<Entry> entries_; // Most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+#endif // SNAPSHOT_CACHE_H
@@ -5,6 +5,7 @@
 #include <vector>
 #include <thread>
 #include <chrono>
+#include <algorithm>
 
 class RollbackManagerTest : public ::testing::Test {
 protected:
@@ -60,3 +61,117 @@ TEST_F(RollbackManagerTest, GetNonExistentSnapshot) {
     json snapshot = rollback_manager->getSnapshot(config_name, "12345");
     ASSERT_TRUE(snapshot.is_null());
 }
+
+TEST_F(RollbackManagerTest, AsyncOperations) {
+    auto engine = std::make_shared<AsyncCommandEngine>(std::vector<std::string>{"127.0.0.1"});
+    RollbackManager manager(pool_manager, engine);
+    std::string config_name = "async_config";
+    json config_data = {{"key", "value"}, {"list", {1, 2, 3}}};
+
+    std::string timestamp = manager.saveSnapshotAsync(config_name, config_data).get();
+    EXPECT_EQ(manager.getSnapshotAsync(config_name, timestamp).get(), config_data);
+    EXPECT_TRUE(manager.getSnapshotAsync(config_name, "12345").get().is_null());
+
+    std::vector<std::string> snapshots = manager.listSnapshotsAsync(config_name).get();
+    ASSERT_EQ(snapshots.size(), 1);
+    EXPECT_EQ(snapshots[0], timestamp);
+
+    manager.deleteSnapshotAsync(config_name, timestamp).get();
+    EXPECT_TRUE(manager.getSnapshot(config_name, timestamp).is_null());
+}
+
+namespace {
+
+// A config of a few KB and one with a single entry changed.
+json largeConfig(int version) {
+    json config;
+    for (int i = 0; i < 100; ++i) {
+        config["vlan_" + std::to_string(i)] = {{"id", i}, {"ports", {"eth0", "eth1", "eth2"}}, {"mtu", 1500}};
+    }
+    config["vlan_" + std::to_string(version % 100)]["mtu"] = 9000 + version;
+    config["revision"] = version;
+    return config;
+}
+
+std::string rawSnapshot(ConnectionPoolManager* pool_manager, const std::string& config_name,
+                        const std::string& timestamp) {
+    RedisConnectionGuard guard(pool_manager);
+    redisReply* reply = (redisReply*)redisCommand(guard.getContext(), "HGET %s %s",
+                                                  config_name.c_str(), timestamp.c_str());
+    std::string record = reply->type == REDIS_REPLY_STRING ? std::string(reply->str, reply->len) : std::string();
+    freeReplyObject(reply);
+    return record;
+}
+
+} // namespace
+
+TEST_F(RollbackManagerTest, DeltaSnapshots) {
+    RollbackOptions options;
+    options.keyframe_interval = 4;
+    RollbackManager manager(pool_manager, nullptr, options);
+    std::string config_name = "delta_config";
+
+    std::vector<std::string> timestamps;
+    for (int version = 0; version < 6; ++version) {
+        timestamps.push_back(manager.saveSnapshot(config_name, largeConfig(version)));
+    }
+    size_t full_size = largeConfig(0).dump().size();
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+        std::string record = rawSnapshot(pool_manager.get(), config_name, timestamps[i]);
+        if (i % 4 == 0) {
+            EXPECT_EQ(json::parse(record), largeConfig(static_cast<int>(i)));
+        } else {
+            ASSERT_EQ(record[0], '~');
+            EXPECT_LT(record.size(), full_size / 10);
+        }
+    }
+    EXPECT_EQ(manager.stats().keyframes_saved, 2u);
+    EXPECT_EQ(manager.stats().deltas_saved, 4u);
+    EXPECT_EQ(manager.listSnapshots(config_name).size(), 6u);
+
+    // A manager with nothing cached replays each chain from its keyframe.
+    RollbackManager reader(pool_manager);
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+        EXPECT_EQ(reader.getSnapshot(config_name, timestamps[i]), largeConfig(static_cast<int>(i)));
+    }
+    RollbackStats stats = reader.stats();
+    EXPECT_GT(stats.patches_applied, 0u);
+    EXPECT_GT(stats.cache_hits, 0u);
+    EXPECT_EQ(reader.getSnapshot(config_name, timestamps[3]), largeConfig(3));
+    EXPECT_EQ(reader.stats().cache_hits, stats.cache_hits + 1);
+    EXPECT_EQ(reader.stats().patches_applied, stats.patches_applied);
+}
+
+TEST_F(RollbackManagerTest, DeletingABaseKeepsDependentsReadable) {
+    auto engine = std::make_shared<AsyncCommandEngine>(std::vector<std::string>{"127.0.0.1"});
+    RollbackManager writer(pool_manager);
+    RollbackManager other(pool_manager, engine);
+    std::string config_name = "delete_delta_config";
+
+    std::vector<std::string> timestamps;
+    for (int version = 0; version < 5; ++version) {
+        timestamps.push_back(writer.saveSnapshot(config_name, largeConfig(version)));
+    }
+
+    // Deleting the keyframe makes the next snapshot one.
+    writer.deleteSnapshot(config_name, timestamps[0]);
+    EXPECT_NE(rawSnapshot(pool_manager.get(), config_name, timestamps[1])[0], '~');
+    EXPECT_TRUE(writer.getSnapshot(config_name, timestamps[0]).is_null());
+
+    // Deleting a delta, here from another manager, asynchronously.
+    other.deleteSnapshotAsync(config_name, timestamps[2]).get();
+    EXPECT_NE(rawSnapshot(pool_manager.get(), config_name, timestamps[3])[0], '~');
+    EXPECT_EQ(other.getSnapshotAsync(config_name, timestamps[4]).get(), largeConfig(4));
+
+    // The writer still diffs against its last save, past the deleted link.
+    timestamps.push_back(writer.saveSnapshot(config_name, largeConfig(5)));
+    EXPECT_EQ(rawSnapshot(pool_manager.get(), config_name, timestamps[5])[0], '~');
+
+    RollbackManager reader(pool_manager);
+    for (size_t i : {1, 3, 4, 5}) {
+        EXPECT_EQ(reader.getSnapshot(config_name, timestamps[i]), largeConfig(static_cast<int>(i)));
+    }
+    std::vector<std::string> snapshots = reader.listSnapshots(config_name);
+    std::sort(snapshots.begin(), snapshots.end());
+    EXPECT_EQ(snapshots, (std::vector<std::string>{timestamps[1], timestamps[3], timestamps[4], timestamps[5]}));
+}
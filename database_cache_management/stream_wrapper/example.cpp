@@ -0,0 +1,25 @@
+#include <stream_wrapper/stream_wrapper.h>
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+int main() {
+    auto pool_manager = std::make_shared<ConnectionPoolManager>(std::vector<std::string>{"127.0.0.1"}, 5);
+    StreamOptions options;
+    options.max_length = 10000; // Keep roughly the last 10000 entries
+    StreamWrapper<std::string> streams(pool_manager, options);
+
+    // Entries survive consumer restarts; each is acknowledged once handled.
+    streams.consume("example_stream", "printers", "printer-1", [](const std::string& id, const std::string& msg) {
+        std::cout << "Received entry " << id << ": " << msg << std::endl;
+    });
+
+    streams.add("example_stream", "hello world");
+    streams.addBatch("example_stream", {"one", "two", "three"});
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    streams.stopConsuming("example_stream", "printers");
+
+    return 0;
+}
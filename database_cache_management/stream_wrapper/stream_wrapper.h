@@ -0,0 +1,677 @@
+#ifndef STREAM_WRAPPER_H
+#define STREAM_WRAPPER_H
+
+#include <string>
+#include <functional>
+#include <thread>
+#include <connection_pool_manager/connection_pool_manager.h>
+#include <connection_pool_manager/redis_connection_guard.h>
+#include <connection_pool_manager/batch_executor.h>
+#include <pub_sub_wrapper/serializers.h>
+#include <hiredis/hiredis.h>
+#include <iostream>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <map>
+#include <vector>
+#include <utility>
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+struct StreamOptions {
+    // XADD trims the stream to about this many entries (MAXLEN ~, so Redis
+    // only drops whole radix tree nodes and trimming stays cheap); 0 keeps
+    // every entry.
+    size_t max_length = 100000;
+    // Entries fetched per XREADGROUP. Their acknowledgements go out as one
+    // XACK pipelined with the next read, so a batch costs one round-trip.
+    size_t read_count = 128;
+    // How long XREADGROUP waits for new entries.
+    std::chrono::milliseconds block{1000};
+    // Where consume() starts a group it creates: "$" for entries added
+    // from then on, "0" for the whole stream.
+    std::string group_start_id = "$";
+    // Every claim_interval, entries that were delivered to some consumer
+    // of the group but not acknowledged for claim_min_idle (the consumer
+    // crashed, or the handler threw) are claimed and handled again.
+    std::chrono::milliseconds claim_min_idle{30000};
+    std::chrono::milliseconds claim_interval{5000};
+    // Delay between attempts to reopen a lost consumer connection.
+    std::chrono::milliseconds reconnect_interval{1000};
+};
+
+struct StreamStats {
+    uint64_t added = 0;
+    uint64_t delivered = 0;    // Entries handed to handlers
+    uint64_t acknowledged = 0;
+    uint64_t failed = 0;       // Handler threw; the entry stays pending for a later claim
+    uint64_t malformed = 0;    // Could not be decoded; acknowledged and dropped
+    uint64_t claimed = 0;      // Taken over from idle pending entries
+    uint64_t reads = 0;        // XREADGROUP round-trips
+};
+
+// Typed Redis Streams transport with consumer groups.
+//
+// Unlike PubSubWrapper, messages are stored: a consumer that was down
+// picks up where its group left off, and an entry is only acknowledged
+// once its handler has returned. Each message is one stream entry with the
+// encoded message in its "data" field.
+//
+// Adding borrows a pooled connection. Every consume() call runs a consumer
+// thread on its own dedicated connection, since XREADGROUP BLOCK would tie
+// up a pooled one. The thread first re-reads the entries still pending
+// for its consumer name (left over from before a crash or a reconnect),
+// then reads new entries in batches and hands them to the handler in
+// order. Pending entries of idle consumers are reclaimed with XAUTOCLAIM
+// (XPENDING and XCLAIM before Redis 6.2), so delivery is at-least-once.
+template<typename T, typename Serializer = JsonSerializer>
+class StreamWrapper {
+public:
+    using Handler = std::function<void(const std::string& id, const T& message)>;
+
+    StreamWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                  const StreamOptions& options = StreamOptions());
+    ~StreamWrapper();
+
+    // Deleted copy and move constructors/assignments
+    StreamWrapper(const StreamWrapper&) = delete;
+    StreamWrapper& operator=(const StreamWrapper&) = delete;
+    StreamWrapper(StreamWrapper&&) = delete;
+    StreamWrapper& operator=(StreamWrapper&&) = delete;
+
+    // Appends the message and returns its entry ID.
+    std::string add(const std::string& stream, const T& message);
+    // Appends the messages pipelined on one connection and returns their
+    // IDs, in order. Throws std::runtime_error if any of them failed.
+    std::vector<std::string> addBatch(const std::string& stream, const std::vector<T>& messages);
+
+    // Creates the group if needed and starts consuming the stream as
+    // `consumer`. Throws std::logic_error if this wrapper already consumes
+    // the stream for the group.
+    void consume(const std::string& stream, const std::string& group, const std::string& consumer,
+                 Handler handler);
+    // Returns once the consumer thread is gone. Must not be called from
+    // its handler.
+    void stopConsuming(const std::string& stream, const std::string& group);
+
+    StreamStats stats() const;
+
+private:
+    struct Consumer {
+        std::string stream;
+        std::string group;
+        std::string name;
+        Handler handler;
+        std::thread thread;
+        std::mutex mutex; // Guards setting stop, and context
+        std::condition_variable wake;
+        std::atomic<bool> stop{false};
+        redisContext* context = nullptr; // Only the consumer thread changes it
+        bool autoclaim = true; // Cleared if the server lacks XAUTOCLAIM
+        std::string pending_cursor = "-"; // Where claimWithXclaim() lists from next
+    };
+
+    // Slack on top of the BLOCK time before a read counts as timed out.
+    static constexpr std::chrono::milliseconds kReadTimeoutSlack{1000};
+
+    void createGroup(const std::string& stream, const std::string& group);
+    void consumerLoop(Consumer* consumer);
+    redisContext* openConsumerConnection();
+    bool readBatch(Consumer& consumer, std::string& cursor, std::vector<std::string>& acks);
+    bool claimIdle(Consumer& consumer, std::vector<std::string>& acks);
+    bool claimWithXclaim(Consumer& consumer, std::vector<std::string>& acks);
+    static std::string nextStreamId(const std::string& id);
+    size_t handleEntries(Consumer& consumer, const redisReply* entries, std::vector<std::string>& acks,
+                         std::string* last_id);
+    void flushAcks(const Consumer& consumer, std::vector<std::string>& acks);
+    void stopConsumer(Consumer& consumer);
+    void pause(Consumer& consumer);
+    static bool append(redisContext* context, const std::vector<std::string>& args);
+    static redisReply* command(redisContext* context, const std::vector<std::string>& args);
+    static bool isError(const redisReply* reply, const char* prefix);
+
+    std::shared_ptr<ConnectionPoolManager> m_pool_manager;
+    const StreamOptions m_options;
+
+    std::mutex m_mutex; // Guards m_consumers
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Consumer>> m_consumers;
+
+    std::atomic<uint64_t> m_added{0};
+    std::atomic<uint64_t> m_delivered{0};
+    std::atomic<uint64_t> m_acknowledged{0};
+    std::atomic<uint64_t> m_failed{0};
+    std::atomic<uint64_t> m_malformed{0};
+    std::atomic<uint64_t> m_claimed{0};
+    std::atomic<uint64_t> m_reads{0};
+};
+
+template<typename T, typename Serializer>
+StreamWrapper<T, Serializer>::StreamWrapper(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                                            const StreamOptions& options)
+    : m_pool_manager(pool_manager), m_options(options) {
+    if (!m_pool_manager) {
+        throw std::invalid_argument("StreamWrapper needs a connection pool");
+    }
+    if (m_options.read_count == 0) {
+        throw std::invalid_argument("read_count must be positive");
+    }
+}
+
+template<typename T, typename Serializer>
+StreamWrapper<T, Serializer>::~StreamWrapper() {
+    std::map<std::pair<std::string, std::string>, std::unique_ptr<Consumer>> consumers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        consumers.swap(m_consumers);
+    }
+    for (auto& [key, consumer] : consumers) {
+        stopConsumer(*consumer);
+    }
+}
+
+template<typename T, typename Serializer>
+std::string StreamWrapper<T, Serializer>::add(const std::string& stream, const T& message) {
+    std::vector<std::string> ids = addBatch(stream, std::vector<T>{message});
+    return ids.front();
+}
+
+template<typename T, typename Serializer>
+std::vector<std::string> StreamWrapper<T, Serializer>::addBatch(const std::string& stream,
+                                                                const std::vector<T>& messages) {
+    std::vector<std::string> ids;
+    if (messages.empty()) {
+        return ids;
+    }
+    std::string max_length = std::to_string(m_options.max_length);
+    BatchExecutor batch(m_pool_manager.get());
+    for (const T& message : messages) {
+        std::string payload = Serializer::template encode<T>(message);
+        if (m_options.max_length > 0) {
+            batch.add({"XADD", stream, "MAXLEN", "~", max_length, "*", "data", payload});
+        } else {
+            batch.add({"XADD", stream, "*", "data", payload});
+        }
+    }
+    batch.execute();
+    if (batch.failures() > 0) {
+        for (size_t i = 0; i < batch.size(); ++i) {
+            if (!batch.ok(i)) {
+                throw std::runtime_error("Failed to add " + std::to_string(batch.failures()) + " of " +
+                                         std::to_string(batch.size()) + " entries to " + stream + ": " +
+                                         batch.error(i));
+            }
+        }
+    }
+    ids.reserve(messages.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        ids.emplace_back(batch.view(i));
+    }
+    m_added.fetch_add(ids.size(), std::memory_order_relaxed);
+    return ids;
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::consume(const std::string& stream, const std::string& group,
+                                           const std::string& consumer, Handler handler) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto key = std::make_pair(stream, group);
+    if (m_consumers.count(key)) {
+        throw std::logic_error("Already consuming " + stream + " for group " + group);
+    }
+    createGroup(stream, group);
+    auto entry = std::make_unique<Consumer>();
+    entry->stream = stream;
+    entry->group = group;
+    entry->name = consumer;
+    entry->handler = std::move(handler);
+    entry->thread = std::thread(&StreamWrapper<T, Serializer>::consumerLoop, this, entry.get());
+    m_consumers.emplace(std::move(key), std::move(entry));
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::stopConsuming(const std::string& stream, const std::string& group) {
+    std::unique_ptr<Consumer> consumer;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_consumers.find(std::make_pair(stream, group));
+        if (it == m_consumers.end()) {
+            return;
+        }
+        if (it->second->thread.get_id() == std::this_thread::get_id()) {
+            throw std::logic_error("stopConsuming() called from the consumer's own handler");
+        }
+        consumer = std::move(it->second);
+        m_consumers.erase(it);
+    }
+    stopConsumer(*consumer);
+}
+
+template<typename T, typename Serializer>
+StreamStats StreamWrapper<T, Serializer>::stats() const {
+    StreamStats stats;
+    stats.added = m_added.load(std::memory_order_relaxed);
+    stats.delivered = m_delivered.load(std::memory_order_relaxed);
+    stats.acknowledged = m_acknowledged.load(std::memory_order_relaxed);
+    stats.failed = m_failed.load(std::memory_order_relaxed);
+    stats.malformed = m_malformed.load(std::memory_order_relaxed);
+    stats.claimed = m_claimed.load(std::memory_order_relaxed);
+    stats.reads = m_reads.load(std::memory_order_relaxed);
+    return stats;
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::createGroup(const std::string& stream, const std::string& group) {
+    RedisConnectionGuard guard(m_pool_manager.get());
+    redisReply* reply =
+        command(guard.getContext(), {"XGROUP", "CREATE", stream, group, m_options.group_start_id, "MKSTREAM"});
+    if (reply == nullptr) {
+        throw std::runtime_error("Failed to create consumer group " + group);
+    }
+    // BUSYGROUP: the group exists already.
+    bool failed = reply->type == REDIS_REPLY_ERROR && !isError(reply, "BUSYGROUP");
+    std::string error = failed ? std::string(reply->str, reply->len) : std::string();
+    freeReplyObject(reply);
+    if (failed) {
+        throw std::runtime_error("Failed to create consumer group " + group + ": " + error);
+    }
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::stopConsumer(Consumer& consumer) {
+    {
+        std::lock_guard<std::mutex> lock(consumer.mutex);
+        consumer.stop = true;
+        if (consumer.context) {
+            // Ends a blocked XREADGROUP right away.
+            shutdown(consumer.context->fd, SHUT_RDWR);
+        }
+    }
+    consumer.wake.notify_all();
+    if (consumer.thread.joinable()) {
+        consumer.thread.join();
+    }
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::pause(Consumer& consumer) {
+    std::unique_lock<std::mutex> lock(consumer.mutex);
+    consumer.wake.wait_for(lock, m_options.reconnect_interval, [&] { return consumer.stop.load(); });
+}
+
+template<typename T, typename Serializer>
+redisContext* StreamWrapper<T, Serializer>::openConsumerConnection() {
+    redisContext* context = m_pool_manager->openDedicatedConnection(0);
+    if (!context) {
+        return nullptr;
+    }
+    auto timeout = std::chrono::duration_cast<std::chrono::microseconds>(m_options.block + kReadTimeoutSlack);
+    timeval tv{static_cast<time_t>(timeout.count() / 1000000), static_cast<suseconds_t>(timeout.count() % 1000000)};
+    if (redisSetTimeout(context, tv) != REDIS_OK) {
+        redisFree(context);
+        return nullptr;
+    }
+    return context;
+}
+
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::consumerLoop(Consumer* consumer) {
+    std::vector<std::string> acks; // Sent with the next read
+    std::string cursor;
+    auto next_claim = std::chrono::steady_clock::now();
+    while (true) {
+        if (!consumer->context) {
+            redisContext* context = openConsumerConnection();
+            std::lock_guard<std::mutex> lock(consumer->mutex);
+            if (consumer->stop) {
+                if (context) {
+                    redisFree(context);
+                }
+                break;
+            }
+            consumer->context = context;
+            // Entries read before a crash or a dropped connection may not
+            // have been acknowledged; this consumer's pending list has them.
+            cursor = "0";
+        } else {
+            std::lock_guard<std::mutex> lock(consumer->mutex);
+            if (consumer->stop) {
+                break;
+            }
+        }
+        if (!consumer->context) {
+            pause(*consumer);
+            continue;
+        }
+
+        bool ok = true;
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_claim) {
+            ok = claimIdle(*consumer, acks);
+            next_claim = now + m_options.claim_interval;
+        }
+        if (ok) {
+            ok = readBatch(*consumer, cursor, acks);
+        }
+        if (!ok) {
+            std::lock_guard<std::mutex> lock(consumer->mutex);
+            if (!consumer->stop) {
+                std::cerr << "Redis connection error in consumer " << consumer->name << " of " << consumer->stream
+                          << std::endl;
+            }
+            redisFree(consumer->context);
+            consumer->context = nullptr;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(consumer->mutex);
+        if (consumer->context) {
+            redisFree(consumer->context);
+            consumer->context = nullptr;
+        }
+    }
+    flushAcks(*consumer, acks);
+}
+
+// Acknowledges what the loop had not sent yet when it stopped.
+template<typename T, typename Serializer>
+void StreamWrapper<T, Serializer>::flushAcks(const Consumer& consumer, std::vector<std::string>& acks) {
+    if (acks.empty()) {
+        return;
+    }
+    try {
+        std::vector<std::string> args{"XACK", consumer.stream, consumer.group};
+        args.insert(args.end(), acks.begin(), acks.end());
+        RedisConnectionGuard guard(m_pool_manager.get());
+        redisReply* reply = command(guard.getContext(), args);
+        if (reply && reply->type == REDIS_REPLY_INTEGER) {
+            m_acknowledged.fetch_add(reply->integer, std::memory_order_relaxed);
+        } else {
+            std::cerr << "Failed to acknowledge " << acks.size() << " entries of " << consumer.stream << std::endl;
+        }
+        if (reply) {
+            freeReplyObject(reply);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to acknowledge " << acks.size() << " entries of " << consumer.stream << ": "
+                  << e.what() << std::endl;
+    }
+    acks.clear();
+}
+
+// Sends the pending acknowledgements and one XREADGROUP in a single write
+// and handles the entries read. `cursor` is "0"-based while the consumer's
+// own pending entries are replayed, ">" afterwards. Returns false if the
+// connection failed.
+template<typename T, typename Serializer>
+bool StreamWrapper<T, Serializer>::readBatch(Consumer& consumer, std::string& cursor, std::vector<std::string>& acks) {
+    redisContext* context = consumer.context;
+    bool acking = !acks.empty();
+    if (acking) {
+        std::vector<std::string> xack{"XACK", consumer.stream, consumer.group};
+        xack.insert(xack.end(), acks.begin(), acks.end());
+        if (!append(context, xack)) {
+            return false;
+        }
+    }
+    std::vector<std::string> args{"XREADGROUP", "GROUP", consumer.group, consumer.name,
+                                  "COUNT", std::to_string(m_options.read_count)};
+    if (cursor == ">") {
+        args.insert(args.end(), {"BLOCK", std::to_string(m_options.block.count())});
+    }
+    args.insert(args.end(), {"STREAMS", consumer.stream, cursor});
+    if (!append(context, args)) {
+        return false;
+    }
+
+    if (acking) {
+        redisReply* ack = nullptr;
+        if (redisGetReply(context, (void**)&ack) != REDIS_OK) {
+            return false;
+        }
+        if (ack->type == REDIS_REPLY_INTEGER) {
+            m_acknowledged.fetch_add(ack->integer, std::memory_order_relaxed);
+        } else {
+            // The entries stay pending and are claimed again later.
+            std::cerr << "Failed to acknowledge " << acks.size() << " entries of " << consumer.stream << std::endl;
+        }
+        freeReplyObject(ack);
+        acks.clear();
+    }
+    redisReply* reply = nullptr;
+    if (redisGetReply(context, (void**)&reply) != REDIS_OK) {
+        return false;
+    }
+    m_reads.fetch_add(1, std::memory_order_relaxed);
+    if (reply->type == REDIS_REPLY_ERROR) {
+        bool no_group = isError(reply, "NOGROUP");
+        std::cerr << "XREADGROUP failed on " << consumer.stream << ": " << std::string(reply->str, reply->len)
+                  << std::endl;
+        freeReplyObject(reply);
+        if (no_group) {
+            // The stream or group was deleted, or Redis restarted empty.
+            try {
+                createGroup(consumer.stream, consumer.group);
+                return true;
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+        pause(consumer);
+        return true;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 && reply->element[0]->type == REDIS_REPLY_ARRAY &&
+        reply->element[0]->elements == 2) {
+        std::string last_id;
+        size_t handled = handleEntries(consumer, reply->element[0]->element[1], acks, &last_id);
+        if (cursor != ">") {
+            // Page through the pending list, then switch to new entries.
+            cursor = handled == 0 ? ">" : last_id;
+        }
+    } else if (cursor != ">") {
+        cursor = ">";
+    }
+    freeReplyObject(reply); // A nil reply means BLOCK timed out
+    return true;
+}
+
+// Claims the group's entries that have been pending for claim_min_idle and
+// handles them. Returns false if the connection failed.
+template<typename T, typename Serializer>
+bool StreamWrapper<T, Serializer>::claimIdle(Consumer& consumer, std::vector<std::string>& acks) {
+    if (!consumer.autoclaim) {
+        return claimWithXclaim(consumer, acks);
+    }
+    std::string start = "0-0";
+    std::string min_idle = std::to_string(m_options.claim_min_idle.count());
+    std::string count = std::to_string(m_options.read_count);
+    do {
+        redisReply* reply = command(consumer.context, {"XAUTOCLAIM", consumer.stream, consumer.group, consumer.name,
+                                                       min_idle, start, "COUNT", count});
+        if (!reply) {
+            return false;
+        }
+        if (reply->type == REDIS_REPLY_ERROR) {
+            bool unknown = isError(reply, "ERR unknown command");
+            if (!unknown) {
+                std::cerr << "XAUTOCLAIM failed on " << consumer.stream << ": " << std::string(reply->str, reply->len)
+                          << std::endl;
+            }
+            freeReplyObject(reply);
+            if (unknown) {
+                consumer.autoclaim = false;
+                return claimWithXclaim(consumer, acks);
+            }
+            return true;
+        }
+        // Next start ID, claimed entries (and, from Redis 7, deleted IDs).
+        if (reply->type != REDIS_REPLY_ARRAY || reply->elements < 2 || reply->element[0]->type != REDIS_REPLY_STRING) {
+            freeReplyObject(reply);
+            return true;
+        }
+        start.assign(reply->element[0]->str, reply->element[0]->len);
+        m_claimed.fetch_add(handleEntries(consumer, reply->element[1], acks, nullptr), std::memory_order_relaxed);
+        freeReplyObject(reply);
+    } while (start != "0-0" && !consumer.stop);
+    return true;
+}
+
+// XAUTOCLAIM is Redis 6.2+; older servers list the pending entries and
+// claim them by ID, one page per claim interval. The pages walk the pending
+// list and wrap around at its end, so entries that are not idle yet (or keep
+// failing) do not hide the ones behind them.
+template<typename T, typename Serializer>
+bool StreamWrapper<T, Serializer>::claimWithXclaim(Consumer& consumer, std::vector<std::string>& acks) {
+    redisReply* pending = command(consumer.context, {"XPENDING", consumer.stream, consumer.group,
+                                                     consumer.pending_cursor, "+",
+                                                     std::to_string(m_options.read_count)});
+    if (!pending) {
+        return false;
+    }
+    std::vector<std::string> args{"XCLAIM", consumer.stream, consumer.group, consumer.name,
+                                  std::to_string(m_options.claim_min_idle.count())};
+    size_t listed = 0;
+    if (pending->type == REDIS_REPLY_ARRAY) {
+        listed = pending->elements;
+        for (size_t i = 0; i < pending->elements; ++i) {
+            const redisReply* entry = pending->element[i];
+            if (entry->type == REDIS_REPLY_ARRAY && entry->elements > 0 && entry->element[0]->type == REDIS_REPLY_STRING) {
+                args.emplace_back(entry->element[0]->str, entry->element[0]->len);
+            }
+        }
+    }
+    freeReplyObject(pending);
+    // XPENDING ranges are inclusive (exclusive starts are 6.2+ as well), so
+    // the next page starts just past the last ID listed.
+    if (listed < m_options.read_count || args.size() == 5) {
+        consumer.pending_cursor = "-";
+    } else {
+        consumer.pending_cursor = nextStreamId(args.back());
+    }
+    if (args.size() == 5) {
+        return true;
+    }
+    // XCLAIM checks the idle time itself and skips entries that are not idle enough.
+    redisReply* claimed = command(consumer.context, args);
+    if (!claimed) {
+        return false;
+    }
+    m_claimed.fetch_add(handleEntries(consumer, claimed, acks, nullptr), std::memory_order_relaxed);
+    freeReplyObject(claimed);
+    return true;
+}
+
+// The smallest stream ID after id ("<ms>-<seq>").
+template<typename T, typename Serializer>
+std::string StreamWrapper<T, Serializer>::nextStreamId(const std::string& id) {
+    size_t dash = id.find('-');
+    if (dash == std::string::npos) {
+        return id + "-1";
+    }
+    uint64_t ms = std::stoull(id.substr(0, dash));
+    uint64_t seq = std::stoull(id.substr(dash + 1));
+    if (seq == UINT64_MAX) {
+        return std::to_string(ms + 1) + "-0";
+    }
+    return std::to_string(ms) + "-" + std::to_string(seq + 1);
+}
+
+// Hands each entry of an XREADGROUP/XCLAIM entry list to the handler and
+// queues its acknowledgement, unless the handler threw. Returns the number
+// of entries in the list.
+template<typename T, typename Serializer>
+size_t StreamWrapper<T, Serializer>::handleEntries(Consumer& consumer, const redisReply* entries,
+                                                   std::vector<std::string>& acks, std::string* last_id) {
+    if (entries->type != REDIS_REPLY_ARRAY) {
+        return 0;
+    }
+    for (size_t i = 0; i < entries->elements; ++i) {
+        const redisReply* entry = entries->element[i];
+        if (entry->type != REDIS_REPLY_ARRAY || entry->elements < 2 || entry->element[0]->type != REDIS_REPLY_STRING) {
+            continue; // XAUTOCLAIM before Redis 7 lists deleted entries as nil
+        }
+        std::string id(entry->element[0]->str, entry->element[0]->len);
+        if (last_id) {
+            *last_id = id;
+        }
+        const redisReply* fields = entry->element[1];
+        if (fields->type == REDIS_REPLY_NIL) {
+            acks.push_back(std::move(id)); // Trimmed away while pending
+            continue;
+        }
+        const redisReply* data = nullptr;
+        if (fields->type == REDIS_REPLY_ARRAY) {
+            for (size_t f = 0; f + 1 < fields->elements; f += 2) {
+                const redisReply* name = fields->element[f];
+                if (name->type == REDIS_REPLY_STRING && name->len == 4 && memcmp(name->str, "data", 4) == 0 &&
+                    fields->element[f + 1]->type == REDIS_REPLY_STRING) {
+                    data = fields->element[f + 1];
+                    break;
+                }
+            }
+        }
+
+        std::optional<T> message;
+        try {
+            if (!data) {
+                throw std::runtime_error("no data field");
+            }
+            message.emplace(Serializer::template decode<T>(data->str, data->len));
+        } catch (const std::exception& e) {
+            std::cerr << "Dropping malformed entry " << id << " of " << consumer.stream << ": " << e.what()
+                      << std::endl;
+            m_malformed.fetch_add(1, std::memory_order_relaxed);
+            acks.push_back(std::move(id));
+            continue;
+        }
+        m_delivered.fetch_add(1, std::memory_order_relaxed);
+        try {
+            consumer.handler(id, *message);
+            acks.push_back(std::move(id));
+        } catch (const std::exception& e) {
+            std::cerr << "Error in handler for entry " << id << " of " << consumer.stream << ": " << e.what()
+                      << std::endl;
+            m_failed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return entries->elements;
+}
+
+// Queues a binary-safe command in the context's output buffer.
+template<typename T, typename Serializer>
+bool StreamWrapper<T, Serializer>::append(redisContext* context, const std::vector<std::string>& args) {
+    std::vector<const char*> argv;
+    std::vector<size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+    return redisAppendCommandArgv(context, static_cast<int>(argv.size()), argv.data(), argvlen.data()) == REDIS_OK;
+}
+
+// Sends one command and waits for its reply; nullptr if the connection failed.
+template<typename T, typename Serializer>
+redisReply* StreamWrapper<T, Serializer>::command(redisContext* context, const std::vector<std::string>& args) {
+    redisReply* reply = nullptr;
+    if (!append(context, args) || redisGetReply(context, (void**)&reply) != REDIS_OK) {
+        return nullptr;
+    }
+    return reply;
+}
+
+template<typename T, typename Serializer>
+bool StreamWrapper<T, Serializer>::isError(const redisReply* reply, const char* prefix) {
+    size_t length = strlen(prefix);
+    return reply->type == REDIS_REPLY_ERROR && reply->len >= length && memcmp(reply->str, prefix, length) == 0;
+}
+
+#endif // STREAM_WRAPPER_H
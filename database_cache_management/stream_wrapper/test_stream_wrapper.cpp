@@ -0,0 +1,180 @@
+#include <gtest/gtest.h>
+#include <stream_wrapper/stream_wrapper.h>
+#include <connection_pool_manager/connection_pool_manager.h>
+#include <connection_pool_manager/redis_connection_guard.h>
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <vector>
+
+class StreamWrapperTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        pool_manager = std::make_shared<ConnectionPoolManager>(std::vector<std::string>{"127.0.0.1"}, 5);
+    }
+
+    // Runs a command and returns its integer reply (or the first element
+    // of an array reply).
+    long long integerCommand(const std::string& command) {
+        RedisConnectionGuard guard(pool_manager.get());
+        redisReply* reply = (redisReply*)redisCommand(guard.getContext(), command.c_str());
+        long long value = -1;
+        if (reply && reply->type == REDIS_REPLY_INTEGER) {
+            value = reply->integer;
+        } else if (reply && reply->type == REDIS_REPLY_ARRAY && reply->elements > 0 &&
+                   reply->element[0]->type == REDIS_REPLY_INTEGER) {
+            value = reply->element[0]->integer;
+        }
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return value;
+    }
+
+    void runCommand(const std::string& command) {
+        RedisConnectionGuard guard(pool_manager.get());
+        redisReply* reply = (redisReply*)redisCommand(guard.getContext(), command.c_str());
+        ASSERT_NE(reply, nullptr);
+        freeReplyObject(reply);
+    }
+
+    static bool waitFor(const std::function<bool()>& done) {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while (!done()) {
+            if (std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        return true;
+    }
+
+    std::shared_ptr<ConnectionPoolManager> pool_manager;
+};
+
+TEST_F(StreamWrapperTest, AddAndConsumeInBatches) {
+    runCommand("DEL stream_test:batch");
+    StreamOptions options;
+    options.read_count = 64;
+    StreamWrapper<int> streams(pool_manager, options);
+
+    std::mutex m;
+    std::vector<int> received;
+    streams.consume("stream_test:batch", "workers", "worker-1", [&](const std::string&, const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        received.push_back(value);
+    });
+
+    std::vector<int> messages;
+    for (int i = 0; i < 1000; ++i) {
+        messages.push_back(i);
+    }
+    std::vector<std::string> ids = streams.addBatch("stream_test:batch", messages);
+    ASSERT_EQ(ids.size(), 1000u);
+    EXPECT_LT(ids.front(), ids.back());
+    ASSERT_TRUE(waitFor([&] {
+        std::lock_guard<std::mutex> lock(m);
+        return received.size() == messages.size();
+    }));
+    {
+        std::lock_guard<std::mutex> lock(m);
+        EXPECT_EQ(received, messages);
+    }
+    // Acknowledged in batches along with the following reads.
+    EXPECT_TRUE(waitFor([&] { return integerCommand("XPENDING stream_test:batch workers") == 0; }));
+    StreamStats stats = streams.stats();
+    EXPECT_EQ(stats.added, 1000u);
+    EXPECT_EQ(stats.delivered, 1000u);
+    EXPECT_LT(stats.reads, 500u);
+    EXPECT_THROW(streams.consume("stream_test:batch", "workers", "worker-2", [](const std::string&, const int&) {}),
+                 std::logic_error);
+    streams.stopConsuming("stream_test:batch", "workers");
+}
+
+TEST_F(StreamWrapperTest, TrimsApproximately) {
+    runCommand("DEL stream_test:trim");
+    StreamOptions options;
+    options.max_length = 100;
+    StreamWrapper<int> streams(pool_manager, options);
+    for (int batch = 0; batch < 10; ++batch) {
+        streams.addBatch("stream_test:trim", std::vector<int>(100, batch));
+    }
+    long long length = integerCommand("XLEN stream_test:trim");
+    EXPECT_GE(length, 100);
+    EXPECT_LT(length, 1000);
+}
+
+TEST_F(StreamWrapperTest, RestartedConsumerReplaysItsPendingEntries) {
+    runCommand("DEL stream_test:replay");
+    StreamWrapper<int> streams(pool_manager);
+    std::mutex m;
+    std::vector<int> received;
+
+    // A handler that fails leaves its entries pending.
+    streams.consume("stream_test:replay", "workers", "worker-1", [](const std::string&, const int&) {
+        throw std::runtime_error("not ready");
+    });
+    streams.addBatch("stream_test:replay", {1, 2, 3});
+    ASSERT_TRUE(waitFor([&] { return streams.stats().failed == 3; }));
+    streams.stopConsuming("stream_test:replay", "workers");
+    EXPECT_EQ(integerCommand("XPENDING stream_test:replay workers"), 3);
+
+    // Coming back under the same name replays them before new entries.
+    streams.consume("stream_test:replay", "workers", "worker-1", [&](const std::string&, const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        received.push_back(value);
+    });
+    streams.add("stream_test:replay", 4);
+    ASSERT_TRUE(waitFor([&] {
+        std::lock_guard<std::mutex> lock(m);
+        return received.size() == 4;
+    }));
+    {
+        std::lock_guard<std::mutex> lock(m);
+        EXPECT_EQ(received, (std::vector<int>{1, 2, 3, 4}));
+    }
+    EXPECT_TRUE(waitFor([&] { return integerCommand("XPENDING stream_test:replay workers") == 0; }));
+}
+
+TEST_F(StreamWrapperTest, ClaimsEntriesOfACrashedConsumer) {
+    runCommand("DEL stream_test:claim");
+    runCommand("XGROUP CREATE stream_test:claim workers 0 MKSTREAM");
+    StreamOptions options;
+    options.claim_min_idle = std::chrono::milliseconds(50);
+    options.claim_interval = std::chrono::milliseconds(50);
+    StreamWrapper<int> streams(pool_manager, options);
+    std::vector<int> messages;
+    for (int i = 0; i < 20; ++i) {
+        messages.push_back(i);
+    }
+    streams.addBatch("stream_test:claim", messages);
+    runCommand("XADD stream_test:claim * data not-json");
+
+    // Read by a consumer that dies before acknowledging anything.
+    runCommand("XREADGROUP GROUP workers crashed COUNT 100 STREAMS stream_test:claim >");
+    EXPECT_EQ(integerCommand("XPENDING stream_test:claim workers"), 21);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::mutex m;
+    std::vector<int> received;
+    streams.consume("stream_test:claim", "workers", "rescuer", [&](const std::string&, const int& value) {
+        std::lock_guard<std::mutex> lock(m);
+        received.push_back(value);
+    });
+    ASSERT_TRUE(waitFor([&] {
+        std::lock_guard<std::mutex> lock(m);
+        return received.size() == messages.size();
+    }));
+    {
+        std::lock_guard<std::mutex> lock(m);
+        EXPECT_EQ(received, messages);
+    }
+    EXPECT_TRUE(waitFor([&] { return integerCommand("XPENDING stream_test:claim workers") == 0; }));
+    StreamStats stats = streams.stats();
+    EXPECT_EQ(stats.claimed, 21u);
+    EXPECT_EQ(stats.malformed, 1u);
+}
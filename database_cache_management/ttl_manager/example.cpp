@@ -39,6 +39,21 @@ int main() {
             std::this_thread::sleep_for(std::chrono::seconds(1));
         }
 
+        // Neighbor entries as a lease group, refreshed in one batch.
+        std::vector<KeyTtl> entries;
+        for (int i = 0; i < 3; ++i) {
+            std::string key = "neighbor:" + std::to_string(i);
+            reply = (redisReply*)redisCommand(conn, "SET %s %s", key.c_str(), "reachable");
+            if (reply) freeReplyObject(reply);
+            entries.push_back({key, 30});
+            ttl_manager.joinGroup("neighbors", key, std::chrono::seconds(30));
+        }
+        auto outcomes = ttl_manager.addKeys(entries);
+        std::cout << "Set TTLs on " << outcomes.size() << " neighbor entries in one batch." << std::endl;
+        for (const auto& [key, outcome] : ttl_manager.keepAlive("neighbors")) {
+            std::cout << "Lease " << key << (outcome == TtlOutcome::Applied ? " refreshed" : " lost") << std::endl;
+        }
+
         pool_manager->returnConnection(conn);
 
     } catch (const std::exception& e) {
@@ -0,0 +1,171 @@
+#include "expiration_wheel.h"
+#include <algorithm>
+#include <stdexcept>
+
+ExpirationWheel::ExpirationWheel(int64_t tick_ms, int64_t now_ms)
+    : tick_ms_(tick_ms), current_tick_(tick_ms > 0 ? now_ms / tick_ms : 0) {
+    if (tick_ms <= 0) {
+        throw std::invalid_argument("Expiration wheel tick must be positive");
+    }
+}
+
+void ExpirationWheel::schedule(const std::string& key, int64_t deadline_ms) {
+    auto [it, inserted] = entries_.try_emplace(key);
+    Entry& entry = it->second;
+    if (inserted) {
+        entry.key = &it->first;
+    } else {
+        unlink(entry);
+    }
+    entry.deadline_ms = deadline_ms;
+    entry.tick = deadline_ms / tick_ms_;
+    link(entry);
+}
+
+bool ExpirationWheel::remove(const std::string& key) {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return false;
+    }
+    unlink(it->second);
+    entries_.erase(it);
+    return true;
+}
+
+std::optional<int64_t> ExpirationWheel::deadline(const std::string& key) const {
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        return std::nullopt;
+    }
+    return it->second.deadline_ms;
+}
+
+// Level L holds deadlines 64^L to 64^(L+1) ticks ahead, in the slot given
+// by their tick's bits at that level; a slot is cascaded down one level
+// when the wheel reaches it.
+void ExpirationWheel::link(Entry& entry) {
+    int64_t tick = std::max(entry.tick, current_tick_);
+    int64_t delta = tick - current_tick_;
+    int level = 0;
+    while (level < kLevels && delta >= (int64_t(1) << (kSlotBits * (level + 1)))) {
+        ++level;
+    }
+    if (level == kLevels) {
+        // Beyond the wheel: park in the farthest slot and re-sort later.
+        level = kLevels - 1;
+        tick = current_tick_ + (int64_t(1) << (kSlotBits * kLevels)) - 1;
+    }
+    int slot = static_cast<int>((tick >> (kSlotBits * level)) & kSlotMask);
+
+    entry.level = static_cast<uint8_t>(level);
+    entry.slot = static_cast<uint8_t>(slot);
+    ++level_sizes_[level];
+    entry.prev = nullptr;
+    entry.next = slots_[level][slot];
+    if (entry.next) {
+        entry.next->prev = &entry;
+    }
+    slots_[level][slot] = &entry;
+}
+
+void ExpirationWheel::unlink(Entry& entry) {
+    if (entry.prev) {
+        entry.prev->next = entry.next;
+    } else {
+        slots_[entry.level][entry.slot] = entry.next;
+    }
+    if (entry.next) {
+        entry.next->prev = entry.prev;
+    }
+    entry.prev = entry.next = nullptr;
+    --level_sizes_[entry.level];
+}
+
+void ExpirationWheel::cascade(int level) {
+    int slot = static_cast<int>((current_tick_ >> (kSlotBits * level)) & kSlotMask);
+    Entry* entry = slots_[level][slot];
+    slots_[level][slot] = nullptr;
+    while (entry) {
+        Entry* next = entry->next;
+        --level_sizes_[level];
+        link(*entry);
+        entry = next;
+    }
+}
+
+void ExpirationWheel::advance(int64_t now_ms, const std::function<void(const std::string& key)>& expired) {
+    // Only ticks that have fully elapsed are processed.
+    int64_t target = now_ms / tick_ms_;
+    while (current_tick_ < target) {
+        int lowest = 0;
+        while (lowest < kLevels && level_sizes_[lowest] == 0) {
+            ++lowest;
+        }
+        if (lowest == kLevels) {
+            current_tick_ = target; // Nothing scheduled
+            break;
+        }
+        if (lowest > 0) {
+            // Nothing can expire before the next slot of the lowest
+            // occupied level comes up, so jump straight there.
+            int shift = kSlotBits * lowest;
+            current_tick_ = std::min(target, ((current_tick_ >> shift) + 1) << shift);
+            for (int level = 1; level < kLevels; ++level) {
+                if ((current_tick_ & ((int64_t(1) << (kSlotBits * level)) - 1)) != 0) {
+                    break;
+                }
+                cascade(level);
+            }
+            continue;
+        }
+
+        int slot = static_cast<int>(current_tick_ & kSlotMask);
+        Entry* entry = slots_[0][slot];
+        slots_[0][slot] = nullptr;
+        while (entry) {
+            Entry* next = entry->next;
+            --level_sizes_[0];
+            if (entry->tick <= current_tick_) {
+                if (expired) {
+                    expired(*entry->key);
+                }
+                entries_.erase(entries_.find(*entry->key));
+            } else {
+                link(*entry);
+            }
+            entry = next;
+        }
+
+        ++current_tick_;
+        for (int level = 1; level < kLevels; ++level) {
+            if ((current_tick_ & ((int64_t(1) << (kSlotBits * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+    }
+}
+
+std::vector<std::pair<std::string, int64_t>> ExpirationWheel::dueBefore(int64_t end_ms, size_t limit) const {
+    std::vector<std::pair<std::string, int64_t>> due;
+    int64_t end_tick = std::max(end_ms / tick_ms_, current_tick_);
+    // At each level, only the slots between now and end_tick can hold
+    // deadlines in range.
+    for (int level = 0; level < kLevels; ++level) {
+        int shift = kSlotBits * level;
+        int64_t first = current_tick_ >> shift;
+        int64_t count = std::min<int64_t>((end_tick >> shift) - first + 1, kSlots);
+        for (int64_t i = 0; i < count; ++i) {
+            for (const Entry* entry = slots_[level][(first + i) & kSlotMask]; entry; entry = entry->next) {
+                if (entry->deadline_ms < end_ms) {
+                    due.emplace_back(*entry->key, entry->deadline_ms);
+                }
+            }
+        }
+    }
+    std::sort(due.begin(), due.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+    if (due.size() > limit) {
+        due.resize(limit);
+    }
+    return due;
+}
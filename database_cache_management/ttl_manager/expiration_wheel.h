@@ -0,0 +1,75 @@
+#ifndef EXPIRATION_WHEEL_H
+#define EXPIRATION_WHEEL_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <optional>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+// Hierarchical timing wheel of key deadlines.
+//
+// Deadlines are whole milliseconds since the epoch, bucketed into ticks of
+// tick_ms. Four levels of 64 slots cover 64^4 ticks ahead (about 19 days
+// at 100 ms); further deadlines wait in the last level and are re-sorted as
+// the wheel turns. Entries sit in intrusive lists, so scheduling,
+// rescheduling and removing a key are O(1), and each key costs one map
+// node plus a fixed-size entry no matter how often it is rescheduled.
+//
+// Not thread-safe; TtlManager serializes access.
+class ExpirationWheel {
+public:
+    ExpirationWheel(int64_t tick_ms, int64_t now_ms);
+
+    // Deleted copy and move constructors/assignments (entries are linked
+    // into the wheel by address)
+    ExpirationWheel(const ExpirationWheel&) = delete;
+    ExpirationWheel& operator=(const ExpirationWheel&) = delete;
+    ExpirationWheel(ExpirationWheel&&) = delete;
+    ExpirationWheel& operator=(ExpirationWheel&&) = delete;
+
+    // Adds the key or moves it to a new deadline.
+    void schedule(const std::string& key, int64_t deadline_ms);
+    bool remove(const std::string& key);
+    std::optional<int64_t> deadline(const std::string& key) const;
+    bool contains(const std::string& key) const { return entries_.count(key) > 0; }
+    size_t size() const { return entries_.size(); }
+
+    // Turns the wheel up to now_ms and removes every key whose deadline has
+    // passed, calling expired for each of them.
+    void advance(int64_t now_ms, const std::function<void(const std::string& key)>& expired);
+
+    // Keys with a deadline before end_ms, soonest first, at most limit.
+    std::vector<std::pair<std::string, int64_t>> dueBefore(int64_t end_ms, size_t limit) const;
+
+private:
+    static constexpr int kLevels = 4;
+    static constexpr int kSlotBits = 6;
+    static constexpr int kSlots = 1 << kSlotBits;
+    static constexpr int64_t kSlotMask = kSlots - 1;
+
+    struct Entry {
+        const std::string* key = nullptr; // The map's own key
+        int64_t deadline_ms = 0;
+        int64_t tick = 0;
+        Entry* prev = nullptr;
+        Entry* next = nullptr;
+        uint8_t level = 0;
+        uint8_t slot = 0;
+    };
+
+    void link(Entry& entry);
+    void unlink(Entry& entry);
+    void cascade(int level);
+
+    const int64_t tick_ms_;
+    // Every tick before this one has been processed.
+    int64_t current_tick_;
+    Entry* slots_[kLevels][kSlots] = {};
+    size_t level_sizes_[kLevels] = {}; // Lets advance() skip empty stretches
+    std::unordered_map<std::string, Entry> entries_;
+};
+
+#endif // EXPIRATION_WHEEL_H
@@ -45,3 +45,205 @@ TEST(TtlManagerTest, AddAndExpire) {
 
     pool_manager->returnConnection(conn_verify);
 }
+
+TEST(TtlManagerTest, AddKeyAsync) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    auto pool_manager = std::make_shared<ConnectionPoolManager>(hosts, 1);
+    auto engine = std::make_shared<AsyncCommandEngine>(hosts);
+    TtlManager ttl_manager(pool_manager, engine);
+
+    auto conn = pool_manager->getConnection();
+    ASSERT_NE(conn, nullptr);
+    redisReply* reply = (redisReply*)redisCommand(conn, "SET %s %s", "myasynckey", "myvalue");
+    ASSERT_NE(reply, nullptr);
+    freeReplyObject(reply);
+
+    ttl_manager.addKeyAsync("myasynckey", 100).get();
+
+    reply = (redisReply*)redisCommand(conn, "TTL %s", "myasynckey");
+    ASSERT_NE(reply, nullptr);
+    EXPECT_GT(reply->integer, 0);
+    EXPECT_LE(reply->integer, 100);
+    freeReplyObject(reply);
+
+    reply = (redisReply*)redisCommand(conn, "DEL %s", "myasynckey");
+    freeReplyObject(reply);
+    pool_manager->returnConnection(conn);
+}
+
+TEST(TtlManagerTest, ExpirationWheelOrdersDeadlines) {
+    const int64_t tick = 10;
+    int64_t now = 1000000;
+    ExpirationWheel wheel(tick, now);
+
+    // Deadlines on every level, one beyond the wheel's span.
+    const std::vector<int64_t> offsets = {5, 300, 50000, 3000000, 900000000, 5000000000};
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        wheel.schedule("key" + std::to_string(i), now + offsets[i]);
+    }
+    wheel.schedule("key0", now + 25); // Rescheduling moves the key
+    EXPECT_EQ(wheel.size(), offsets.size());
+    EXPECT_EQ(wheel.deadline("key0"), now + 25);
+
+    auto due = wheel.dueBefore(now + 60000, 10);
+    ASSERT_EQ(due.size(), 3u);
+    EXPECT_EQ(due[0].first, "key0");
+    EXPECT_EQ(due[1].first, "key1");
+    EXPECT_EQ(due[2].first, "key2");
+    EXPECT_EQ(wheel.dueBefore(now + 60000, 1).size(), 1u);
+
+    // Every key expires once its deadline has passed, not before.
+    std::vector<std::string> expired;
+    auto collect = [&](const std::string& key) { expired.push_back(key); };
+    for (size_t i = 1; i < offsets.size(); ++i) {
+        wheel.advance(now + offsets[i] - tick, collect);
+        EXPECT_EQ(wheel.contains("key" + std::to_string(i)), true) << i;
+        wheel.advance(now + offsets[i] + tick, collect);
+        EXPECT_EQ(wheel.contains("key" + std::to_string(i)), false) << i;
+    }
+    EXPECT_EQ(expired.size(), offsets.size());
+    EXPECT_EQ(wheel.size(), 0u);
+}
+
+TEST(TtlManagerTest, TrackedKeysAreBatchedPerTick) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    auto pool_manager = std::make_shared<ConnectionPoolManager>(hosts, 2);
+    TtlManagerOptions options;
+    options.tick = std::chrono::milliseconds(20);
+    TtlManager ttl_manager(pool_manager, nullptr, options);
+
+    auto conn = pool_manager->getConnection();
+    ASSERT_NE(conn, nullptr);
+    for (const char* key : {"wheel:a", "wheel:b", "wheel:c"}) {
+        freeReplyObject(redisCommand(conn, "SET %s %s", key, "value"));
+    }
+    freeReplyObject(redisCommand(conn, "DEL %s", "wheel:missing"));
+
+    using namespace std::chrono_literals;
+    ttl_manager.expireAfter("wheel:a", 10s);
+    ttl_manager.expireAfter("wheel:b", 300ms);
+    ttl_manager.expireAfter("wheel:c", 1h);
+    ttl_manager.expireAfter("wheel:missing", 10s);
+    EXPECT_EQ(ttl_manager.trackedKeys(), 4u);
+
+    auto soon = ttl_manager.expiringWithin(1s);
+    ASSERT_EQ(soon.size(), 1u);
+    EXPECT_EQ(soon[0].key, "wheel:b");
+    auto all = ttl_manager.expiringWithin(2h);
+    ASSERT_EQ(all.size(), 4u);
+    EXPECT_EQ(all.back().key, "wheel:c");
+
+    ttl_manager.flush();
+    redisReply* reply = (redisReply*)redisCommand(conn, "PTTL %s", "wheel:a");
+    EXPECT_GT(reply->integer, 9000);
+    EXPECT_LE(reply->integer, 10000);
+    freeReplyObject(reply);
+    // Redis had no such key, so it is no longer tracked.
+    EXPECT_EQ(ttl_manager.trackedKeys(), 3u);
+    EXPECT_FALSE(ttl_manager.deadline("wheel:missing").has_value());
+
+    // Extensions are local until the next tick.
+    EXPECT_TRUE(ttl_manager.extend("wheel:a", 5s));
+    EXPECT_FALSE(ttl_manager.extend("wheel:missing", 5s));
+    std::this_thread::sleep_for(100ms);
+    reply = (redisReply*)redisCommand(conn, "PTTL %s", "wheel:a");
+    EXPECT_GT(reply->integer, 14000);
+    freeReplyObject(reply);
+
+    // wheel:b expires in Redis and drops out of the index.
+    std::this_thread::sleep_for(400ms);
+    reply = (redisReply*)redisCommand(conn, "EXISTS %s", "wheel:b");
+    EXPECT_EQ(reply->integer, 0);
+    freeReplyObject(reply);
+    EXPECT_EQ(ttl_manager.trackedKeys(), 2u);
+
+    ttl_manager.untrack("wheel:c");
+    EXPECT_EQ(ttl_manager.trackedKeys(), 1u);
+    for (const char* key : {"wheel:a", "wheel:c"}) {
+        freeReplyObject(redisCommand(conn, "DEL %s", key));
+    }
+    pool_manager->returnConnection(conn);
+}
+
+TEST(TtlManagerTest, BulkTtlsAndLeaseKeepAlive) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    auto pool_manager = std::make_shared<ConnectionPoolManager>(hosts, 1);
+    TtlManager ttl_manager(pool_manager);
+
+    auto conn = pool_manager->getConnection();
+    ASSERT_NE(conn, nullptr);
+    for (const char* key : {"bulk:a", "bulk:b", "lease:a", "lease:b"}) {
+        freeReplyObject(redisCommand(conn, "SET %s %s", key, "value"));
+    }
+    freeReplyObject(redisCommand(conn, "DEL %s", "bulk:missing"));
+    pool_manager->returnConnection(conn);
+
+    EXPECT_FALSE(ttl_manager.addKey("bulk:missing", 10));
+    auto outcomes = ttl_manager.addKeys({{"bulk:a", 10}, {"bulk:missing", 10}, {"bulk:b", 20}});
+    ASSERT_EQ(outcomes.size(), 3u);
+    EXPECT_EQ(outcomes[0], TtlOutcome::Applied);
+    EXPECT_EQ(outcomes[1], TtlOutcome::KeyMissing);
+    EXPECT_EQ(outcomes[2], TtlOutcome::Applied);
+
+    using namespace std::chrono_literals;
+    ttl_manager.joinGroup("neighbors", "lease:a", 30s);
+    ttl_manager.joinGroup("neighbors", "lease:b", 60s);
+    ttl_manager.joinGroup("neighbors", "bulk:missing", 30s);
+    EXPECT_EQ(ttl_manager.groupSize("neighbors"), 3u);
+
+    size_t applied = 0;
+    for (const auto& [key, outcome] : ttl_manager.keepAlive("neighbors")) {
+        if (key == "bulk:missing") {
+            EXPECT_EQ(outcome, TtlOutcome::KeyMissing);
+        } else {
+            EXPECT_EQ(outcome, TtlOutcome::Applied);
+            ++applied;
+        }
+    }
+    EXPECT_EQ(applied, 2u);
+    // The lost lease left the group.
+    EXPECT_EQ(ttl_manager.groupSize("neighbors"), 2u);
+    ttl_manager.leaveGroup("neighbors", "lease:a");
+    EXPECT_EQ(ttl_manager.groupSize("neighbors"), 1u);
+    EXPECT_TRUE(ttl_manager.keepAlive("unknown").empty());
+
+    conn = pool_manager->getConnection();
+    ASSERT_NE(conn, nullptr);
+    redisReply* reply = (redisReply*)redisCommand(conn, "TTL %s", "bulk:b");
+    EXPECT_GT(reply->integer, 10);
+    freeReplyObject(reply);
+    reply = (redisReply*)redisCommand(conn, "PTTL %s", "lease:b");
+    EXPECT_GT(reply->integer, 50000);
+    freeReplyObject(reply);
+    for (const char* key : {"bulk:a", "bulk:b", "lease:a", "lease:b"}) {
+        freeReplyObject(redisCommand(conn, "DEL %s", key));
+    }
+    pool_manager->returnConnection(conn);
+}
+
+TEST(TtlManagerTest, DeadlinesShorterThanATickStillReachRedis) {
+    std::vector<std::string> hosts = {"127.0.0.1"};
+    auto pool_manager = std::make_shared<ConnectionPoolManager>(hosts, 2);
+    TtlManagerOptions options;
+    options.tick = std::chrono::milliseconds(200);
+    TtlManager ttl_manager(pool_manager, nullptr, options);
+
+    auto conn = pool_manager->getConnection();
+    ASSERT_NE(conn, nullptr);
+    for (const char* key : {"short:a", "short:b"}) {
+        freeReplyObject(redisCommand(conn, "SET %s %s", key, "value"));
+    }
+
+    using namespace std::chrono_literals;
+    ttl_manager.expireAfter("short:a", 5ms);
+    ttl_manager.expireAt("short:b", std::chrono::system_clock::now() - 1s);
+    std::this_thread::sleep_for(600ms);
+
+    for (const char* key : {"short:a", "short:b"}) {
+        redisReply* reply = (redisReply*)redisCommand(conn, "EXISTS %s", key);
+        EXPECT_EQ(reply->integer, 0) << key;
+        freeReplyObject(reply);
+    }
+    EXPECT_EQ(ttl_manager.trackedKeys(), 0u);
+    pool_manager->returnConnection(conn);
+}
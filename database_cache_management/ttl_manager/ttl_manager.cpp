@@ -1,24 +1,312 @@
 #include "ttl_manager.h"
+#include <connection_pool_manager/batch_executor.h>
+#include <connection_pool_manager/redis_connection_guard.h>
 #include <hiredis/hiredis.h>
+#include <iostream>
 #include <stdexcept>
 
-TtlManager::TtlManager(std::shared_ptr<ConnectionPoolManager> pool_manager)
-    : pool_manager_(pool_manager) {
+namespace {
+
+int64_t unixMillis(std::chrono::system_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+}
+
+int64_t nowMillis() {
+    return unixMillis(std::chrono::system_clock::now());
+}
+
+} // namespace
+
+TtlManager::TtlManager(std::shared_ptr<ConnectionPoolManager> pool_manager,
+                       std::shared_ptr<AsyncCommandEngine> async_engine,
+                       const TtlManagerOptions& options)
+    : pool_manager_(pool_manager), async_engine_(async_engine), options_(options),
+      wheel_(options.tick.count(), nowMillis()) {
+    ticker_thread_ = std::thread(&TtlManager::tickLoop, this);
 }
 
 TtlManager::~TtlManager() {
+    {
+        std::lock_guard<std::mutex> lock(ticker_mutex_);
+        stop_ticker_ = true;
+    }
+    ticker_cv_.notify_one();
+    ticker_thread_.join();
+    try {
+        flush();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to send pending TTLs: " << e.what() << std::endl;
+    }
+}
+
+bool TtlManager::addKey(const std::string& key, int ttl_seconds) {
+    RedisConnectionGuard conn(pool_manager_.get());
+
+    redisReply* reply = (redisReply*)redisCommand(conn.getContext(), "EXPIRE %b %d", key.data(), key.size(),
+                                                  ttl_seconds);
+    if (!reply || reply->type != REDIS_REPLY_INTEGER) {
+        if (reply) freeReplyObject(reply);
+        throw std::runtime_error("Failed to set TTL in Redis");
+    }
+
+    bool applied = reply->integer == 1;
+    freeReplyObject(reply);
+    return applied;
+}
+
+std::vector<TtlOutcome> TtlManager::addKeys(const std::vector<KeyTtl>& keys) {
+    std::vector<TtlOutcome> outcomes;
+    outcomes.reserve(keys.size());
+    if (keys.empty()) {
+        return outcomes;
+    }
+
+    BatchExecutor batch(pool_manager_.get());
+    for (const auto& entry : keys) {
+        batch.add({"EXPIRE", entry.key, std::to_string(entry.ttl_seconds)});
+    }
+    batch.execute();
+    for (size_t i = 0; i < keys.size(); ++i) {
+        if (!batch.ok(i)) {
+            outcomes.push_back(TtlOutcome::Failed);
+        } else {
+            outcomes.push_back(batch.integer(i) == 1 ? TtlOutcome::Applied : TtlOutcome::KeyMissing);
+        }
+    }
+    return outcomes;
+}
+
+void TtlManager::joinGroup(const std::string& group, const std::string& key, std::chrono::milliseconds ttl) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    groups_[group][key] = ttl;
+}
+
+void TtlManager::leaveGroup(const std::string& group, const std::string& key) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto it = groups_.find(group);
+    if (it != groups_.end()) {
+        it->second.erase(key);
+        if (it->second.empty()) {
+            groups_.erase(it);
+        }
+    }
+}
+
+size_t TtlManager::groupSize(const std::string& group) const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto it = groups_.find(group);
+    return it == groups_.end() ? 0 : it->second.size();
 }
 
-void TtlManager::addKey(const std::string& key, int ttl_seconds) {
-    auto conn = pool_manager_->getConnection();
-    if (!conn) {
-        throw std::runtime_error("Failed to get Redis connection");
+std::vector<std::pair<std::string, TtlOutcome>> TtlManager::keepAlive(const std::string& group) {
+    std::vector<std::pair<std::string, int64_t>> members; // Key and new deadline
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        auto it = groups_.find(group);
+        if (it == groups_.end()) {
+            return {};
+        }
+        int64_t now = nowMillis();
+        members.reserve(it->second.size());
+        for (const auto& [key, ttl] : it->second) {
+            members.emplace_back(key, now + ttl.count());
+        }
     }
 
-    redisReply* reply = (redisReply*)redisCommand(conn, "EXPIRE %s %d", key.c_str(), ttl_seconds);
-    if (reply) {
-        freeReplyObject(reply);
+    BatchExecutor batch(pool_manager_.get());
+    for (const auto& [key, deadline] : members) {
+        batch.add({"PEXPIREAT", key, std::to_string(deadline)});
     }
+    batch.execute();
 
-    pool_manager_->returnConnection(conn);
+    std::vector<std::pair<std::string, TtlOutcome>> outcomes;
+    outcomes.reserve(members.size());
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    auto group_it = groups_.find(group);
+    for (size_t i = 0; i < members.size(); ++i) {
+        auto& [key, deadline] = members[i];
+        TtlOutcome outcome = TtlOutcome::Failed;
+        if (batch.ok(i)) {
+            outcome = batch.integer(i) == 1 ? TtlOutcome::Applied : TtlOutcome::KeyMissing;
+        }
+        if (outcome == TtlOutcome::Applied && wheel_.contains(key) && dirty_.count(key) == 0) {
+            wheel_.schedule(key, deadline);
+        } else if (outcome == TtlOutcome::KeyMissing && group_it != groups_.end()) {
+            group_it->second.erase(key); // The lease is gone
+        }
+        outcomes.emplace_back(std::move(key), outcome);
+    }
+    if (group_it != groups_.end() && group_it->second.empty()) {
+        groups_.erase(group_it);
+    }
+    return outcomes;
+}
+
+std::future<void> TtlManager::addKeyAsync(const std::string& key, int ttl_seconds) {
+    return asyncToFuture<void>([&](AsyncCallback<void> callback) {
+        addKeyAsync(key, ttl_seconds, std::move(callback));
+    });
+}
+
+void TtlManager::addKeyAsync(const std::string& key, int ttl_seconds, AsyncCallback<void> callback) {
+    if (!async_engine_) {
+        throw std::runtime_error("TtlManager was created without an async engine");
+    }
+    async_engine_->command({"EXPIRE", key, std::to_string(ttl_seconds)},
+                           [callback](const redisReply*, std::exception_ptr error) {
+        callback(error);
+    });
+}
+
+void TtlManager::expireAfter(const std::string& key, std::chrono::milliseconds ttl) {
+    track(key, nowMillis() + ttl.count());
+}
+
+void TtlManager::expireAt(const std::string& key, std::chrono::system_clock::time_point deadline) {
+    track(key, unixMillis(deadline));
+}
+
+bool TtlManager::extend(const std::string& key, std::chrono::milliseconds extra) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    std::optional<int64_t> deadline = wheel_.deadline(key);
+    if (!deadline) {
+        return false;
+    }
+    wheel_.schedule(key, *deadline + extra.count());
+    dirty_.insert(key);
+    return true;
+}
+
+void TtlManager::untrack(const std::string& key) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    wheel_.remove(key);
+    dirty_.erase(key);
+}
+
+std::optional<std::chrono::system_clock::time_point> TtlManager::deadline(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    std::optional<int64_t> deadline = wheel_.deadline(key);
+    if (!deadline) {
+        return std::nullopt;
+    }
+    return std::chrono::system_clock::time_point(std::chrono::milliseconds(*deadline));
+}
+
+std::vector<ExpiringKey> TtlManager::expiringWithin(std::chrono::milliseconds window, size_t limit) const {
+    std::vector<std::pair<std::string, int64_t>> due;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        due = wheel_.dueBefore(nowMillis() + window.count(), limit);
+    }
+    std::vector<ExpiringKey> expiring;
+    expiring.reserve(due.size());
+    for (auto& [key, deadline] : due) {
+        expiring.push_back({std::move(key), std::chrono::system_clock::time_point(std::chrono::milliseconds(deadline))});
+    }
+    return expiring;
+}
+
+size_t TtlManager::trackedKeys() const {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    return wheel_.size();
+}
+
+void TtlManager::track(const std::string& key, int64_t deadline_ms) {
+    std::lock_guard<std::mutex> lock(index_mutex_);
+    if (!wheel_.contains(key) && wheel_.size() >= options_.max_tracked_keys) {
+        throw std::runtime_error("TTL index is full");
+    }
+    wheel_.schedule(key, deadline_ms);
+    dirty_.insert(key);
+}
+
+void TtlManager::flush() {
+    std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+    flushLocked();
+}
+
+void TtlManager::flushLocked() {
+    std::vector<std::pair<std::string, int64_t>> pending;
+    {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        pending.reserve(dirty_.size());
+        for (const auto& key : dirty_) {
+            if (std::optional<int64_t> deadline = wheel_.deadline(key)) {
+                pending.emplace_back(key, *deadline);
+            }
+        }
+        dirty_.clear();
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    std::string error;
+    std::vector<std::string> missing;
+    try {
+        BatchExecutor batch(pool_manager_.get());
+        for (const auto& [key, deadline] : pending) {
+            batch.add({"PEXPIREAT", key, std::to_string(deadline)});
+        }
+        batch.execute();
+
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        for (size_t i = 0; i < pending.size(); ++i) {
+            const std::string& key = pending[i].first;
+            if (!batch.ok(i)) {
+                // Retried at the next flush, unless it was dropped meanwhile.
+                if (wheel_.contains(key)) {
+                    dirty_.insert(key);
+                }
+                if (error.empty()) {
+                    error = batch.error(i);
+                }
+            } else if (batch.integer(i) == 0 && wheel_.deadline(key) == pending[i].second &&
+                       dirty_.count(key) == 0) {
+                wheel_.remove(key); // No such key in Redis
+            }
+        }
+    } catch (const std::exception& e) {
+        std::lock_guard<std::mutex> lock(index_mutex_);
+        for (const auto& entry : pending) {
+            if (wheel_.contains(entry.first)) {
+                dirty_.insert(entry.first);
+            }
+        }
+        throw std::runtime_error(std::string("Failed to send TTLs to Redis: ") + e.what());
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Failed to send TTLs to Redis: " + error);
+    }
+}
+
+void TtlManager::tickLoop() {
+    std::unique_lock<std::mutex> lock(ticker_mutex_);
+    while (!ticker_cv_.wait_for(lock, options_.tick, [this]() { return stop_ticker_; })) {
+        lock.unlock();
+        {
+            // Flush first: a deadline that passes before its PEXPIREAT is
+            // sent must still go out, and Redis then deletes the key. Holding
+            // flush_mutex_ through the advance keeps a concurrent flush()
+            // from taking keys out of dirty_ that are still in flight.
+            std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+            try {
+                flushLocked();
+            } catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            std::lock_guard<std::mutex> index_lock(index_mutex_);
+            // Keys whose PEXPIREAT failed stay tracked until it is sent.
+            std::vector<std::pair<std::string, int64_t>> unsent;
+            wheel_.advance(nowMillis(), [this, &unsent](const std::string& key) {
+                if (dirty_.count(key) > 0) {
+                    unsent.emplace_back(key, *wheel_.deadline(key));
+                }
+            });
+            for (const auto& [key, deadline] : unsent) {
+                wheel_.schedule(key, deadline);
+            }
+        }
+        lock.lock();
+    }
 }
@@ -2,12 +2,55 @@
 #define TTL_MANAGER_H
 
 #include <connection_pool_manager/connection_pool_manager.h>
+#include <async_command_engine/async_command_engine.h>
+#include "expiration_wheel.h"
 #include <string>
 #include <memory>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+
+struct TtlManagerOptions {
+    // Resolution of the expiration index. Deadline changes are sent to
+    // Redis once per tick.
+    std::chrono::milliseconds tick{100};
+    // Upper bound on tracked keys; tracking more throws.
+    size_t max_tracked_keys = 1000000;
+};
+
+// One key of TtlManager::addKeys().
+struct KeyTtl {
+    std::string key;
+    int ttl_seconds = 0;
+};
+
+// Per-key result of the bulk TTL operations.
+enum class TtlOutcome {
+    Applied,
+    KeyMissing, // Redis has no such key, so no TTL was set
+    Failed      // Error reply or lost connection
+};
+
+struct ExpiringKey {
+    std::string key;
+    std::chrono::system_clock::time_point deadline;
+};
 
 class TtlManager {
 public:
-    TtlManager(std::shared_ptr<ConnectionPoolManager> pool_manager);
+    // The async engine is optional; without it the *Async operations throw.
+    TtlManager(std::shared_ptr<ConnectionPoolManager> pool_manager,
+               std::shared_ptr<AsyncCommandEngine> async_engine = nullptr,
+               const TtlManagerOptions& options = TtlManagerOptions());
+    // Sends deadline changes that are still pending.
     ~TtlManager();
 
     // Deleted copy and move constructors/assignments
@@ -16,10 +59,68 @@ public:
     TtlManager(TtlManager&&) = delete;
     TtlManager& operator=(TtlManager&&) = delete;
 
-    void addKey(const std::string& key, int ttl_seconds);
+    // Returns false if the key does not exist. Throws std::runtime_error if
+    // Redis fails the command.
+    bool addKey(const std::string& key, int ttl_seconds);
+    // Sets many TTLs in one pipelined batch on a single connection and
+    // reports each key's outcome, in input order. Throws only if no
+    // connection can be had.
+    std::vector<TtlOutcome> addKeys(const std::vector<KeyTtl>& keys);
+
+    // Lease groups: named sets of keys whose TTLs are refreshed together.
+    // keepAlive() sends one PEXPIREAT per member (now plus its TTL) in a
+    // single pipelined batch and returns each member's outcome; members
+    // Redis no longer has are dropped from the group. Tracked members'
+    // deadlines in the expiration index move along.
+    void joinGroup(const std::string& group, const std::string& key, std::chrono::milliseconds ttl);
+    void leaveGroup(const std::string& group, const std::string& key);
+    std::vector<std::pair<std::string, TtlOutcome>> keepAlive(const std::string& group);
+    size_t groupSize(const std::string& group) const;
+
+    // Tracked keys. expireAfter(), expireAt() and extend() only record the
+    // deadline in a local expiration index (a timing wheel); every tick, the
+    // deadlines changed since the last one go out as one pipelined batch of
+    // PEXPIREAT. Keys leave the index once their deadline has passed and
+    // been sent, when Redis reports them missing, or through untrack().
+    void expireAfter(const std::string& key, std::chrono::milliseconds ttl);
+    void expireAt(const std::string& key, std::chrono::system_clock::time_point deadline);
+    // Pushes a tracked key's deadline back. Returns false if it is not tracked.
+    bool extend(const std::string& key, std::chrono::milliseconds extra);
+    // Stops tracking the key; its TTL in Redis stays as last sent.
+    void untrack(const std::string& key);
+    std::optional<std::chrono::system_clock::time_point> deadline(const std::string& key) const;
+    // Tracked keys expiring within the window, soonest first.
+    std::vector<ExpiringKey> expiringWithin(std::chrono::milliseconds window, size_t limit = SIZE_MAX) const;
+    size_t trackedKeys() const;
+    // Sends pending deadline changes now rather than at the next tick.
+    // Throws std::runtime_error if some failed; those are retried later.
+    void flush();
+
+    // Non-blocking variants on the async engine. Callbacks run on an engine
+    // event loop thread and must not block.
+    std::future<void> addKeyAsync(const std::string& key, int ttl_seconds);
+    void addKeyAsync(const std::string& key, int ttl_seconds, AsyncCallback<void> callback);
 
 private:
+    void track(const std::string& key, int64_t deadline_ms);
+    void flushLocked(); // Caller holds flush_mutex_
+    void tickLoop();
+
     std::shared_ptr<ConnectionPoolManager> pool_manager_;
+    std::shared_ptr<AsyncCommandEngine> async_engine_;
+    const TtlManagerOptions options_;
+
+    mutable std::mutex index_mutex_; // Guards wheel_, dirty_ and groups_
+    ExpirationWheel wheel_;
+    std::unordered_set<std::string> dirty_; // Deadline changed since the last flush
+    // Lease group name to member keys and their TTLs.
+    std::unordered_map<std::string, std::unordered_map<std::string, std::chrono::milliseconds>> groups_;
+    std::mutex flush_mutex_; // Keeps flushes, and so the PEXPIREATs per key, in order
+
+    std::mutex ticker_mutex_;
+    std::condition_variable ticker_cv_;
+    bool stop_ticker_ = false;
+    std::thread ticker_thread_;
 };
 
 #endif // TTL_MANAGER_H